@@ -0,0 +1,120 @@
+#include "admission.h"
+
+namespace ss {
+namespace net {
+
+const std::uint32_t admission::MAX_BURST;
+const std::uint32_t admission::MAX_CONNECTIONS;
+
+admission::admission(std::uint32_t a_slots, std::uint32_t a_rate, std::uint32_t a_burst, std::uint32_t a_max_connections)
+: m_rate(a_rate)
+, m_burst(std::uint64_t(std::min(std::max(a_burst, 1u), MAX_BURST)) * TOKEN_ONE)
+, m_max_connections(std::min(a_max_connections, MAX_CONNECTIONS))
+, m_epoch(std::chrono::steady_clock::now())
+, m_used(0)
+{
+	// power of two slots so the probe sequence is a mask away
+	std::size_t l_slots = 64;
+	while (l_slots < a_slots)
+		l_slots <<= 1;
+	m_slots = std::vector<slot>(l_slots);
+	m_mask = l_slots - 1;
+	for (auto& i : m_slots) {
+		i.m_key.store(0, std::memory_order_relaxed);
+		i.m_state.store(0, std::memory_order_relaxed);
+	}
+}
+
+admission::~admission()
+{
+
+}
+
+std::uint32_t admission::now_ms() const
+{
+	// wraps after 49 days, bucket arithmetic is done modulo 2^32
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+std::uint64_t admission::refill(std::uint64_t a_state, std::uint32_t a_now) const
+{
+	std::uint64_t l_tokens = tokens_of(a_state);
+	std::uint32_t l_elapsed = a_now - ms_of(a_state);
+	l_tokens += std::uint64_t(l_elapsed) * m_rate * TOKEN_ONE / 1000;
+	return std::min(l_tokens, m_burst);
+}
+
+std::size_t admission::hash(std::uint64_t a_key) const
+{
+	// fibonacci hashing, addresses from one network differ only in their low bits
+	return (a_key * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+admission::verdict admission::admit(std::uint32_t a_addr, int& a_slot)
+{
+	a_slot = -1;
+	std::uint64_t l_key = std::uint64_t(a_addr) + 1;
+	std::uint32_t l_now = now_ms();
+	// find the address, remembering the first slot that could be taken over should it not be
+	// there: never used, or holding an address with no connections and a full bucket, which is
+	// indistinguishable from one we've never seen. Only this thread adds connections, so such a
+	// slot stays idle until we're done with it.
+	slot *l_found = nullptr;
+	slot *l_free = nullptr;
+	std::size_t l_pos = hash(l_key);
+	for (unsigned int i = 0; i < PROBE_LIMIT; ++i) {
+		slot& l_slot = m_slots[(l_pos + i) & m_mask];
+		std::uint64_t l_slot_key = l_slot.m_key.load(std::memory_order_acquire);
+		if (l_slot_key == l_key) {
+			l_found = &l_slot;
+			break;
+		}
+		if (l_free != nullptr)
+			continue;
+		if (l_slot_key == 0) {
+			l_free = &l_slot;
+			break; // nothing past an unused slot
+		}
+		std::uint64_t l_state = l_slot.m_state.load(std::memory_order_acquire);
+		if ((connections_of(l_state) == 0) && ((m_rate == 0) || (refill(l_state, l_now) == m_burst)))
+			l_free = &l_slot;
+	}
+	if (l_found == nullptr) {
+		if (l_free == nullptr)
+			return ADMIT_TABLE_FULL;
+		if (l_free->m_key.load(std::memory_order_relaxed) == 0)
+			m_used.fetch_add(1, std::memory_order_relaxed);
+		l_free->m_state.store(pack(l_now, m_burst, 0), std::memory_order_relaxed);
+		l_free->m_key.store(l_key, std::memory_order_release);
+		l_found = l_free;
+	}
+	// take a token and a connection in one go, releases may be racing us for the word
+	std::uint64_t l_state = l_found->m_state.load(std::memory_order_acquire);
+	while (1) {
+		std::uint64_t l_tokens = m_burst;
+		if (m_rate != 0) {
+			l_tokens = refill(l_state, l_now);
+			if (l_tokens < TOKEN_ONE)
+				return REJECT_RATE;
+			l_tokens -= TOKEN_ONE;
+		}
+		std::uint64_t l_connections = connections_of(l_state);
+		if (((m_max_connections != 0) && (l_connections >= m_max_connections)) || (l_connections == MAX_CONNECTIONS))
+			return REJECT_CONNECTIONS;
+		if (l_found->m_state.compare_exchange_weak(l_state, pack(l_now, l_tokens, l_connections + 1), std::memory_order_acq_rel))
+			break;
+	}
+	a_slot = l_found - m_slots.data();
+	return ADMIT;
+}
+
+void admission::release(int a_slot)
+{
+	if ((a_slot < 0) || (std::size_t(a_slot) >= m_slots.size()))
+		return;
+	// the slot can't be taken over while it counts a connection, so it's still ours to decrement
+	m_slots[a_slot].m_state.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+} // namespace net
+} // namespace ss
@@ -0,0 +1,72 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+
+namespace ss {
+namespace net {
+
+// per source address connection admission: a token bucket limiting the rate of new connections
+// and a cap on concurrent ones. Addresses live in a fixed size open addressing table whose slots
+// each pack the whole bucket state into one atomic word, so nothing is ever locked. Only one
+// thread (the accepting one) may call admit(), release() is safe from anywhere.
+
+class admission {
+public:
+	enum verdict {
+		ADMIT,
+		REJECT_RATE, // out of tokens
+		REJECT_CONNECTIONS, // at the concurrent connection cap
+		ADMIT_TABLE_FULL // no slot for the address, let in unchecked
+	};
+
+	// a_rate in connections per second (0 = no limit), a_burst tokens (at most MAX_BURST),
+	// a_max_connections concurrent per address (0 = no limit, at most MAX_CONNECTIONS)
+	admission(std::uint32_t a_slots, std::uint32_t a_rate, std::uint32_t a_burst, std::uint32_t a_max_connections);
+	~admission();
+
+	const static std::uint32_t MAX_BURST = 255;
+	const static std::uint32_t MAX_CONNECTIONS = 65535;
+
+	// on ADMIT a_slot is set to the slot that counts the connection, which has to be handed
+	// to release() when it closes. It is -1 otherwise.
+	verdict admit(std::uint32_t a_addr, int& a_slot);
+	void release(int a_slot);
+	std::size_t slots() const { return m_slots.size(); }
+	std::size_t used() const { return m_used.load(std::memory_order_relaxed); }
+
+protected:
+	// state word: | ms timestamp of last refill (32) | tokens in 1/256ths (16) | connections (16) |
+	const static unsigned int PROBE_LIMIT = 32;
+	const static std::uint64_t TOKEN_ONE = 256;
+
+	struct slot {
+		std::atomic<std::uint64_t> m_key; // address + 1, 0 = never used
+		std::atomic<std::uint64_t> m_state;
+	};
+
+	static std::uint64_t pack(std::uint32_t a_ms, std::uint64_t a_tokens, std::uint64_t a_connections) { return (std::uint64_t(a_ms) << 32) | (a_tokens << 16) | a_connections; }
+	static std::uint32_t ms_of(std::uint64_t a_state) { return a_state >> 32; }
+	static std::uint64_t tokens_of(std::uint64_t a_state) { return (a_state >> 16) & 0xffff; }
+	static std::uint64_t connections_of(std::uint64_t a_state) { return a_state & 0xffff; }
+	std::uint32_t now_ms() const;
+	std::uint64_t refill(std::uint64_t a_state, std::uint32_t a_now) const; // tokens after refilling
+	std::size_t hash(std::uint64_t a_key) const;
+
+	std::vector<slot> m_slots;
+	std::size_t m_mask;
+	std::uint32_t m_rate;
+	std::uint64_t m_burst; // in 1/256ths
+	std::uint32_t m_max_connections;
+	std::chrono::steady_clock::time_point m_epoch;
+	std::atomic<std::size_t> m_used;
+};
+
+} // namespace net
+} // namespace ss
+
+#endif // ADMISSION_H
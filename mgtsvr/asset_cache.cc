@@ -0,0 +1,105 @@
+#include "asset_cache.h"
+
+namespace ss {
+namespace net {
+
+const double asset_cache::CHECK_INTERVAL = 1.0;
+
+asset_cache::asset_cache()
+{
+
+}
+
+asset_cache::~asset_cache()
+{
+
+}
+
+std::shared_ptr<const std::string> asset_cache::get(const std::string& a_path)
+{
+	{
+		std::lock_guard<std::mutex> l_guard(m_mtx);
+		auto l_it = m_assets.find(a_path);
+		if (l_it != m_assets.end())
+			return l_it->second.m_payload;
+	}
+	// first use. Two callers may both load it, the second one's copy is the one kept.
+	asset l_asset;
+	load(a_path, nullptr, l_asset);
+	std::lock_guard<std::mutex> l_guard(m_mtx);
+	m_assets[a_path] = l_asset;
+	if (m_next_check.load(std::memory_order_relaxed) == 0.0)
+		m_next_check.store(ss::doubletime::now_as_double() + CHECK_INTERVAL, std::memory_order_relaxed);
+	return l_asset.m_payload;
+}
+
+bool asset_cache::check_due()
+{
+	double l_next = m_next_check.load(std::memory_order_relaxed);
+	if (l_next == 0.0)
+		return false; // nothing cached yet
+	double l_now = ss::doubletime::now_as_double();
+	if (l_now < l_next)
+		return false;
+	return m_next_check.compare_exchange_strong(l_next, l_now + CHECK_INTERVAL, std::memory_order_relaxed);
+}
+
+bool asset_cache::load(const std::string& a_path, const asset *a_old, asset& a_asset)
+{
+	std::error_code l_ec;
+	std::filesystem::file_time_type l_mtime = std::filesystem::last_write_time(a_path, l_ec);
+	std::uintmax_t l_size = l_ec ? 0 : std::filesystem::file_size(a_path, l_ec);
+	if (l_ec) {
+		if ((a_old == nullptr) || a_old->m_payload)
+			ctx.log_p(ss::log::WARNING, std::format("asset_cache: unable to read {}: {}", a_path, l_ec.message()));
+		a_asset.m_payload.reset();
+		return false;
+	}
+	if ((a_old != nullptr) && a_old->m_payload && (a_old->m_mtime == l_mtime) && (a_old->m_size == l_size)) {
+		a_asset = *a_old;
+		return true;
+	}
+	std::string l_contents;
+	try {
+		ss::data l_load;
+		l_load.load_file(a_path);
+		l_contents = l_load.read_std_str(l_load.size());
+	} catch (std::exception& e) {
+		ctx.log_p(ss::log::WARNING, std::format("asset_cache: unable to load {}: {}", a_path, e.what()));
+		a_asset.m_payload.reset();
+		return false;
+	}
+	l_contents += '\n';
+	a_asset.m_payload = std::make_shared<const std::string>(std::move(l_contents));
+	a_asset.m_mtime = l_mtime;
+	a_asset.m_size = l_size;
+	ctx.log(std::format("asset_cache: loaded {} ({} bytes)", a_path, l_size));
+	return true;
+}
+
+void asset_cache::revalidate()
+{
+	std::lock_guard<std::mutex> l_revalidate_guard(m_revalidate_mtx);
+	std::map<std::string, asset> l_assets;
+	{
+		std::lock_guard<std::mutex> l_guard(m_mtx);
+		l_assets = m_assets;
+	}
+	// get() keeps handing out the old payloads while we're at the disk
+	for (auto& [l_path, l_asset] : l_assets) {
+		asset l_old = l_asset;
+		load(l_path, &l_old, l_asset);
+	}
+	std::lock_guard<std::mutex> l_guard(m_mtx);
+	for (auto& [l_path, l_asset] : l_assets)
+		m_assets[l_path] = l_asset;
+}
+
+void asset_cache::refresh()
+{
+	revalidate();
+	m_next_check.store(ss::doubletime::now_as_double() + CHECK_INTERVAL, std::memory_order_relaxed);
+}
+
+} // namespace net
+} // namespace ss
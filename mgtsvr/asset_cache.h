@@ -0,0 +1,62 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <filesystem>
+#include <format>
+
+#include "data.h"
+#include "log.h"
+#include "doubletime.h"
+
+namespace ss {
+namespace net {
+
+// static files sent to clients (banners, help). Each is loaded once and handed out as a shared
+// immutable payload, ready to be attached to any number of output queues without copying. get()
+// never touches the disk for a file it has seen: the files are looked at again by revalidate(),
+// which the owner runs off its hot paths when check_due() says CHECK_INTERVAL seconds have gone
+// by, and by refresh(). Payloads already handed out stay valid, a reload only replaces what
+// later callers get.
+
+class asset_cache {
+public:
+	asset_cache();
+	~asset_cache();
+
+	const static double CHECK_INTERVAL; // seconds
+
+	// the file's contents followed by a newline, as send_to_client() would write them.
+	// nullptr if the file can't be read. Only a file's first use reads it.
+	std::shared_ptr<const std::string> get(const std::string& a_path);
+	// true for exactly one caller once the files are due a look, that caller should see to it
+	// that revalidate() is run
+	bool check_due();
+	// stats every file and reloads those that have changed, the lock isn't held while it does
+	void revalidate();
+	void refresh(); // revalidates right away
+
+protected:
+	struct asset {
+		std::shared_ptr<const std::string> m_payload;
+		std::filesystem::file_time_type m_mtime;
+		std::uintmax_t m_size = 0;
+	};
+	// reads the file if it isn't the one a_old describes, no lock needed. false if it can't be read.
+	bool load(const std::string& a_path, const asset *a_old, asset& a_asset);
+
+	ss::log::ctx& ctx = ss::log::ctx::get();
+	std::mutex m_mtx;
+	std::map<std::string, asset> m_assets;
+	std::atomic<double> m_next_check{0.0};
+	std::mutex m_revalidate_mtx; // one revalidate() at a time
+};
+
+} // namespace net
+} // namespace ss
+
+#endif // ASSET_CACHE_H
@@ -0,0 +1,191 @@
+#include "circbuff.h"
+
+namespace ss {
+namespace net {
+
+circbuff::circbuff()
+: m_capacity(0)
+, m_head(0)
+, m_size(0)
+, m_scanned(0)
+{
+
+}
+
+circbuff::~circbuff()
+{
+
+}
+
+circbuff::circbuff(const circbuff& a_circbuff)
+: m_capacity(0)
+, m_head(0)
+, m_size(0)
+, m_scanned(0)
+{
+	*this = a_circbuff;
+}
+
+circbuff& circbuff::operator=(const circbuff& a_circbuff)
+{
+	if (this == &a_circbuff)
+		return *this;
+	clear();
+	struct iovec l_iov[2];
+	int l_cnt = a_circbuff.data_segments(l_iov);
+	for (int i = 0; i < l_cnt; ++i)
+		write((const std::uint8_t *)l_iov[i].iov_base, l_iov[i].iov_len);
+	return *this;
+}
+
+void circbuff::clear()
+{
+	m_head = 0;
+	m_size = 0;
+	m_scanned = 0;
+}
+
+void circbuff::regrow(std::size_t a_capacity)
+{
+	// linearize into a fresh buffer
+	std::unique_ptr<std::uint8_t[]> l_buffer = std::make_unique<std::uint8_t[]>(a_capacity);
+	struct iovec l_iov[2];
+	int l_cnt = data_segments(l_iov);
+	std::size_t l_pos = 0;
+	for (int i = 0; i < l_cnt; ++i) {
+		memcpy(l_buffer.get() + l_pos, l_iov[i].iov_base, l_iov[i].iov_len);
+		l_pos += l_iov[i].iov_len;
+	}
+	m_buffer = std::move(l_buffer);
+	m_capacity = a_capacity;
+	m_head = 0;
+}
+
+void circbuff::reserve(std::size_t a_len)
+{
+	if (available() >= a_len)
+		return;
+	std::size_t l_capacity = (m_capacity == 0) ? MIN_CAPACITY : m_capacity;
+	while (l_capacity - m_size < a_len)
+		l_capacity *= 2;
+	regrow(l_capacity);
+}
+
+int circbuff::free_segments(struct iovec *a_iov)
+{
+	if (available() == 0)
+		return 0;
+	std::size_t l_tail = (m_head + m_size) % m_capacity;
+	if (l_tail >= m_head) {
+		// free space runs from tail to end of buffer, then wraps to head
+		a_iov[0].iov_base = m_buffer.get() + l_tail;
+		a_iov[0].iov_len = m_capacity - l_tail;
+		if (m_head == 0)
+			return 1;
+		a_iov[1].iov_base = m_buffer.get();
+		a_iov[1].iov_len = m_head;
+		return 2;
+	}
+	a_iov[0].iov_base = m_buffer.get() + l_tail;
+	a_iov[0].iov_len = m_head - l_tail;
+	return 1;
+}
+
+void circbuff::commit(std::size_t a_len)
+{
+	m_size += a_len;
+}
+
+void circbuff::write(const std::uint8_t *a_data, std::size_t a_len)
+{
+	reserve(a_len);
+	struct iovec l_iov[2];
+	int l_cnt = free_segments(l_iov);
+	std::size_t l_pos = 0;
+	for (int i = 0; (i < l_cnt) && (l_pos < a_len); ++i) {
+		std::size_t l_chunk = std::min(a_len - l_pos, l_iov[i].iov_len);
+		memcpy(l_iov[i].iov_base, a_data + l_pos, l_chunk);
+		l_pos += l_chunk;
+	}
+	commit(a_len);
+}
+
+int circbuff::data_segments(struct iovec *a_iov) const
+{
+	if (m_size == 0)
+		return 0;
+	if (m_head + m_size <= m_capacity) {
+		a_iov[0].iov_base = m_buffer.get() + m_head;
+		a_iov[0].iov_len = m_size;
+		return 1;
+	}
+	a_iov[0].iov_base = m_buffer.get() + m_head;
+	a_iov[0].iov_len = m_capacity - m_head;
+	a_iov[1].iov_base = m_buffer.get();
+	a_iov[1].iov_len = m_size - a_iov[0].iov_len;
+	return 2;
+}
+
+int circbuff::data_segments(struct iovec *a_iov, std::size_t a_offset, std::size_t a_len) const
+{
+	if ((a_len == 0) || (a_offset >= m_size))
+		return 0;
+	if (a_offset + a_len > m_size)
+		a_len = m_size - a_offset;
+	std::size_t l_start = (m_head + a_offset) % m_capacity;
+	if (l_start + a_len <= m_capacity) {
+		a_iov[0].iov_base = m_buffer.get() + l_start;
+		a_iov[0].iov_len = a_len;
+		return 1;
+	}
+	a_iov[0].iov_base = m_buffer.get() + l_start;
+	a_iov[0].iov_len = m_capacity - l_start;
+	a_iov[1].iov_base = m_buffer.get();
+	a_iov[1].iov_len = a_len - a_iov[0].iov_len;
+	return 2;
+}
+
+void circbuff::consume(std::size_t a_len)
+{
+	if (a_len >= m_size) {
+		clear();
+		return;
+	}
+	m_head = (m_head + a_len) % m_capacity;
+	m_size -= a_len;
+	m_scanned = (m_scanned > a_len) ? m_scanned - a_len : 0;
+}
+
+std::optional<std::string> circbuff::read_std_str_delim(std::uint8_t a_delim)
+{
+	// look for the delimiter, skipping whatever we already scanned on a previous call
+	struct iovec l_iov[2];
+	int l_cnt = data_segments(l_iov);
+	std::size_t l_base = 0;
+	for (int i = 0; i < l_cnt; ++i) {
+		std::size_t l_len = l_iov[i].iov_len;
+		if (m_scanned < l_base + l_len) {
+			std::size_t l_skip = (m_scanned > l_base) ? m_scanned - l_base : 0;
+			const std::uint8_t *l_start = (const std::uint8_t *)l_iov[i].iov_base + l_skip;
+			const std::uint8_t *l_found = (const std::uint8_t *)memchr(l_start, a_delim, l_len - l_skip);
+			if (l_found != nullptr) {
+				std::size_t l_linelen = l_base + (l_found - (const std::uint8_t *)l_iov[i].iov_base);
+				std::string l_ret;
+				l_ret.resize(l_linelen);
+				std::size_t l_first = std::min(l_linelen, l_iov[0].iov_len);
+				memcpy(l_ret.data(), l_iov[0].iov_base, l_first);
+				if (l_linelen > l_first)
+					memcpy(l_ret.data() + l_first, l_iov[1].iov_base, l_linelen - l_first);
+				consume(l_linelen + 1);
+				m_scanned = 0;
+				return l_ret;
+			}
+		}
+		l_base += l_len;
+	}
+	m_scanned = m_size;
+	return std::nullopt;
+}
+
+} // namespace net
+} // namespace ss
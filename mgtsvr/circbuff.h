@@ -0,0 +1,59 @@
+#ifndef CIRCBUFF_H
+#define CIRCBUFF_H
+
+#include <string>
+#include <optional>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <sys/uio.h>
+
+namespace ss {
+namespace net {
+
+// growable circular byte buffer that exposes its free and used regions as iovecs, so
+// sockets can be drained with readv() straight into the tail and flushed with writev()
+// straight from the head without going through an intermediate buffer.
+
+class circbuff {
+public:
+	circbuff();
+	~circbuff();
+	circbuff(const circbuff& a_circbuff);
+	circbuff& operator=(const circbuff& a_circbuff);
+
+	std::size_t size() const { return m_size; }
+	std::size_t capacity() const { return m_capacity; }
+	std::size_t available() const { return m_capacity - m_size; }
+	void clear();
+
+	// producer side
+	void reserve(std::size_t a_len); // guarantee at least a_len bytes of free space at the tail
+	int free_segments(struct iovec *a_iov); // fills up to 2 iovecs, returns count
+	void commit(std::size_t a_len); // a_len bytes were written into the free segments
+	void write(const std::uint8_t *a_data, std::size_t a_len);
+
+	// consumer side
+	int data_segments(struct iovec *a_iov) const; // fills up to 2 iovecs, returns count
+	int data_segments(struct iovec *a_iov, std::size_t a_offset, std::size_t a_len) const; // same, for a range of used bytes
+	void consume(std::size_t a_len);
+	std::optional<std::string> read_std_str_delim(std::uint8_t a_delim = '\n');
+
+	const static std::size_t MIN_CAPACITY = 1024;
+
+protected:
+	void regrow(std::size_t a_capacity);
+
+	std::unique_ptr<std::uint8_t[]> m_buffer;
+	std::size_t m_capacity;
+	std::size_t m_head; // offset of first used byte
+	std::size_t m_size; // used bytes
+	std::size_t m_scanned; // bytes from head already known not to contain a delimiter
+};
+
+} // namespace net
+} // namespace ss
+
+#endif // CIRCBUFF_H
@@ -3,27 +3,33 @@
 namespace ss {
 namespace net {
 
+// first output timestamp of the command the current worker is running, if any
+static thread_local std::uint64_t *s_first_output = nullptr;
+
+// output of the batch of commands the current worker is running. Lines for the batch's client
+// are collected here, and go onto its output queue in one piece when something else needs to
+// follow them there or the batch is done.
+struct output_batch {
+	int m_fd = -1; // client being batched for, -1 = none
+	std::uint32_t m_serial = 0; // and which one, output is dropped if the fd changes hands meanwhile
+	std::string m_text;
+	bool m_queued = false; // output went straight onto the client's queue and still wants flushing
+};
+static thread_local output_batch s_batch;
+
+// connections that data_from_client() found new commands for, queued together once the
+// reactor has been through all its clients
+static thread_local std::vector<int> s_ready;
+
 command_server::command_server(const std::string& a_category, const std::string& a_auth_db)
 : ss::net::server_base(a_category)
 , m_auth_db_filename(a_auth_db)
+, m_queue(queue_capacity())
 {
 	ctx.log("command_server starting up..");
 	ss::icr& l_icr = ss::icr::get();
 
-	if (l_icr.key_is_defined(m_category, "banner")) {
-		m_banner = l_icr.to_boolean(l_icr.keyvalue(m_category, "banner"));
-		m_banner_file = l_icr.keyvalue(m_category, "banner_file");
-	}
-	if (l_icr.key_is_defined(m_category, "logon_banner")) {
-		m_logon_banner = l_icr.to_boolean(l_icr.keyvalue(m_category, "logon_banner"));
-		m_logon_banner_file = l_icr.keyvalue(m_category, "logon_banner_file");
-	}
-	if (m_banner) {
-		ctx.log(std::format("banner ACTIVE, file = {}", m_banner_file));
-	}
-	if (m_logon_banner) {
-		ctx.log(std::format("logon banner ACTIVE, file = {}", m_logon_banner_file));
-	}
+	load_banners();
 	// we are in charge of processing user commands, so we configure the auth layer
 	bool l_load = load_authdb(m_auth_db_filename);
 	ctx.log(std::format("loaded auth_db ({}): {})", m_auth_db_filename, l_load));
@@ -50,181 +56,807 @@ command_server::command_server(const std::string& a_category, const std::string&
 	}
 	m_prompts = l_icr.to_boolean(l_icr.keyvalue(m_category, "prompts"));
 
+	// built in commands go into the registry before any worker can look one up
+	register_internal_commands();
+
 	// start worker threads
-	if (!l_icr.key_is_defined(m_category, "worker_threads")) {
-		ctx.log_p(ss::log::ERR, "key <worker_threads> must be defined in ini file, exiting!");
-		throw std::runtime_error("command_server: key <worker_threads> must be defined in ini file, exiting!");
-	}
-	m_worker_threads = l_icr.to_integer(l_icr.keyvalue(m_category, "worker_threads"));
-	// sanity check number of worker threads
-	if ((m_worker_threads > 32) || (m_worker_threads == 0)) {
-		ctx.log_p(ss::log::ERR, "key <worker_threads> can be set to a maximum of 32 and may not be zero.");
-		throw std::runtime_error("command_server: key <worker_threads> can be set to a maximum of 32 and may not be zero.");
-	}
-	m_finish_sem_mutex.lock();
-	m_finish_sem = 0;
-	for (std::size_t i = 1; i <= m_worker_threads; ++i) {
-		std::string l_name = std::format("{}_work{}", m_category, i);
-		std::thread l_work_thr(&command_server::worker_thread, this, l_name);
-		l_work_thr.detach();
-		m_finish_sem++;
+	if (!configure_pool())
+		throw std::runtime_error("command_server: invalid worker pool settings, exiting!");
+	// we're not up until every worker can take a command
+	std::latch l_ready(m_workers_min.load());
+	{
+		std::lock_guard<std::mutex> l_guard(m_pool_mtx);
+		resize_pool(&l_ready);
 	}
-	m_finish_sem_mutex.unlock();
+	l_ready.wait();
+	update_pool_manager();
+	add_stats_source([this]() {
+		publish_command_stats();
+	});
 
 	ctx.log("command processor UP");
 }
 
 command_server::~command_server()
 {
+	// normally shutdown() has done this already, but the workers mustn't outlive us either way
+	stop_workers();
 }
 
 void command_server::shutdown()
 {
 	ctx.log("Shutting down command_server subsystem..");
+	// each phase is timed, a slow shutdown (or HUP) shows where it spent its time
+	auto l_start = std::chrono::steady_clock::now();
+	auto l_phase = l_start;
+	auto l_lap = [&l_phase]() {
+		auto l_now = std::chrono::steady_clock::now();
+		double l_ms = std::chrono::duration<double, std::milli>(l_now - l_phase).count();
+		l_phase = l_now;
+		return l_ms;
+	};
 
-	// tell everybody we're shutting down
-	std::set<int> l_clients;
-	// grab list of connected clients
-	m_client_list_mtx.lock();
-	for (auto& [key, value] : m_client_list)
-		l_clients.insert(key);
-	m_client_list_mtx.unlock();
-	// iterate the set and send out the broadcast
-	for (auto& i : l_clients) {
-		lock_client_output(i);
-		send_to_client_atomic(i, "[command_server: system is shutting down immediately]");
-		send_to_client_atomic(i, "disconnecting...");
-		unlock_client_output(i);
-	}
-
-	// shut down the work queue - no more command execution at this point
-	m_queue.shut_down();
-	// wait for worker threads to finish up
-	do {
-		m_finish_sem_mutex.lock();
-//		std::cout << "m_finish_sem is " << m_finish_sem << std::endl;
-		if (m_finish_sem == 0) {
-			m_finish_sem_mutex.unlock();
-			break;
+	// tell everybody we're shutting down, and wait until it's queued for all of them. The reactors
+	// do the telling, so if they're stuck (or gone) we only wait so long: the promise is shared,
+	// a late completion finds it still there.
+	auto l_told = std::make_shared<std::promise<void>>();
+	std::future<void> l_told_future = l_told->get_future();
+	fan_out(std::make_shared<const std::string>("[command_server: system is shutting down immediately]\ndisconnecting...\n"), nullptr, [l_told](std::size_t a_reached) {
+		l_told->set_value();
+	});
+	int l_notice_ms = SHUTDOWN_NOTICE_MS;
+	if (l_told_future.wait_for(std::chrono::milliseconds(l_notice_ms)) == std::future_status::timeout)
+		ctx.log_p(ss::log::WARNING, std::format("shutdown: reactors didn't get round to telling clients within {} ms, going ahead", l_notice_ms));
+	ctx.log(std::format("shutdown: clients told in {:.3f} ms", l_lap()));
+
+	// no more command execution at this point
+	stop_workers();
+	ctx.log(std::format("shutdown: worker threads completed in {:.3f} ms", l_lap()));
+
+	if (m_upgraded) {
+		// upgrade() saved it before the successor read it, from then on it's the successor's
+		ctx.log("shutdown: upgraded, auth_db left to our successor");
+	} else {
+		// log everybody off
+		for (auto& [key, value] : m_user_records) {
+			auto l_logged_in = logged_in(key);
+			if (l_logged_in.value())
+				logout(key);
 		}
-		m_finish_sem_mutex.unlock();
-		// wait a bit
-		std::this_thread::sleep_for(std::chrono::milliseconds(20));
-	} while (1);
-	ctx.log("Worker threads completed.");
 
-	// log everybody off
-	for (auto& [key, value] : m_user_records) {
-		auto l_logged_in = logged_in(key);
-		if (l_logged_in.value())
-			logout(key);
+		bool l_save = save_authdb(m_auth_db_filename);
+		ctx.log(std::format("saved auth_db ({}): {})", m_auth_db_filename, l_save));
+		ctx.log(std::format("shutdown: users logged off and auth_db saved in {:.3f} ms", l_lap()));
 	}
+	ctx.log("command processor DOWN");
+	server_base::shutdown();
+	double l_base_ms = l_lap();
+	ctx.log(std::format("shutdown: server_base down in {:.3f} ms, {:.3f} ms in all", l_base_ms, std::chrono::duration<double, std::milli>(l_phase - l_start).count()));
+}
 
+void command_server::stop_workers()
+{
+	// the pool manager goes first so nothing new is started. Every worker is asked to stop, so a
+	// busy one won't take another connection once it has finished the batch it's on, then the
+	// queue wakes the parked ones, and each is joined as it leaves. Safe to call again, after an
+	// upgrade the pool has already been stopped by quiesce().
+	m_pool_manager.request_stop();
+	if (m_pool_manager.joinable())
+		m_pool_manager.join();
+	for (auto& l_worker : m_workers)
+		l_worker.m_thread.request_stop();
+	m_queue.shut_down();
+	m_workers.clear();
+}
+
+bool command_server::upgrade(char **a_argv)
+{
 	bool l_save = save_authdb(m_auth_db_filename);
 	ctx.log(std::format("saved auth_db ({}): {})", m_auth_db_filename, l_save));
-	ctx.log("command processor DOWN");
-	server_base::shutdown();
+	m_upgraded = server_base::upgrade(a_argv);
+	return m_upgraded;
+}
+
+void command_server::quiesce()
+{
+	stop_workers();
+	ctx.log(std::format("upgrade: worker threads stopped, {} commands not run", m_pending_commands.load()));
+}
+
+std::string command_server::unprocessed_input(int client_sockfd, const client_rec& a_rec)
+{
+	// caller holds the client's shard. The commands go back the way they came in, for the
+	// successor to frame again.
+	std::string l_input;
+	connection_mailbox *l_box = m_mailboxes.acquire(client_sockfd);
+	if (l_box == nullptr)
+		return l_input;
+	if (l_box->m_serial == a_rec.m_serial) {
+		for (auto& l_item : l_box->m_items) {
+			l_input += l_item.data;
+			l_input += '\n';
+		}
+		m_pending_commands.fetch_sub(l_box->m_items.size(), std::memory_order_relaxed);
+		l_box->m_items.clear();
+	}
+	m_mailboxes.release(client_sockfd);
+	return l_input;
+}
+
+bool command_server::reload()
+{
+	ctx.log("Reloading command_server configuration..");
+	int l_old_policy = m_auth_policy;
+	bool l_ok = server_base::reload();
+	ss::icr& l_icr = ss::icr::get();
+	
+	load_banners();
+	m_assets.refresh(); // banner and help files may have been edited along with the ini
+	if (l_icr.key_is_defined(m_category, "prompts")) {
+		m_prompts = l_icr.to_boolean(l_icr.keyvalue(m_category, "prompts"));
+	} else {
+		ctx.log_p(ss::log::NOTICE, "key <prompts> must be defined in ini file, keeping the old setting");
+		l_ok = false;
+	}
+	
+	// the pool gets its new settings, then workers are started or retired to fit them
+	{
+		std::lock_guard<std::mutex> l_guard(m_pool_mtx);
+		if (configure_pool())
+			resize_pool();
+		else
+			l_ok = false;
+		wake_pool_manager(); // it may have workers to retire under the new settings
+	}
+	update_pool_manager();
+	
+	// clients that came in anonymously while logins weren't required are asked to log on now,
+	// rather than being thrown off by their next command
+	if ((l_old_policy < 2) && (m_auth_policy >= 2)) {
+		std::vector<int> l_anonymous;
+		m_clients.for_each([&](int a_fd, client_rec& a_rec) {
+			if ((a_rec.m_auth_state == auth_state::AUTH_STATE_NOAUTH) && (a_rec.m_linger_until == 0)) {
+				a_rec.m_auth_state = auth_state::AUTH_STATE_AWAIT_USERNAME;
+				l_anonymous.push_back(a_fd);
+			}
+		});
+		for (int l_fd : l_anonymous) {
+			send_to_client(l_fd, "[command_server: logons are now required]");
+			send_to_client(l_fd, "username: ");
+		}
+		ctx.log_p(ss::log::NOTICE, std::format("auth_policy raised to {}, {} anonymous clients asked to log on", m_auth_policy.load(), l_anonymous.size()));
+	}
+	
+	ctx.log(std::format("command_server configuration reloaded{}", l_ok ? "" : ", invalid keys kept their old values"));
+	return l_ok;
+}
+
+void command_server::load_banners()
+{
+	ss::icr& l_icr = ss::icr::get();
+	auto l_banners = std::make_shared<banner_settings>();
+	if (l_icr.key_is_defined(m_category, "banner")) {
+		l_banners->m_banner = l_icr.to_boolean(l_icr.keyvalue(m_category, "banner"));
+		l_banners->m_banner_file = l_icr.keyvalue(m_category, "banner_file");
+	}
+	if (l_icr.key_is_defined(m_category, "logon_banner")) {
+		l_banners->m_logon_banner = l_icr.to_boolean(l_icr.keyvalue(m_category, "logon_banner"));
+		l_banners->m_logon_banner_file = l_icr.keyvalue(m_category, "logon_banner_file");
+	}
+	if (l_banners->m_banner) {
+		ctx.log(std::format("banner ACTIVE, file = {}", l_banners->m_banner_file));
+	}
+	if (l_banners->m_logon_banner) {
+		ctx.log(std::format("logon banner ACTIVE, file = {}", l_banners->m_logon_banner_file));
+	}
+	// load the banners up front, so the first clients don't wait on the disk
+	if (l_banners->m_banner)
+		m_assets.get(l_banners->m_banner_file);
+	if (l_banners->m_logon_banner)
+		m_assets.get(l_banners->m_logon_banner_file);
+	std::lock_guard<std::mutex> l_guard(m_banners_mtx);
+	m_banners = l_banners;
+}
+
+std::shared_ptr<const command_server::banner_settings> command_server::banners()
+{
+	std::lock_guard<std::mutex> l_guard(m_banners_mtx);
+	return m_banners;
 }
 
 void command_server::newly_accepted_client(int client_sockfd)
 {
 //	ctx.log(std::format("newly_accepted_client: {}", client_sockfd));
-	if (m_logon_banner) {
-		ss::data l_logon_banner;
-		l_logon_banner.load_file(m_logon_banner_file);
-		std::string l_string = l_logon_banner.read_std_str(l_logon_banner.size());
-		send_to_client(client_sockfd, l_string);
-	}
-	if (m_auth_policy > 1) {
-		// send "username:" string
-		send_to_client(client_sockfd, "username: ");
-		m_client_list_mtx.lock();
-		std::map<int, client_rec>::iterator l_client_list_it = m_client_list.find(client_sockfd);
-		l_client_list_it->second.m_auth_state = auth_state::AUTH_STATE_AWAIT_USERNAME;
-		m_client_list_mtx.unlock();
-	} else {
-		// no logon, just send banner if it is configured
-		if (m_banner) {
-			ss::data l_banner;
-			l_banner.load_file(m_banner_file);
-			std::string l_string = l_banner.read_std_str(l_banner.size());
-			send_to_client(client_sockfd, l_string);
+	// the client already belongs to its reactor, which may have seen it leave by now
+	try {
+		std::shared_ptr<const banner_settings> l_banners = banners();
+		if (l_banners->m_logon_banner)
+			send_asset(client_sockfd, l_banners->m_logon_banner_file);
+		if (m_auth_policy > 1) {
+			// send "username:" string, register_client() has us waiting for it already
+			send_to_client(client_sockfd, "username: ");
+		} else {
+			// no logon, just send banner if it is configured
+			if (l_banners->m_banner)
+				send_asset(client_sockfd, l_banners->m_banner_file);
+			prompt(client_sockfd);
 		}
-		prompt(client_sockfd);
+	} catch (std::exception& e) {
+		ctx.log_p(ss::log::INFO, std::format("client on fd {} left before it was greeted", client_sockfd));
 	}
 }
 
 void command_server::lock_client_output(int client_sockfd)
 {
 	ACQUIRE_CL(client_sockfd)
+	if (client_sockfd == s_batch.m_fd)
+		commit_batch(client_sockfd, *l_client);
 }
 
 void command_server::unlock_client_output(int client_sockfd)
 {
-	RELEASE_CL
+	// hand whatever was queued while we held the client to the kernel in one go, or leave it
+	// for the end of the batch
+	client_rec *l_client = m_clients.find(client_sockfd);
+	bool l_ok = true;
+	std::uint32_t l_serial = 0;
+	if (client_sockfd == s_batch.m_fd) {
+		s_batch.m_queued = true;
+	} else if (l_client != nullptr) {
+		l_ok = flush_client(client_sockfd, *l_client);
+		l_serial = l_client->m_serial;
+	}
+	m_clients.release(client_sockfd);
+	if (!l_ok)
+		remove_client(client_sockfd, l_serial);
+	note_output();
 }
 
 void command_server::send_to_client(int client_sockfd, const std::string& a_string)
 {
+	if (client_sockfd == s_batch.m_fd) {
+		s_batch.m_text += a_string;
+		s_batch.m_text += '\n';
+		note_output();
+		return;
+	}
 	ACQUIRE_CL(client_sockfd)
-	l_client_list_it->second.m_out_circbuff.write_std_str_delim(a_string);
-	set_epollout_for_fd(client_sockfd);
+	enqueue_output(client_sockfd, *l_client, a_string);
+	bool l_ok = flush_client(client_sockfd, *l_client);
+	std::uint32_t l_serial = l_client->m_serial;
 	RELEASE_CL
+	if (!l_ok)
+		remove_client(client_sockfd, l_serial);
+	note_output();
 }
 
 void command_server::send_to_client_atomic(int client_sockfd, const std::string& a_string)
 {
 	// same as above, but without locking the client's output mutex.
 	// this is so multiple sends can be done in one atomic operation.
-	std::map<int, client_rec>::iterator l_client_list_it = m_client_list.find(client_sockfd);
-	l_client_list_it->second.m_out_circbuff.write_std_str_delim(a_string);
-	set_epollout_for_fd(client_sockfd);
+	// output is queued only, unlock_client_output() flushes it.
+	client_rec *l_client = m_clients.find(client_sockfd);
+	enqueue_output(client_sockfd, *l_client, a_string);
+}
+
+void command_server::attach_to_client(int client_sockfd, std::shared_ptr<const std::string> a_payload)
+{
+	// queue a payload by reference, it is written out from where it lives
+	ACQUIRE_CL(client_sockfd)
+	bool l_ok = true;
+	std::uint32_t l_serial = l_client->m_serial;
+	if (client_sockfd == s_batch.m_fd) {
+		if (commit_batch(client_sockfd, *l_client)) {
+			enqueue_output(client_sockfd, *l_client, a_payload);
+			s_batch.m_queued = true;
+		}
+	} else {
+		enqueue_output(client_sockfd, *l_client, a_payload);
+		l_ok = flush_client(client_sockfd, *l_client);
+	}
+	RELEASE_CL
+	if (!l_ok)
+		remove_client(client_sockfd, l_serial);
+	note_output();
+}
+
+void command_server::attach_to_client_atomic(int client_sockfd, std::shared_ptr<const std::string> a_payload)
+{
+	client_rec *l_client = m_clients.find(client_sockfd);
+	enqueue_output(client_sockfd, *l_client, a_payload);
+}
+
+void command_server::send_asset(int client_sockfd, const std::string& a_path)
+{
+	// the cached payload goes out by reference, so this costs the same whoever asks
+	std::shared_ptr<const std::string> l_payload = m_assets.get(a_path);
+	if (l_payload)
+		attach_to_client(client_sockfd, l_payload);
+	if (m_assets.check_due())
+		m_queue.add_work_item(REVALIDATE_ASSETS);
 }
 
 void command_server::data_from_client(int client_sockfd)
 {
 	// we are called when a client sockfd has actionable data waiting. Our job is to grab
 	// the data piecemeal (as strings in this case) and enqueue if for service.
-	// client_list is locked while we are in here, our caller will unlock it.
-	std::map<int, client_rec>::iterator l_client_list_it = m_client_list.find(client_sockfd);
-	while (l_client_list_it->second.m_in_circbuff.size() > 0) {
-		std::optional<std::string> l_data = l_client_list_it->second.m_in_circbuff.read_std_str_delim();
+	// the client's shard of the client table is locked while we are in here, our caller will unlock it.
+	client_rec *l_client = m_clients.find(client_sockfd);
+	connection_mailbox *l_box = m_mailboxes.acquire(client_sockfd);
+	if (l_box == nullptr) {
+		m_mailboxes.insert(client_sockfd, connection_mailbox { l_client->m_serial, {}, false });
+		l_box = m_mailboxes.acquire(client_sockfd);
+	}
+	if (l_box->m_serial != l_client->m_serial) {
+		// left over from the fd's previous client
+		m_pending_commands.fetch_sub(l_box->m_items.size(), std::memory_order_relaxed);
+		l_box->m_items.clear();
+		l_box->m_serial = l_client->m_serial;
+	}
+	// only commands that go through the registry as they are can be run inline, not logon input
+	bool l_registry = (l_client->m_auth_state == auth_state::AUTH_STATE_NOAUTH) || (l_client->m_auth_state == auth_state::AUTH_STATE_LOGGED_ON);
+	std::uint64_t l_copied = 0;
+	while (l_client->m_in_circbuff.size() > 0) {
+		std::optional<std::string> l_data = l_client->m_in_circbuff.read_std_str_delim();
 		if (l_data.has_value()) {
+			l_copied += l_data.value().size();
 			if (l_data.value().size() > 0) {
 				command_work_item l_item;
 				l_item.client_sockfd = client_sockfd;
+				l_item.serial = l_client->m_serial;
 				l_item.data = l_data.value();
+				l_item.inline_safe = l_registry && is_inline_safe(l_item.data);
+				l_item.t_read = l_client->m_input_ns;
+				l_item.t_framed = ss::net::histogram::now_ns();
+				l_item.t_dequeued = 0;
+				l_item.t_first_output = 0;
+				l_item.t_done = 0;
 //				ctx.log(std::format("data_from_client: enqueueing {} from fd {}", l_data.value(), client_sockfd));
-				m_queue.add_work_item(l_item);
+				l_box->m_items.push_back(std::move(l_item));
+				m_pending_commands.fetch_add(1, std::memory_order_relaxed);
 			}
 		} else {
 			// stop processing this file descriptor
 			break;
 		}
 	}
+	bool l_schedule = !l_box->m_items.empty() && !l_box->m_scheduled;
+	if (l_schedule)
+		l_box->m_scheduled = true;
+	m_mailboxes.release(client_sockfd);
+	if (l_schedule)
+		s_ready.push_back(client_sockfd);
+	m_io_stats.m_copied_bytes.fetch_add(l_copied, std::memory_order_relaxed);
+}
+
+void command_server::input_served()
+{
+	// no shard is held here. The pool gets its share first, so it isn't kept waiting on us.
+	std::vector<int> l_inline;
+	std::erase_if(s_ready, [this, &l_inline](int a_fd) {
+		if (!runs_inline(a_fd))
+			return false;
+		l_inline.push_back(a_fd);
+		return true;
+	});
+	bool l_queued = !s_ready.empty();
+	m_queue.add_work_items(s_ready);
+	if (l_queued)
+		queued_work();
+	for (int l_fd : l_inline) {
+		m_inline_batches.fetch_add(1, std::memory_order_relaxed);
+		run_connection(l_fd, inline_latency());
+	}
 }
 
-void command_server::worker_thread(const std::string& a_logname)
+bool command_server::is_inline_safe(const std::string& a_line)
+{
+	// the command's name as process_command() will see it, looked up without splitting the line
+	std::size_t l_start = a_line.find_first_not_of(" \t");
+	if (l_start == std::string::npos)
+		return false;
+	std::size_t l_end = a_line.find_first_of(" \t\r\"", l_start);
+	std::string l_name = a_line.substr(l_start, (l_end == std::string::npos) ? std::string::npos : l_end - l_start);
+	for (auto& c : l_name)
+		c = std::toupper(c);
+	std::shared_lock<std::shared_mutex> l_guard(m_commands_mtx);
+	auto l_it = m_commands.find(l_name);
+	return (l_it != m_commands.end()) && (l_it->second.m_flags & COMMAND_INLINE_SAFE);
+}
+
+bool command_server::runs_inline(int client_sockfd)
+{
+	// the connection is scheduled and nobody has it yet, so what's in its mailbox is ours to judge
+	connection_mailbox *l_box = m_mailboxes.acquire(client_sockfd);
+	if (l_box == nullptr)
+		return false;
+	bool l_inline = !l_box->m_items.empty() && (l_box->m_items.size() <= MAILBOX_BATCH) &&
+		std::all_of(l_box->m_items.begin(), l_box->m_items.end(), [](const command_work_item& a_item) { return a_item.inline_safe; });
+	m_mailboxes.release(client_sockfd);
+	return l_inline;
+}
+
+command_server::latency_recorder& command_server::inline_latency()
+{
+	// one per reactor thread, kept with the workers' recorders so /LATENCY and the stats see it
+	static thread_local std::pair<command_server *, latency_recorder *> s_recorder { nullptr, nullptr };
+	if (s_recorder.first != this) {
+		std::lock_guard<std::mutex> l_guard(m_latency_mtx);
+		m_latency.push_back(std::make_unique<latency_recorder>());
+		s_recorder = { this, m_latency.back().get() };
+	}
+	return *s_recorder.second;
+}
+
+void command_server::client_removed(int client_sockfd, const client_rec& a_rec)
+{
+	// commands the client left behind die with it. The mailbox itself stays, a worker may still
+	// own it, and the fd's next client takes it over as usual.
+	connection_mailbox *l_box = m_mailboxes.acquire(client_sockfd);
+	if (l_box == nullptr)
+		return;
+	if (l_box->m_serial == a_rec.m_serial) {
+		m_pending_commands.fetch_sub(l_box->m_items.size(), std::memory_order_relaxed);
+		l_box->m_items.clear();
+	}
+	m_mailboxes.release(client_sockfd);
+}
+
+std::size_t command_server::queue_capacity()
+{
+	// m_queue holds each connection at most once, so room for as many fd's as we may have
+	// means a push never waits. Past 64k the odd wait for room is cheaper than the memory.
+	struct rlimit l_limit;
+	std::size_t l_fds = 65536;
+	if ((getrlimit(RLIMIT_NOFILE, &l_limit) == 0) && (l_limit.rlim_cur != RLIM_INFINITY))
+		l_fds = l_limit.rlim_cur;
+	return std::clamp<std::size_t>(l_fds, 1024, 65536);
+}
+
+bool command_server::configure_pool()
+{
+	// caller holds m_pool_mtx, or there are no workers yet
+	ss::icr& l_icr = ss::icr::get();
+	if (!l_icr.key_is_defined(m_category, "worker_threads")) {
+		ctx.log_p(ss::log::ERR, "key <worker_threads> must be defined in ini file!");
+		return false;
+	}
+	unsigned int l_min = l_icr.to_integer(l_icr.keyvalue(m_category, "worker_threads"));
+	unsigned int l_max = l_min;
+	if (l_icr.key_is_defined(m_category, "worker_threads_max"))
+		l_max = l_icr.to_integer(l_icr.keyvalue(m_category, "worker_threads_max"));
+	// sanity check number of worker threads
+	unsigned int l_limit = WORKER_THREADS_LIMIT;
+	if ((l_min == 0) || (l_max < l_min) || (l_max > l_limit)) {
+		ctx.log_p(ss::log::ERR, std::format("key <worker_threads> may not be zero, and <worker_threads_max> must be at least <worker_threads> and at most {}.", l_limit));
+		return false;
+	}
+	m_workers_min = l_min;
+	m_workers_max = l_max;
+	m_grow_wait_ms = DEFAULT_GROW_WAIT_MS;
+	if (l_icr.key_is_defined(m_category, "worker_grow_wait"))
+		m_grow_wait_ms = std::max(1, l_icr.to_integer(l_icr.keyvalue(m_category, "worker_grow_wait")));
+	m_idle_timeout = DEFAULT_IDLE_TIMEOUT;
+	if (l_icr.key_is_defined(m_category, "worker_idle_timeout"))
+		m_idle_timeout = std::max(1, l_icr.to_integer(l_icr.keyvalue(m_category, "worker_idle_timeout")));
+	if (l_max > l_min)
+		ctx.log(std::format("elastic worker pool: {} to {} threads, grow wait {} ms, idle timeout {} s", l_min, l_max, m_grow_wait_ms, m_idle_timeout));
+	else
+		ctx.log(std::format("worker pool: {} threads", l_min));
+	return true;
+}
+
+void command_server::resize_pool(std::latch *a_ready)
+{
+	join_exited_workers();
+	unsigned int l_alive = m_workers_alive.load(std::memory_order_relaxed);
+	for (; l_alive < m_workers_min; ++l_alive)
+		start_worker(a_ready);
+	if (l_alive > m_workers_max)
+		retire_workers(l_alive - m_workers_max);
+}
+
+void command_server::update_pool_manager()
+{
+	// main thread only (construction and reload)
+	if ((m_workers_max > m_workers_min) && !m_pool_manager.joinable()) {
+		m_pool_manager = std::jthread([this](std::stop_token a_stop) {
+			pool_manager(a_stop);
+		});
+	} else if ((m_workers_max == m_workers_min) && m_pool_manager.joinable()) {
+		m_pool_manager.request_stop();
+		m_pool_manager.join();
+	}
+}
+
+void command_server::retire_workers(unsigned int a_count)
+{
+	// the alive count drops now, so the pool isn't sized on workers that are on their way out.
+	// Whichever workers take the markers off the queue are the ones that go.
+	m_workers_alive.fetch_sub(a_count, std::memory_order_relaxed);
+	for (unsigned int i = 0; i < a_count; ++i)
+		m_queue.add_work_item(RETIRE_WORKER);
+	ctx.log_p(ss::log::INFO, std::format("worker pool shrinking by {} to {} threads", a_count, m_workers_alive.load(std::memory_order_relaxed)));
+}
+
+void command_server::start_worker(std::latch *a_ready)
+{
+	m_workers.emplace_back();
+	worker& l_worker = m_workers.back();
+	std::string l_name = std::format("{}_work{}", m_category, ++m_worker_serial);
+	l_worker.m_thread = std::jthread([this, l_name, &l_worker, a_ready](std::stop_token a_stop) {
+		worker_thread(a_stop, l_name, l_worker, a_ready);
+	});
+	m_workers_alive.fetch_add(1, std::memory_order_relaxed);
+	m_workers_started.fetch_add(1, std::memory_order_relaxed);
+}
+
+void command_server::join_exited_workers()
+{
+	for (auto l_it = m_workers.begin(); l_it != m_workers.end(); ) {
+		if (l_it->m_exited.load(std::memory_order_acquire)) {
+			l_it->m_thread.join();
+			l_it = m_workers.erase(l_it);
+		} else {
+			++l_it;
+		}
+	}
+}
+
+void command_server::queued_work()
+{
+	// cheap unless the pool is saturated and the manager is asleep, and then only the first push
+	// takes the lock
+	if (m_workers_busy.load(std::memory_order_relaxed) < m_workers_alive.load(std::memory_order_relaxed))
+		return;
+	if (!m_pool_asleep.exchange(false))
+		return;
+	std::lock_guard<std::mutex> l_guard(m_pool_mtx);
+	m_pool_cv.notify_one();
+}
+
+void command_server::wake_pool_manager()
+{
+	m_pool_asleep = false;
+	m_pool_cv.notify_one();
+}
+
+void command_server::pool_manager(std::stop_token a_stop)
+{
+	ctx.register_thread(std::format("{}_pool", m_category));
+	// looks the pool over a few times per grow wait while there's a backlog. A backlog that has
+	// been there since the last look, or items that waited too long to be picked up, mean every
+	// worker is busy and more would help; the fewest idle workers seen over an idle timeout is how
+	// many the pool could have done without. With neither a backlog nor surplus workers it sleeps
+	// until queued_work() finds the pool saturated, so an idle server doesn't wake at all.
+	auto l_backlog_since = std::chrono::steady_clock::time_point::min();
+	auto l_window_start = std::chrono::steady_clock::now();
+	unsigned int l_idle_floor = UINT_MAX;
+	std::uint64_t l_pops = m_queue.pops();
+	std::uint64_t l_wait_ns = m_queue.wait_ns();
+	std::unique_lock<std::mutex> l_lock(m_pool_mtx);
+	while (1) {
+		// the settings are under the lock we hold, and may have changed on a reload since last time
+		bool l_backlogged = (m_queue.size() > 0);
+		bool l_surplus = (m_workers_alive.load(std::memory_order_relaxed) > m_workers_min.load(std::memory_order_relaxed));
+		if (l_backlogged) {
+			auto l_interval = std::chrono::milliseconds(std::clamp<unsigned int>(m_grow_wait_ms / 2, 5, 500));
+			m_pool_cv.wait_for(l_lock, a_stop, l_interval, []() { return false; });
+		} else {
+			// nothing to measure: asleep until queued_work() finds the pool saturated, waking once
+			// a second to sample the idle floor only while there are surplus workers
+			m_pool_asleep = true;
+			auto l_woken = [this]() { return !m_pool_asleep.load(); };
+			if (l_surplus)
+				m_pool_cv.wait_for(l_lock, a_stop, std::chrono::seconds(1), l_woken);
+			else
+				m_pool_cv.wait(l_lock, a_stop, l_woken);
+			m_pool_asleep = false;
+			if (!l_surplus) {
+				// measure afresh from here, the time asleep says nothing about the load
+				l_pops = m_queue.pops();
+				l_wait_ns = m_queue.wait_ns();
+				l_window_start = std::chrono::steady_clock::now();
+				l_idle_floor = UINT_MAX;
+			}
+		}
+		if (a_stop.stop_requested())
+			break;
+		join_exited_workers();
+		auto l_now = std::chrono::steady_clock::now();
+		unsigned int l_alive = m_workers_alive.load(std::memory_order_relaxed);
+		unsigned int l_busy = m_workers_busy.load(std::memory_order_relaxed);
+		unsigned int l_idle = (l_alive > l_busy) ? l_alive - l_busy : 0;
+		std::size_t l_waiting = m_queue.size();
+		
+		// grow: by as many as are waiting, at most doubling at a time
+		std::uint64_t l_new_pops = m_queue.pops();
+		std::uint64_t l_new_wait_ns = m_queue.wait_ns();
+		bool l_slow = (l_new_pops > l_pops) && ((l_new_wait_ns - l_wait_ns) / (l_new_pops - l_pops) >= std::uint64_t(m_grow_wait_ms) * 1000000);
+		l_pops = l_new_pops;
+		l_wait_ns = l_new_wait_ns;
+		if (l_waiting == 0)
+			l_backlog_since = std::chrono::steady_clock::time_point::min();
+		else if (l_backlog_since == std::chrono::steady_clock::time_point::min())
+			l_backlog_since = l_now;
+		bool l_backlog = (l_backlog_since != std::chrono::steady_clock::time_point::min()) && (l_now - l_backlog_since >= std::chrono::milliseconds(m_grow_wait_ms));
+		if ((l_slow || l_backlog) && (l_idle == 0) && (l_alive < m_workers_max)) {
+			std::size_t l_grow = std::min<std::size_t>({ std::max<std::size_t>(l_waiting, 1), l_alive, m_workers_max - l_alive });
+			for (std::size_t i = 0; i < l_grow; ++i)
+				start_worker();
+			ctx.log_p(ss::log::INFO, std::format("worker pool grown by {} to {} threads, {} connections waiting", l_grow, l_alive + l_grow, l_waiting));
+			l_backlog_since = std::chrono::steady_clock::time_point::min();
+			l_window_start = l_now;
+			l_idle_floor = UINT_MAX;
+			continue;
+		}
+		
+		// shrink
+		l_idle_floor = std::min(l_idle_floor, l_idle);
+		if (l_now - l_window_start >= std::chrono::seconds(m_idle_timeout)) {
+			unsigned int l_retire = std::min(l_idle_floor, (l_alive > m_workers_min) ? l_alive - m_workers_min : 0);
+			if (l_retire > 0)
+				retire_workers(l_retire);
+			l_window_start = l_now;
+			l_idle_floor = UINT_MAX;
+		}
+	}
+}
+
+void command_server::worker_thread(std::stop_token a_stop, const std::string& a_logname, worker& a_worker, std::latch *a_ready)
 {
 	ctx.register_thread(a_logname);
 	ctx.log_p(ss::log::INFO, std::format("worker thread started up."));
+	latency_recorder *l_latency;
+	{
+		std::lock_guard<std::mutex> l_guard(m_latency_mtx);
+		if (m_spare_latency.empty()) {
+			m_latency.push_back(std::make_unique<latency_recorder>());
+			l_latency = m_latency.back().get();
+		} else {
+			l_latency = m_spare_latency.back();
+			m_spare_latency.pop_back();
+		}
+	}
+	if (a_ready != nullptr)
+		a_ready->count_down();
 	
-	while (!m_queue.is_shut_down()) {
-		std::optional<command_work_item> l_item = m_queue.wait_for_item(20);
-		if (l_item.has_value()) {
-			try {
-				bool l_terminal = process_command(l_item.value());
-				if (!l_terminal)
-					prompt(l_item.value().client_sockfd);
-			} catch (std::exception& e) {
-				ctx.log_p(ss::log::NOTICE, std::format("unable to process command for user on fd {}. Reason: {}", l_item.value().client_sockfd, e.what()));
-			}
+	bool l_retired = false;
+	while (!a_stop.stop_requested()) {
+		// sleeps until a connection has commands to run, or the queue is shut down
+		std::optional<int> l_fd = m_queue.wait_for_item();
+		if (!l_fd.has_value())
+			break;
+		if (l_fd.value() == RETIRE_WORKER) {
+			// the pool manager took us off the alive count when it queued this
+			m_workers_retired.fetch_add(1, std::memory_order_relaxed);
+			l_retired = true;
+			break;
 		}
+		if (l_fd.value() == REVALIDATE_ASSETS) {
+			m_assets.revalidate();
+			continue;
+		}
+		m_workers_busy.fetch_add(1, std::memory_order_relaxed);
+		run_connection(l_fd.value(), *l_latency);
+		m_workers_busy.fetch_sub(1, std::memory_order_relaxed);
+	}
+	if (!l_retired)
+		m_workers_alive.fetch_sub(1, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> l_guard(m_latency_mtx);
+		m_spare_latency.push_back(l_latency);
 	}
-	m_finish_sem_mutex.lock();
-	m_finish_sem--;
-	m_finish_sem_mutex.unlock();
 	ctx.log_p(ss::log::INFO, std::format("worker thread exiting..."));
+	a_worker.m_exited.store(true, std::memory_order_release);
+}
+
+void command_server::run_connection(int client_sockfd, latency_recorder& a_recorder)
+{
+	// we own the connection's mailbox from the moment we took its fd off the queue, so nobody
+	// else can run its commands in the meantime. Take everything waiting (up to a batch) at once.
+	std::vector<command_work_item> l_batch;
+	connection_mailbox *l_box = m_mailboxes.acquire(client_sockfd);
+	if (l_box == nullptr)
+		return;
+	std::size_t l_count = (l_box->m_items.size() < MAILBOX_BATCH) ? l_box->m_items.size() : MAILBOX_BATCH;
+	l_batch.reserve(l_count);
+	for (std::size_t i = 0; i < l_count; ++i) {
+		l_batch.push_back(std::move(l_box->m_items.front()));
+		l_box->m_items.pop_front();
+	}
+	m_mailboxes.release(client_sockfd);
+	m_pending_commands.fetch_sub(l_count, std::memory_order_relaxed);
+	
+	begin_batch(client_sockfd);
+	for (auto& l_work : l_batch) {
+		l_work.t_dequeued = ss::net::histogram::now_ns();
+		s_first_output = &l_work.t_first_output;
+		try {
+			bool l_terminal = process_command(l_work);
+			if (!l_terminal)
+				prompt(l_work.client_sockfd);
+		} catch (std::exception& e) {
+			ctx.log_p(ss::log::NOTICE, std::format("unable to process command for user on fd {}. Reason: {}", l_work.client_sockfd, e.what()));
+		}
+		s_first_output = nullptr;
+		l_work.t_done = ss::net::histogram::now_ns();
+		record_latency(a_recorder, l_work);
+	}
+	end_batch();
+	
+	// more may have come in while we were busy. If so, the connection goes to the back of the
+	// queue rather than keeping us to itself.
+	bool l_more = false;
+	l_box = m_mailboxes.acquire(client_sockfd);
+	if (l_box == nullptr)
+		return;
+	l_more = !l_box->m_items.empty();
+	if (!l_more)
+		l_box->m_scheduled = false;
+	m_mailboxes.release(client_sockfd);
+	if (l_more) {
+		m_queue.add_work_item(client_sockfd);
+		queued_work();
+	}
+}
+
+void command_server::begin_batch(int client_sockfd)
+{
+	s_batch.m_fd = client_sockfd;
+	s_batch.m_serial = 0; // no client has serial 0, so nothing is committed if it's gone already
+	s_batch.m_text.clear();
+	s_batch.m_queued = false;
+	client_rec *l_client = m_clients.acquire(client_sockfd);
+	if (l_client != nullptr) {
+		s_batch.m_serial = l_client->m_serial;
+		m_clients.release(client_sockfd);
+	}
+}
+
+bool command_server::commit_batch(int client_sockfd, client_rec& a_rec)
+{
+	// caller holds the client. Collected lines go onto its queue ahead of whatever comes next,
+	// unless the client we collected them for has left and someone else has its fd now.
+	if (a_rec.m_serial != s_batch.m_serial) {
+		s_batch.m_text.clear();
+		s_batch.m_queued = false;
+		return false;
+	}
+	if (s_batch.m_text.empty())
+		return true;
+	enqueue_output(client_sockfd, a_rec, s_batch.m_text, false);
+	s_batch.m_text.clear();
+	s_batch.m_queued = true;
+	return true;
+}
+
+void command_server::end_batch()
+{
+	int l_fd = s_batch.m_fd;
+	s_batch.m_fd = -1;
+	if ((l_fd == -1) || (s_batch.m_text.empty() && !s_batch.m_queued))
+		return;
+	client_rec *l_client = m_clients.acquire(l_fd);
+	if (l_client != nullptr) {
+		bool l_ok = true;
+		std::uint32_t l_serial = l_client->m_serial;
+		commit_batch(l_fd, *l_client);
+		if (s_batch.m_queued)
+			l_ok = flush_client(l_fd, *l_client);
+		m_clients.release(l_fd);
+		if (!l_ok)
+			remove_client(l_fd, l_serial);
+	}
+	s_batch.m_text.clear();
+	s_batch.m_queued = false;
+}
+
+void command_server::disconnect(int client_sockfd)
+{
+	if (client_sockfd == s_batch.m_fd)
+		end_batch();
+	close_client(client_sockfd);
 }
 
 std::vector<std::string> command_server::split_command(const std::string& a_command)
@@ -278,14 +910,20 @@ void command_server::prompt(int client_sockfd)
 {
 	if (m_prompts) {
 		ACQUIRE_CL(client_sockfd)
-		std::string l_user = l_client_list_it->second.m_auth_username;
-		auth_state l_as = l_client_list_it->second.m_auth_state;
+		std::string l_user = l_client->m_auth_username;
+		auth_state l_as = l_client->m_auth_state;
 		RELEASE_CL
 		// don't show prompt during the login roll...
 		if ((l_as != auth_state::AUTH_STATE_NOAUTH) && (l_as != auth_state::AUTH_STATE_LOGGED_ON))
 			return;
 		if (!(l_as == auth_state::AUTH_STATE_LOGGED_ON))
 			l_user = "(non)";
+		if (client_sockfd == s_batch.m_fd) {
+			// part of the batch like the rest of the command's output, so prompts don't break it up
+			send_to_client(client_sockfd, std::format("\n[{} {}]", m_category, ss::doubletime::now_as_iso8601_ms()));
+			send_to_client(client_sockfd, std::format("{}: please enter a command.", l_user));
+			return;
+		}
 		lock_client_output(client_sockfd);
 		send_to_client_atomic(client_sockfd, std::format("\n[{} {}]", m_category, ss::doubletime::now_as_iso8601_ms()));
 		send_to_client_atomic(client_sockfd, std::format("{}: please enter a command.", l_user));
@@ -293,20 +931,155 @@ void command_server::prompt(int client_sockfd)
 	}
 }
 
-bool command_server::process_command(command_work_item a_item)
+void command_server::note_output()
+{
+	if ((s_first_output != nullptr) && (*s_first_output == 0))
+		*s_first_output = ss::net::histogram::now_ns();
+}
+
+void command_server::record_latency(latency_recorder& a_recorder, const command_work_item& a_item)
+{
+	// worker thread, a_recorder is its own
+	std::string l_command = a_item.command.empty() ? "(unknown)" : a_item.command;
+	auto l_it = a_recorder.m_commands.find(l_command);
+	if (l_it == a_recorder.m_commands.end()) {
+		if (a_recorder.m_commands.size() >= LATENCY_MAX_COMMANDS) {
+			l_command = "(other)";
+			l_it = a_recorder.m_commands.find(l_command);
+		}
+		if (l_it == a_recorder.m_commands.end()) {
+			std::lock_guard<std::mutex> l_guard(a_recorder.m_mtx);
+			l_it = a_recorder.m_commands.emplace(l_command, std::make_unique<command_latency>()).first;
+		}
+	}
+	l_it->second->m_count.fetch_add(1, std::memory_order_relaxed);
+	std::array<ss::net::histogram, LATENCY_STAGES>& l_stages = l_it->second->m_stages;
+	// input that was already buffered when it was framed has no read time of its own
+	if ((a_item.t_read != 0) && (a_item.t_read <= a_item.t_framed)) {
+		l_stages[LATENCY_FRAME].record(a_item.t_framed - a_item.t_read);
+		l_stages[LATENCY_TOTAL].record(a_item.t_done - a_item.t_read);
+	}
+	l_stages[LATENCY_QUEUE].record(a_item.t_dequeued - a_item.t_framed);
+	l_stages[LATENCY_SERVICE].record(a_item.t_done - a_item.t_dequeued);
+	if (a_item.t_first_output != 0)
+		l_stages[LATENCY_RESPOND].record(a_item.t_first_output - a_item.t_dequeued);
+}
+
+void command_server::report_latency(int client_sockfd)
+{
+	// merge every worker's histograms per command and stage, reading them as they're written
+	typedef std::array<std::uint64_t, ss::net::histogram::BUCKETS> counts;
+	std::map<std::string, std::vector<std::pair<counts, std::uint64_t>>> l_merged;
+	{
+		std::lock_guard<std::mutex> l_guard(m_latency_mtx);
+		for (auto& l_recorder : m_latency) {
+			std::lock_guard<std::mutex> l_recorder_guard(l_recorder->m_mtx);
+			for (auto& [l_command, l_latency] : l_recorder->m_commands) {
+				auto& l_into = l_merged[l_command];
+				if (l_into.empty())
+					l_into.resize(LATENCY_STAGES, { counts{}, 0 });
+				for (unsigned int i = 0; i < LATENCY_STAGES; ++i)
+					l_latency->m_stages[i].merge_into(l_into[i].first, l_into[i].second);
+			}
+		}
+	}
+	const char *l_stage_names[LATENCY_STAGES] = { "frame", "queue", "service", "respond", "total" };
+	auto l_us = [](std::uint64_t a_ns) { return std::format("{:.1f}", a_ns / 1000.0); };
+	lock_client_output(client_sockfd);
+	send_to_client_atomic(client_sockfd, "command         stage   count       p50 us      p99 us      p999 us");
+	for (auto& [l_command, l_stages] : l_merged) {
+		for (unsigned int i = 0; i < LATENCY_STAGES; ++i) {
+			const counts& l_counts = l_stages[i].first;
+			std::uint64_t l_total = l_stages[i].second;
+			if (l_total == 0)
+				continue;
+			send_to_client_atomic(client_sockfd, std::format("{}{}{}{}{}{}", pad(l_command, 16), pad(l_stage_names[i], 8), pad(std::format("{}", l_total), 12), pad(l_us(ss::net::histogram::percentile(l_counts, l_total, 0.5)), 12), pad(l_us(ss::net::histogram::percentile(l_counts, l_total, 0.99)), 12), l_us(ss::net::histogram::percentile(l_counts, l_total, 0.999))));
+		}
+	}
+	send_to_client_atomic(client_sockfd, std::format("{} commands.", l_merged.size()));
+	unlock_client_output(client_sockfd);
+}
+
+void command_server::publish_command_stats()
+{
+	// runs inside publish_stats(). Only the latency locks are taken, which workers hold just to
+	// add a command name they haven't run before.
+	std::map<std::string, std::uint64_t> l_executed;
+	{
+		std::lock_guard<std::mutex> l_guard(m_latency_mtx);
+		for (auto& l_recorder : m_latency) {
+			std::lock_guard<std::mutex> l_recorder_guard(l_recorder->m_mtx);
+			for (auto& [l_command, l_latency] : l_recorder->m_commands)
+				l_executed[l_command] += l_latency->m_count.load(std::memory_order_relaxed);
+		}
+	}
+	ss::esr_object_ptr l_commands = child_object("commands");
+	set_number(l_commands, "queue_depth", m_pending_commands.load(std::memory_order_relaxed));
+	set_number(l_commands, "ready_connections", m_queue.size());
+	std::uint64_t l_pops = m_queue.pops();
+	set_number(l_commands, "queue_wait_avg_us", (l_pops == 0) ? 0.0 : double(m_queue.wait_ns()) / l_pops / 1000.0);
+	set_number(l_commands, "worker_parks", m_queue.parks());
+	set_number(l_commands, "auth_failures", m_auth_failures.load(std::memory_order_relaxed));
+	set_number(l_commands, "inline_batches", m_inline_batches.load(std::memory_order_relaxed));
+	ss::esr_object_ptr l_pool = child_object(l_commands, "pool");
+	set_number(l_pool, "threads", m_workers_alive.load(std::memory_order_relaxed));
+	set_number(l_pool, "busy", m_workers_busy.load(std::memory_order_relaxed));
+	set_number(l_pool, "min", m_workers_min.load(std::memory_order_relaxed));
+	set_number(l_pool, "max", m_workers_max.load(std::memory_order_relaxed));
+	set_number(l_pool, "started", m_workers_started.load(std::memory_order_relaxed));
+	set_number(l_pool, "retired", m_workers_retired.load(std::memory_order_relaxed));
+	ss::esr_object_ptr l_counts = child_object(l_commands, "executed");
+	for (auto& [l_command, l_count] : l_executed)
+		set_number(l_counts, l_command, l_count);
+}
+
+void command_server::report_stats(int client_sockfd)
+{
+	std::string l_stats = stats_text();
+	lock_client_output(client_sockfd);
+	std::size_t l_pos = 0;
+	while (l_pos < l_stats.size()) {
+		std::size_t l_end = l_stats.find('\n', l_pos);
+		if (l_end == std::string::npos)
+			l_end = l_stats.size();
+		send_to_client_atomic(client_sockfd, l_stats.substr(l_pos, l_end - l_pos));
+		l_pos = l_end + 1;
+	}
+	unlock_client_output(client_sockfd);
+}
+
+bool command_server::process_command(command_work_item& a_item)
 {
 	ctx.log(std::format("processing command from fd {}, cmd = {}", a_item.client_sockfd, a_item.data));
 
 	// eheck if we're even an authorized user
 	ACQUIRE_CL(a_item.client_sockfd)
-	auth_state l_as = l_client_list_it->second.m_auth_state;
+	auth_state l_as = l_client->m_auth_state;
+	bool l_closing = (l_client->m_linger_until != 0);
+	bool l_stale = (l_client->m_serial != a_item.serial);
 	RELEASE_CL
+	int l_policy = m_auth_policy; // one policy for the whole command, even if a reload changes it
+	if (l_stale)
+		return true; // from a client that has gone since, the fd belongs to somebody else now
+	if (l_closing)
+		return true; // pipelined behind whatever got the client disconnected, drop it
+	if ((l_as != auth_state::AUTH_STATE_NOAUTH) && (l_as != auth_state::AUTH_STATE_LOGGED_ON))
+		a_item.command = "(login)";
 	if (l_as == auth_state::AUTH_STATE_NOAUTH) {
 		// a non! make sure this is ok
-		if (m_auth_policy >= 2) {
-			// can't be a non on here if we're requiring logins, so kick this asshole off
-			ctx.log_p(ss::log::NOTICE, std::format("Discovered non-user online on fd {} when auth_policy requires logins. Disconnecting user", a_item.client_sockfd));
-			remove_client(a_item.client_sockfd);
+		if (l_policy >= 2) {
+			// logins became required since this client came in, and reload() hasn't got round to
+			// asking it to log on yet. Whichever of us moves it on sends the username prompt.
+			ACQUIRE_CL(a_item.client_sockfd)
+			bool l_ask = (l_client->m_serial == a_item.serial) && (l_client->m_auth_state == auth_state::AUTH_STATE_NOAUTH);
+			if (l_ask)
+				l_client->m_auth_state = auth_state::AUTH_STATE_AWAIT_USERNAME;
+			RELEASE_CL
+			if (l_ask) {
+				ctx.log_p(ss::log::NOTICE, std::format("Discovered non-user online on fd {} when auth_policy requires logins. Asking user to log on", a_item.client_sockfd));
+				send_to_client(a_item.client_sockfd, "[command_server: logons are now required]");
+				send_to_client(a_item.client_sockfd, "username: ");
+			}
 			return true;
 		}
 	} else if (l_as == auth_state::AUTH_STATE_AWAIT_USERNAME) {
@@ -316,24 +1089,23 @@ bool command_server::process_command(command_work_item a_item)
 			if (l_logged_in.value()) { // check these in succession to prevent a bad option exception
 				send_to_client(a_item.client_sockfd, "[user already logged in]");
 				send_to_client(a_item.client_sockfd, "disconnecting...");
-				std::this_thread::sleep_for(std::chrono::milliseconds(500));
 				ctx.log_p(ss::log::NOTICE, std::format("user {} attempted multiple logons, disconnecting", a_item.data));
-				remove_client(a_item.client_sockfd);
+				disconnect(a_item.client_sockfd);
 				return true;
 			}
 		}
 		// this user entered username, so process it
-		if (m_auth_policy == 2) {
+		if (l_policy == 2) {
 			// ask user for password
 			ctx.log_p(ss::log::NOTICE, std::format("user {} attempting logon", a_item.data));
 			// send "password:" string
 			send_to_client(a_item.client_sockfd, "password: ");
 			ACQUIRE_CL(a_item.client_sockfd)
-			l_client_list_it->second.m_auth_username = a_item.data;
-			l_client_list_it->second.m_auth_state = auth_state::AUTH_STATE_AWAIT_PASSWORD;
+			l_client->m_auth_username = a_item.data;
+			l_client->m_auth_state = auth_state::AUTH_STATE_AWAIT_PASSWORD;
 			RELEASE_CL
 			return false;
-		} else if (m_auth_policy == 3) {
+		} else if (l_policy == 3) {
 			ctx.log_p(ss::log::NOTICE, std::format("user {} attempting logon", a_item.data));
 			// send user a session hash and challenge them
 			std::optional<challenge_pack> l_pack = challenge(a_item.data);
@@ -341,16 +1113,16 @@ bool command_server::process_command(command_work_item a_item)
 				// no such user
 				send_to_client(a_item.client_sockfd, "[no such user]");
 				send_to_client(a_item.client_sockfd, "disconnecting...");
-				std::this_thread::sleep_for(std::chrono::milliseconds(500));
 				ctx.log_p(ss::log::NOTICE, std::format("no such user {} found in auth database, disconnecting user", a_item.data));
-				remove_client(a_item.client_sockfd);
+				m_auth_failures.fetch_add(1, std::memory_order_relaxed);
+				disconnect(a_item.client_sockfd);
 				return true;
 			}
 			ACQUIRE_CL(a_item.client_sockfd)
-			l_client_list_it->second.m_auth_username = a_item.data;
+			l_client->m_auth_username = a_item.data;
 			// record the challenge pack so we can reference it later
-			l_client_list_it->second.m_auth_challenge_pack = l_pack.value();
-			l_client_list_it->second.m_auth_state = auth_state::AUTH_STATE_AWAIT_CHAL;
+			l_client->m_auth_challenge_pack = l_pack.value();
+			l_client->m_auth_state = auth_state::AUTH_STATE_AWAIT_CHAL;
 			RELEASE_CL
 			// send "session:" string
 			send_to_client(a_item.client_sockfd, std::format("session: {}", l_pack.value().session));
@@ -358,7 +1130,7 @@ bool command_server::process_command(command_work_item a_item)
 		}
 	} else if (l_as == auth_state::AUTH_STATE_AWAIT_PASSWORD) {
 		ACQUIRE_CL(a_item.client_sockfd)
-		std::string l_user = l_client_list_it->second.m_auth_username;
+		std::string l_user = l_client->m_auth_username;
 		RELEASE_CL
 		// if auth_policy is set to 2, we will wind up here after user enters plaintext password
 		std::optional<challenge_pack> l_pack = challenge(l_user);
@@ -366,9 +1138,9 @@ bool command_server::process_command(command_work_item a_item)
 			// no such user
 			send_to_client(a_item.client_sockfd, "[no such user]");
 			send_to_client(a_item.client_sockfd, "disconnecting...");
-			std::this_thread::sleep_for(std::chrono::milliseconds(500));
 			ctx.log_p(ss::log::NOTICE, std::format("no such user {} found in auth database, disconnecting user", l_user));
-			remove_client(a_item.client_sockfd);
+			m_auth_failures.fetch_add(1, std::memory_order_relaxed);
+			disconnect(a_item.client_sockfd);
 			return true;
 		}
 		auth l_dummy_client(auth::role::CLIENT);
@@ -381,15 +1153,12 @@ bool command_server::process_command(command_work_item a_item)
 		bool l_authenticated = authenticate(l_user, l_pack.value(), l_response.value());
 		if (l_authenticated) {
 			ctx.log_p(ss::log::INFO, std::format("authenticated user {}", l_user));
-			if (m_banner) {
-				ss::data l_banner;
-				l_banner.load_file(m_banner_file);
-				std::string l_string = l_banner.read_std_str(l_banner.size());
-				send_to_client(a_item.client_sockfd, l_string);
-			}
+			std::shared_ptr<const banner_settings> l_banners = banners();
+			if (l_banners->m_banner)
+				send_asset(a_item.client_sockfd, l_banners->m_banner_file);
 			{
 				ACQUIRE_CL(a_item.client_sockfd)
-				l_client_list_it->second.m_auth_state = auth_state::AUTH_STATE_LOGGED_ON;
+				l_client->m_auth_state = auth_state::AUTH_STATE_LOGGED_ON;
 				RELEASE_CL
 			}
 			return false;
@@ -397,30 +1166,27 @@ bool command_server::process_command(command_work_item a_item)
 			// not authenticated
 			send_to_client(a_item.client_sockfd, "[unable to authenticate]");
 			send_to_client(a_item.client_sockfd, "disconnecting...");
-			std::this_thread::sleep_for(std::chrono::milliseconds(500));
 			ctx.log_p(ss::log::INFO, std::format("unable to authenticate user {}", l_user));
-			remove_client(a_item.client_sockfd);
+			m_auth_failures.fetch_add(1, std::memory_order_relaxed);
+			disconnect(a_item.client_sockfd);
 			return true;
 		}
 	} else if (l_as == auth_state::AUTH_STATE_AWAIT_CHAL) {
 		// auth_policy 3: user has accepted our challenge and sent his reply hash
-//		std::cout << "expected_response " << l_client_list_it->second.m_auth_challenge_pack.expected_response << " actual response: " << a_item.data << std::endl;
+//		std::cout << "expected_response " << l_client->m_auth_challenge_pack.expected_response << " actual response: " << a_item.data << std::endl;
 		ACQUIRE_CL(a_item.client_sockfd)
-		std::string l_user = l_client_list_it->second.m_auth_username;
-		challenge_pack l_pack = l_client_list_it->second.m_auth_challenge_pack;
+		std::string l_user = l_client->m_auth_username;
+		challenge_pack l_pack = l_client->m_auth_challenge_pack;
 		RELEASE_CL
 		bool l_authenticated = authenticate(l_user, l_pack, a_item.data);
 		if (l_authenticated) {
 			ctx.log_p(ss::log::INFO, std::format("authenticated user {}", l_user));
-			if (m_banner) {
-				ss::data l_banner;
-				l_banner.load_file(m_banner_file);
-				std::string l_string = l_banner.read_std_str(l_banner.size());
-				send_to_client(a_item.client_sockfd, l_string);
-			}
+			std::shared_ptr<const banner_settings> l_banners = banners();
+			if (l_banners->m_banner)
+				send_asset(a_item.client_sockfd, l_banners->m_banner_file);
 			{
 				ACQUIRE_CL(a_item.client_sockfd)
-				l_client_list_it->second.m_auth_state = auth_state::AUTH_STATE_LOGGED_ON;
+				l_client->m_auth_state = auth_state::AUTH_STATE_LOGGED_ON;
 				RELEASE_CL
 			}
 			return false;
@@ -428,9 +1194,9 @@ bool command_server::process_command(command_work_item a_item)
 			// not authenticated
 			send_to_client(a_item.client_sockfd, "[unable to authenticate]");
 			send_to_client(a_item.client_sockfd, "disconnecting...");
-			std::this_thread::sleep_for(std::chrono::milliseconds(500));
 			ctx.log_p(ss::log::INFO, std::format("unable to authenticate user {}", l_user));
-			remove_client(a_item.client_sockfd);
+			m_auth_failures.fetch_add(1, std::memory_order_relaxed);
+			disconnect(a_item.client_sockfd);
 			return true;
 		}
 	}
@@ -441,159 +1207,201 @@ bool command_server::process_command(command_work_item a_item)
 		l_cmdv[0].erase(l_cmdv[0].begin()); // hack off forward slash
 	for (auto& c : l_cmdv[0]) // make uppercase
 		c = std::toupper(c);
-	if (!l_internal) {
-		external_command(a_item.client_sockfd, l_cmdv);
+	a_item.command = l_internal ? "/" + l_cmdv[0] : l_cmdv[0];
+	
+	std::optional<command_entry> l_entry;
+	{
+		std::shared_lock<std::shared_mutex> l_guard(m_commands_mtx);
+		auto l_it = m_commands.find(a_item.command);
+		if (l_it != m_commands.end())
+			l_entry = l_it->second;
+	}
+	if (!l_entry.has_value()) {
+		if (!l_internal) {
+			external_command(a_item.client_sockfd, l_cmdv);
+			return false;
+		}
+		std::string l_response = std::format("[command_server: internal command {} not recognized]", l_cmdv[0]);
+		send_to_client(a_item.client_sockfd, l_response);
 		return false;
 	}
 	
-	std::string l_user;
-	{
+	command_call l_call { a_item.client_sockfd, "(non)", (l_as == auth_state::AUTH_STATE_LOGGED_ON), l_cmdv };
+	if (l_call.logged_on) {
 		ACQUIRE_CL(a_item.client_sockfd)
-		if (l_as == auth_state::AUTH_STATE_LOGGED_ON)
-			l_user = l_client_list_it->second.m_auth_username;
-		else
-			l_user = "(non)";
+		l_call.user = l_client->m_auth_username;
 		RELEASE_CL
 	}
-	
-	if (l_cmdv[0] == "PART") {
-		// preform logoff
-		send_to_client(a_item.client_sockfd, "[logging you off]");
-		send_to_client(a_item.client_sockfd, "disconnecting...");
-		std::this_thread::sleep_for(std::chrono::milliseconds(500));
-		if (m_auth_policy >= 1 && l_as == auth_state::AUTH_STATE_LOGGED_ON) {
-			ctx.log_p(ss::log::INFO, std::format("logging off user {}", l_user));
-			logout(l_user);
-		}
-		remove_client(a_item.client_sockfd);
-		return true;
+	if ((l_entry.value().m_flags & COMMAND_NEEDS_AUTH) && !l_call.logged_on) {
+		send_to_client(a_item.client_sockfd, std::format("[command_server: you must be logged in to execute the command {}.", l_cmdv[0]));
+		return false;
 	}
-	if (l_cmdv[0] == "WHOAMI") {
-		if (l_as == auth_state::AUTH_STATE_LOGGED_ON) {
-			ACQUIRE_CL(a_item.client_sockfd)
-			ss::doubletime l_conn_time = l_client_list_it->second.m_connect_time;
-			RELEASE_CL
-			lock_client_output(a_item.client_sockfd);
-			send_to_client_atomic(a_item.client_sockfd, std::format("{}{}", pad("you are:", 20), l_user));
-			auto l_priv = priv_level(l_user);
-			send_to_client_atomic(a_item.client_sockfd, std::format("{}{}", pad("privilege level:", 20), l_priv.value()));
-			auto l_last_login = last_login(l_user);
-			send_to_client_atomic(a_item.client_sockfd, std::format("{}{}", pad("last login:", 20), l_last_login.value().iso8601_ms()));
-			auto l_last = last(l_user);
-			send_to_client_atomic(a_item.client_sockfd, std::format("{}{}", pad("last seen:", 20), l_last.value().iso8601_ms()));
-			auto l_creation = creation(l_user);
-			send_to_client_atomic(a_item.client_sockfd, std::format("{}{}", pad("account creation:", 20), l_creation.value().iso8601_ms()));
-			send_to_client_atomic(a_item.client_sockfd, std::format("{}{}", pad("connected on:", 20), l_conn_time.iso8601_ms()));
-			send_to_client_atomic(a_item.client_sockfd, std::format("{}{} seconds.", pad("connected for:", 20), ss::doubletime::now_as_double() - double(l_conn_time)));
-			unlock_client_output(a_item.client_sockfd);
-		} else {
-			send_to_client(a_item.client_sockfd, "not logged in");
+	if ((l_policy >= 2) && (l_entry.value().m_priv_level != PRIV_ANYONE)) {
+		auto l_priv_level = priv_level(l_call.user);
+		if (!l_priv_level.has_value() || (l_priv_level.value() > l_entry.value().m_priv_level)) {
+			send_to_client(a_item.client_sockfd, std::format("[command_server: you do not have privileges to execute the command {}.", l_cmdv[0]));
+			return false;
 		}
-		return false;
 	}
-	if (l_cmdv[0] == "HELP") {
+	return l_entry.value().m_handler(l_call);
+}
+
+void command_server::register_command(const std::string& a_name, int a_priv_level, unsigned int a_flags, command_handler a_handler)
+{
+	std::lock_guard<std::shared_mutex> l_guard(m_commands_mtx);
+	m_commands[a_name] = command_entry { a_handler, a_priv_level, a_flags };
+}
+
+void command_server::register_internal_commands()
+{
+	register_command("/PART", PRIV_ANYONE, 0, [this](command_call& a_call) { return command_part(a_call); });
+	register_command("/WHOAMI", PRIV_ANYONE, COMMAND_NEEDS_AUTH, [this](command_call& a_call) { return command_whoami(a_call); });
+	register_command("/HELP", PRIV_ANYONE, 0, [this](command_call& a_call) {
 		// display help file
-		ss::data l_help;
-		l_help.load_file("help.txt");
-		std::string l_string = l_help.read_std_str(l_help.size());
-		send_to_client(a_item.client_sockfd, l_string);
+		send_asset(a_call.client_sockfd, "help.txt");
 		return false;
-	}
-	if (l_cmdv[0] == "USERS") {
-		// display user list
-		lock_client_output(a_item.client_sockfd);
-		send_to_client_atomic(a_item.client_sockfd, "username        priv online last seen");
-		m_user_records_mtx.lock();
-		for (auto& [key, value] : m_user_records) {
-			send_to_client_atomic(a_item.client_sockfd, std::format("{}{}{}{}", pad(key, 16), pad(std::format("{}", value.priv_level), 5), pad(std::format("{}", value.logged_in), 7), value.last.iso8601_ms()));
-		}
-		send_to_client_atomic(a_item.client_sockfd, std::format("{} user records.", m_user_records.size()));
-		m_user_records_mtx.unlock();
-		unlock_client_output(a_item.client_sockfd);
+	});
+	register_command("/USERS", PRIV_ANYONE, 0, [this](command_call& a_call) { return command_users(a_call); });
+	register_command("/WHO", PRIV_ANYONE, 0, [this](command_call& a_call) { return command_who(a_call); });
+	register_command("/BROADCAST", -1, 0, [this](command_call& a_call) { return command_broadcast(a_call); });
+	register_command("/LATENCY", -1, 0, [this](command_call& a_call) {
+		report_latency(a_call.client_sockfd);
 		return false;
-	}
-	if (l_cmdv[0] == "WHO") {
-		// show who is online, both users and nons
-		lock_client_output(a_item.client_sockfd);
-		send_to_client_atomic(a_item.client_sockfd, "fd  address                 username        connect time                       seconds online");
-		// client list is already locked by virtue of lock_client_output
-		for (auto& [key, value] : m_client_list) {
-			// is user online:
-			std::string l_online_username;
-			if (value.m_auth_state == auth_state::AUTH_STATE_NOAUTH) {
-				l_online_username = "(non)";
-			} else if (value.m_auth_state == auth_state::AUTH_STATE_LOGGED_ON) {
-				l_online_username = value.m_auth_username;
-			} else {
-				// in the login roll
-				l_online_username = "(logging on)";
-			}
-			std::string l_cli = std::format("{}", key);
-			std::string l_cliaddr = "unknown";
-			if (value.m_family == AF_UNIX) {
-				l_cliaddr = un_str(&value.m_sockaddr_un);
-			} else if (value.m_family == AF_INET) {
-				l_cliaddr = ip_str(&value.m_sockaddr_in);
-			}
-			send_to_client_atomic(a_item.client_sockfd, std::format("{}{}{}{}{}", pad(l_cli, 4), pad(l_cliaddr, 24), pad(l_online_username, 16), pad(value.m_connect_time.iso8601_ms(), 35), ss::doubletime::now_as_double() - double(value.m_connect_time)));
-		}
-		send_to_client_atomic(a_item.client_sockfd, std::format("{} user connections.", m_client_list.size()));
-		unlock_client_output(a_item.client_sockfd);
+	});
+	register_command("/STATS", -1, 0, [this](command_call& a_call) {
+		report_stats(a_call.client_sockfd);
 		return false;
+	});
+	register_command("/DOWN", -2, 0, [this](command_call& a_call) { return command_down(a_call); });
+	register_command("/HUP", -2, 0, [this](command_call& a_call) { return command_hup(a_call); });
+	register_command("/UPGRADE", -2, 0, [this](command_call& a_call) { return command_upgrade(a_call); });
+}
+
+bool command_server::command_part(command_call& a_call)
+{
+	// preform logoff
+	send_to_client(a_call.client_sockfd, "[logging you off]");
+	send_to_client(a_call.client_sockfd, "disconnecting...");
+	if (m_auth_policy >= 1 && a_call.logged_on) {
+		ctx.log_p(ss::log::INFO, std::format("logging off user {}", a_call.user));
+		logout(a_call.user);
 	}
-	if (l_cmdv[0] == "BROADCAST") {
-		// if auth_policy >= 2 check if user is -1 or less
-		auto l_priv_level = priv_level(l_user);
-		if ((m_auth_policy >= 2) && (l_priv_level.value() > -1)) {
-			send_to_client(a_item.client_sockfd, std::format("[command_server: you do not have privileges to execute the command {}.", l_cmdv[0]));
-			return false;
-		}
-		std::set<int> l_clients;
-		// grab list of connected clients
-		m_client_list_mtx.lock();
-		for (auto& [key, value] : m_client_list) {
-			// ignore people who are in the login roll
-			if ((value.m_auth_state == auth_state::AUTH_STATE_NOAUTH) || (value.m_auth_state == auth_state::AUTH_STATE_LOGGED_ON))
-				l_clients.insert(key);
-		}
-		m_client_list_mtx.unlock();
-		// now remove ourselves
-		l_clients.erase(a_item.client_sockfd);
-		// iterate the set and send out the broadcast
-		for (auto& i : l_clients) {
-			lock_client_output(i);
-			send_to_client_atomic(i, std::format("[broadcast message from user: {}]", l_user));
-			send_to_client_atomic(i, l_cmdv[1]);
-			unlock_client_output(i);
-		}
-		send_to_client(a_item.client_sockfd, std::format("[command_server: sent BROADCAST message to {} users.", l_clients.size()));
-		return false;
+	disconnect(a_call.client_sockfd);
+	return true;
+}
+
+bool command_server::command_whoami(command_call& a_call)
+{
+	// COMMAND_NEEDS_AUTH, anonymous clients are turned away before we get here
+	ACQUIRE_CL(a_call.client_sockfd)
+	ss::doubletime l_conn_time = l_client->m_connect_time;
+	RELEASE_CL
+	lock_client_output(a_call.client_sockfd);
+	send_to_client_atomic(a_call.client_sockfd, std::format("{}{}", pad("you are:", 20), a_call.user));
+	auto l_priv = priv_level(a_call.user);
+	send_to_client_atomic(a_call.client_sockfd, std::format("{}{}", pad("privilege level:", 20), l_priv.value()));
+	auto l_last_login = last_login(a_call.user);
+	send_to_client_atomic(a_call.client_sockfd, std::format("{}{}", pad("last login:", 20), l_last_login.value().iso8601_ms()));
+	auto l_last = last(a_call.user);
+	send_to_client_atomic(a_call.client_sockfd, std::format("{}{}", pad("last seen:", 20), l_last.value().iso8601_ms()));
+	auto l_creation = creation(a_call.user);
+	send_to_client_atomic(a_call.client_sockfd, std::format("{}{}", pad("account creation:", 20), l_creation.value().iso8601_ms()));
+	send_to_client_atomic(a_call.client_sockfd, std::format("{}{}", pad("connected on:", 20), l_conn_time.iso8601_ms()));
+	send_to_client_atomic(a_call.client_sockfd, std::format("{}{} seconds.", pad("connected for:", 20), ss::doubletime::now_as_double() - double(l_conn_time)));
+	unlock_client_output(a_call.client_sockfd);
+	return false;
+}
+
+bool command_server::command_users(command_call& a_call)
+{
+	// display user list
+	lock_client_output(a_call.client_sockfd);
+	send_to_client_atomic(a_call.client_sockfd, "username        priv online last seen");
+	m_user_records_mtx.lock();
+	for (auto& [key, value] : m_user_records) {
+		send_to_client_atomic(a_call.client_sockfd, std::format("{}{}{}{}", pad(key, 16), pad(std::format("{}", value.priv_level), 5), pad(std::format("{}", value.logged_in), 7), value.last.iso8601_ms()));
 	}
-	if (l_cmdv[0] == "DOWN") {
-		// if auth_policy >= 2 check if user is -2 or less
-		auto l_priv_level = priv_level(l_user);
-		if ((m_auth_policy >= 2) && (l_priv_level.value() > -2)) {
-			send_to_client(a_item.client_sockfd, std::format("[command_server: you do not have privileges to execute the command {}.", l_cmdv[0]));
-			return false;
+	send_to_client_atomic(a_call.client_sockfd, std::format("{} user records.", m_user_records.size()));
+	m_user_records_mtx.unlock();
+	unlock_client_output(a_call.client_sockfd);
+	return false;
+}
+
+bool command_server::command_who(command_call& a_call)
+{
+	// show who is online, both users and nons. The table is walked one shard at a time
+	// (collecting lines in fd order) before we take hold of our own client for output.
+	std::map<int, std::string> l_lines;
+	m_clients.for_each([&](int key, client_rec& value) {
+		// is user online:
+		std::string l_online_username;
+		if (value.m_auth_state == auth_state::AUTH_STATE_NOAUTH) {
+			l_online_username = "(non)";
+		} else if (value.m_auth_state == auth_state::AUTH_STATE_LOGGED_ON) {
+			l_online_username = value.m_auth_username;
+		} else {
+			// in the login roll
+			l_online_username = "(logging on)";
 		}
-		send_to_client(a_item.client_sockfd, "[command_server: requesting server DOWN]");
-		m_request_down = true;
-		return true;
-	}
-	if (l_cmdv[0] == "HUP") {
-		// if auth_policy >= 2 check if user is -2 or less
-		auto l_priv_level = priv_level(l_user);
-		if ((m_auth_policy >= 2) && (l_priv_level.value() > -2)) {
-			send_to_client(a_item.client_sockfd, std::format("[command_server: you do not have privileges to execute the command {}.", l_cmdv[0]));
-			return false;
+		std::string l_cli = std::format("{}", key);
+		std::string l_cliaddr = "unknown";
+		if (value.m_family == AF_UNIX) {
+			l_cliaddr = un_str(&value.m_sockaddr_un);
+		} else if (value.m_family == AF_INET) {
+			l_cliaddr = ip_str(&value.m_sockaddr_in);
 		}
-		send_to_client(a_item.client_sockfd, "[command_server: requesting server HANGUP]");
-		m_request_hup = true;
-		return true;
-	}
-	
-	std::string l_response = std::format("[command_server: internal command {} not recognized]", l_cmdv[0]);
-	send_to_client(a_item.client_sockfd, l_response);
+		l_lines[key] = std::format("{}{}{}{}{}", pad(l_cli, 4), pad(l_cliaddr, 24), pad(l_online_username, 16), pad(value.m_connect_time.iso8601_ms(), 35), ss::doubletime::now_as_double() - double(value.m_connect_time));
+	});
+	lock_client_output(a_call.client_sockfd);
+	send_to_client_atomic(a_call.client_sockfd, "fd  address                 username        connect time                       seconds online");
+	for (auto& [key, value] : l_lines)
+		send_to_client_atomic(a_call.client_sockfd, value);
+	send_to_client_atomic(a_call.client_sockfd, std::format("{} user connections.", l_lines.size()));
+	unlock_client_output(a_call.client_sockfd);
+	return false;
+}
+
+bool command_server::command_broadcast(command_call& a_call)
+{
+	// the message is put together once and every recipient gets a reference to it. The
+	// reactors deliver it, and we wait (only so long, as shutdown() does) for their count so the
+	// report goes out with the rest of this command's output, ahead of the prompt.
+	std::shared_ptr<const std::string> l_message = std::make_shared<const std::string>(std::format("[broadcast message from user: {}]\n{}\n", a_call.user, a_call.cmdv[1]));
+	int l_sender = a_call.client_sockfd;
+	auto l_reached = std::make_shared<std::promise<std::size_t>>();
+	std::future<std::size_t> l_reached_future = l_reached->get_future();
+	fan_out(l_message, [l_sender](int a_fd, const client_rec& a_rec) {
+		// ignore ourselves, and people who are in the login roll
+		return (a_fd != l_sender) && ((a_rec.m_auth_state == auth_state::AUTH_STATE_NOAUTH) || (a_rec.m_auth_state == auth_state::AUTH_STATE_LOGGED_ON));
+	}, [l_reached](std::size_t a_reached) {
+		l_reached->set_value(a_reached);
+	});
+	int l_report_ms = BROADCAST_REPORT_MS;
+	if (l_reached_future.wait_for(std::chrono::milliseconds(l_report_ms)) == std::future_status::timeout)
+		send_to_client(l_sender, "[command_server: BROADCAST message is still being delivered.");
+	else
+		send_to_client(l_sender, std::format("[command_server: sent BROADCAST message to {} users.", l_reached_future.get()));
+	return false;
+}
+
+bool command_server::command_down(command_call& a_call)
+{
+	send_to_client(a_call.client_sockfd, "[command_server: requesting server DOWN]");
+	raise_request(m_request_down);
+	return true;
+}
+
+bool command_server::command_hup(command_call& a_call)
+{
+	send_to_client(a_call.client_sockfd, "[command_server: requesting configuration reload]");
+	raise_request(m_request_hup);
+	return false;
+}
+
+bool command_server::command_upgrade(command_call& a_call)
+{
+	send_to_client(a_call.client_sockfd, "[command_server: requesting server upgrade]");
+	raise_request(m_request_upgrade);
 	return false;
 }
 
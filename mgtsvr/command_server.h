@@ -6,28 +6,44 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <climits>
 #include <optional>
+#include <memory>
 #include <thread>
+#include <future>
 #include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <latch>
+#include <shared_mutex>
+#include <atomic>
 #include <exception>
 #include <stdexcept>
+#include <algorithm>
+
+#include <sys/resource.h>
 
 #include "auth.h"
 #include "icr.h"
 #include "server_base.h"
 #include "log.h"
-#include "ccl.h"
+#include "wait_queue.h"
+#include "fd_table.h"
+#include "asset_cache.h"
 
 #define ACQUIRE_CL(a_fd) \
-	m_client_list_mtx.lock(); \
-	std::map<int, client_rec>::iterator l_client_list_it = m_client_list.find(a_fd); \
-	if (l_client_list_it == this->m_client_list.end()) { \
-		m_client_list_mtx.unlock(); \
+	int l_client_fd = a_fd; \
+	client_rec *l_client = m_clients.acquire(l_client_fd); \
+	if (l_client == nullptr) { \
 		throw std::runtime_error("client logoff occurred while processing command."); \
 	}
 	
 #define RELEASE_CL \
-	m_client_list_mtx.unlock();
+	m_clients.release(l_client_fd);
 
 namespace ss {
 namespace net {
@@ -37,38 +53,209 @@ public:
 
 	struct command_work_item {
 		int client_sockfd;
+		std::uint32_t serial; // client the command is from, it's dropped if the fd has changed hands since
 		std::string data;
+		std::string command; // filled in by process_command(), latencies are kept per command
+		bool inline_safe; // a COMMAND_INLINE_SAFE command, the reactor that read it may run it
+		// pipeline timestamps (histogram::now_ns()): input read, framed into this item, picked
+		// up by a worker, first output handed to the client, done
+		std::uint64_t t_read;
+		std::uint64_t t_framed;
+		std::uint64_t t_dequeued;
+		std::uint64_t t_first_output;
+		std::uint64_t t_done;
+	};
+	
+	enum latency_stage {
+		LATENCY_FRAME, // read -> framed
+		LATENCY_QUEUE, // framed -> dequeued
+		LATENCY_SERVICE, // dequeued -> done
+		LATENCY_RESPOND, // dequeued -> first output
+		LATENCY_TOTAL, // read -> done
+		LATENCY_STAGES
 	};
 	
+	// what a command handler gets to work with. cmdv[0] is the verb, upper-cased and without
+	// its slash; user is "(non)" unless the client is logged on.
+	struct command_call {
+		int client_sockfd;
+		std::string user;
+		bool logged_on;
+		std::vector<std::string>& cmdv;
+	};
+	// returns true if the client is gone afterwards (PART, DOWN...)
+	typedef std::function<bool(command_call&)> command_handler;
+	
+	enum command_flags : unsigned int {
+		COMMAND_NEEDS_AUTH = 1, // refused unless the client is logged on
+		COMMAND_INLINE_SAFE = 2 // doesn't block or hold client locks for long, run on the reactor when nothing else is waiting
+	};
+	const static int PRIV_ANYONE = INT_MAX; // no privilege check
+	
 	command_server(const std::string& a_category, const std::string& a_auth_db);
 	virtual ~command_server();
 	virtual void shutdown();
+	// banners, prompts, auth_policy and the worker pool's size are applied live
+	virtual bool reload();
+	// saves the auth db first, so the successor starts out knowing what we know
+	virtual bool upgrade(char **a_argv);
 	virtual void newly_accepted_client(int client_sockfd);
 	virtual void data_from_client(int client_sockfd);
+	virtual void input_served();
 	virtual void external_command(int client_sockfd, std::vector<std::string>& a_cmdv) = 0;
+	// add a command to the registry. Internal commands are named with their slash ("/WHO"),
+	// a subclass's own without ("FORTUNE"). a_priv_level is the highest privilege level allowed
+	// to run it when auth_policy >= 2. Re-registering a name replaces the old entry.
+	void register_command(const std::string& a_name, int a_priv_level, unsigned int a_flags, command_handler a_handler);
 
 protected:
 	ss::log::ctx& ctx = ss::log::ctx::get();
-	bool m_banner; // should we print the banner when a user logs on?
-	std::string m_banner_file;
-	bool m_logon_banner;
-	std::string m_logon_banner_file;
+	// replaced as a whole on reload(), so readers take a reference and see one version of it
+	struct banner_settings {
+		bool m_banner = false; // should we print the banner when a user logs on?
+		std::string m_banner_file;
+		bool m_logon_banner = false;
+		std::string m_logon_banner_file;
+	};
+	std::mutex m_banners_mtx;
+	std::shared_ptr<const banner_settings> m_banners;
+	std::shared_ptr<const banner_settings> banners();
+	void load_banners();
+	ss::net::asset_cache m_assets; // banners and help, loaded once and shared by every client
 	std::string m_auth_db_filename;
-	ss::ccl::work_queue<command_work_item> m_queue;
+	bool m_upgraded = false; // the auth db is the successor's now, shutdown() leaves it alone
+	// commands from one client run one at a time in the order they came in, while different
+	// clients' commands spread over all the workers. Each connection's commands wait in a mailbox
+	// of its own, and m_queue holds the fd's of connections with commands waiting, each at most
+	// once: the worker that takes one owns that connection until its mailbox is empty.
+	struct connection_mailbox {
+		std::uint32_t m_serial; // client the commands are from, a new client on the fd starts afresh
+		std::deque<command_work_item> m_items;
+		bool m_scheduled; // on m_queue, or a worker is running its commands
+	};
+	// a worker takes up to this many of a connection's commands at a time and runs them as one
+	// batch, with their output collected and handed to the client in one go at the end
+	const static std::size_t MAILBOX_BATCH = 64;
+	const static int SHUTDOWN_NOTICE_MS = 2000; // shutdown() waits this long for the reactors to tell everybody
+	const static int BROADCAST_REPORT_MS = 2000; // a BROADCAST waits this long to report how many it reached
+	ss::net::fd_table<connection_mailbox> m_mailboxes;
+	ss::net::wait_queue<int> m_queue;
+	virtual void client_removed(int client_sockfd, const client_rec& a_rec); // its commands go with it
+	static std::size_t queue_capacity();
+	std::atomic<std::size_t> m_pending_commands{0}; // in all the mailboxes together
 	// command server functions
 	void lock_client_output(int client_sockfd);
 	void unlock_client_output(int client_sockfd);
 	void send_to_client(int client_sockfd, const std::string& a_string);
 	void send_to_client_atomic(int client_sockfd, const std::string& a_string);
+	void attach_to_client(int client_sockfd, std::shared_ptr<const std::string> a_payload);
+	void attach_to_client_atomic(int client_sockfd, std::shared_ptr<const std::string> a_payload);
+	void send_asset(int client_sockfd, const std::string& a_path);
 	void prompt(int client_sockfd);
-	bool m_prompts;
+	std::atomic<bool> m_prompts;
 	std::string pad(const std::string& a_string, std::size_t a_len);
-	unsigned int m_worker_threads;
-	std::mutex m_finish_sem_mutex; // roll your own semaphore, we want to block until it reaches zero
-	unsigned int m_finish_sem;
-	void worker_thread(const std::string& a_logname);
+	// worker pool: m_workers_min threads always, and up to m_workers_max while connections wait
+	// on m_queue for longer than m_grow_wait_ms. The pool manager thread grows it, and retires
+	// workers the pool could have done without for m_idle_timeout seconds by queueing a
+	// RETIRE_WORKER in place of an fd for each one. REVALIDATE_ASSETS has the worker that takes
+	// it look at the asset files on disk, so nobody serving a client has to.
+	const static unsigned int WORKER_THREADS_LIMIT = 1024;
+	const static int RETIRE_WORKER = -1;
+	const static int REVALIDATE_ASSETS = -2;
+	const static unsigned int DEFAULT_GROW_WAIT_MS = 50;
+	const static unsigned int DEFAULT_IDLE_TIMEOUT = 30; // seconds
+	struct worker {
+		std::jthread m_thread;
+		std::atomic<bool> m_exited{false}; // done, ready to be joined
+	};
+	std::atomic<unsigned int> m_workers_min;
+	std::atomic<unsigned int> m_workers_max;
+	unsigned int m_grow_wait_ms; // under m_pool_mtx
+	unsigned int m_idle_timeout; // under m_pool_mtx
+	std::mutex m_pool_mtx; // m_workers and the pool's settings
+	// the pool manager sleeps on m_pool_cv without a timeout while there's nothing to measure or
+	// retire. m_pool_asleep says so, and the first push to find every worker busy clears it and
+	// wakes the manager (as do a reload and a stop request).
+	std::condition_variable_any m_pool_cv;
+	std::atomic<bool> m_pool_asleep{false};
+	void queued_work(); // after pushing onto m_queue
+	void wake_pool_manager(); // caller holds m_pool_mtx
+	std::list<worker> m_workers;
+	unsigned int m_worker_serial = 0; // for naming workers
+	std::jthread m_pool_manager; // not started for a fixed size pool
+	std::atomic<unsigned int> m_workers_alive{0};
+	std::atomic<unsigned int> m_workers_busy{0};
+	std::atomic<std::uint64_t> m_workers_started{0};
+	std::atomic<std::uint64_t> m_workers_retired{0};
+	bool configure_pool(); // reads the pool's keys, false if they don't make sense
+	void resize_pool(std::latch *a_ready = nullptr); // to within min..max, caller holds m_pool_mtx
+	void start_worker(std::latch *a_ready = nullptr); // caller holds m_pool_mtx
+	void retire_workers(unsigned int a_count); // caller holds m_pool_mtx
+	void join_exited_workers(); // caller holds m_pool_mtx
+	void update_pool_manager(); // starts or stops it, whichever the pool's settings call for
+	void pool_manager(std::stop_token a_stop);
+	void stop_workers(); // no command runs once this returns, those still waiting stay in their mailboxes
+	// handing clients over: commands stop, and those that haven't run go back as input
+	virtual void quiesce();
+	virtual std::string unprocessed_input(int client_sockfd, const client_rec& a_rec);
+	// a_ready is counted down once the worker is ready for commands
+	void worker_thread(std::stop_token a_stop, const std::string& a_logname, worker& a_worker, std::latch *a_ready);
 	std::vector<std::string> split_command(const std::string& a_command);
-	bool process_command(command_work_item a_item);
+	bool process_command(command_work_item& a_item);
+	
+	// command registry, looked up once per command by process_command(), which also does the
+	// privilege and login checks so the handlers don't have to. Unregistered external commands
+	// fall through to external_command().
+	struct command_entry {
+		command_handler m_handler;
+		int m_priv_level;
+		unsigned int m_flags;
+	};
+	std::shared_mutex m_commands_mtx;
+	std::unordered_map<std::string, command_entry> m_commands;
+	void register_internal_commands();
+	bool command_part(command_call& a_call);
+	bool command_whoami(command_call& a_call);
+	bool command_users(command_call& a_call);
+	bool command_who(command_call& a_call);
+	bool command_broadcast(command_call& a_call);
+	bool command_down(command_call& a_call);
+	bool command_hup(command_call& a_call);
+	bool command_upgrade(command_call& a_call);
+	
+	// per worker latency histograms and execution counts, one set per command name. Only the
+	// owning worker records; its mutex covers adding commands, and readers merging them.
+	struct command_latency {
+		std::atomic<std::uint64_t> m_count{0};
+		std::array<ss::net::histogram, LATENCY_STAGES> m_stages;
+	};
+	struct latency_recorder {
+		std::mutex m_mtx;
+		std::map<std::string, std::unique_ptr<command_latency>> m_commands;
+	};
+	const static std::size_t LATENCY_MAX_COMMANDS = 32; // past this, names are lumped together as (other)
+	std::mutex m_latency_mtx;
+	std::vector<std::unique_ptr<latency_recorder>> m_latency;
+	std::vector<latency_recorder *> m_spare_latency; // left by retired workers, for the next one started
+	void note_output();
+	void record_latency(latency_recorder& a_recorder, const command_work_item& a_item);
+	void run_connection(int client_sockfd, latency_recorder& a_recorder);
+	// connections whose mailbox holds only inline safe commands skip the queue and are run by
+	// the reactor that read them, with a latency recorder of its own
+	std::atomic<std::uint64_t> m_inline_batches{0};
+	bool is_inline_safe(const std::string& a_line);
+	bool runs_inline(int client_sockfd);
+	latency_recorder& inline_latency();
+	void begin_batch(int client_sockfd);
+	bool commit_batch(int client_sockfd, client_rec& a_rec); // false: the batch's client has left
+	void end_batch();
+	void disconnect(int client_sockfd); // close_client(), once the batch's output is out of our hands
+	void report_latency(int client_sockfd);
+	
+	// statistics of our own, published into the esr tree along with server_base's
+	std::atomic<std::uint64_t> m_auth_failures{0};
+	void publish_command_stats();
+	void report_stats(int client_sockfd);
 };
 
 } // namespace net
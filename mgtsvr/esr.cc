@@ -104,4 +104,128 @@ esr::~esr()
 	
 }
 
+esr_object_ptr esr::child_object(const std::string& a_name)
+{
+	return child_object(m_root, a_name);
+}
+
+esr_object_ptr esr::child_object(esr_object_ptr a_parent, const std::string& a_name)
+{
+	std::lock_guard<std::mutex> l_guard(m_root_mtx);
+	object_cont::iterator l_it = a_parent->container.find(a_name);
+	if (l_it != a_parent->container.end())
+		return as_object(l_it->second);
+	esr_object_ptr l_ret = std::make_shared<esr_object>(a_name);
+	a_parent->add(l_ret);
+	return l_ret;
+}
+
+void esr::set_number(esr_object_ptr a_object, const std::string& a_name, double a_value)
+{
+	std::lock_guard<std::mutex> l_guard(m_root_mtx);
+	object_cont::iterator l_it = a_object->container.find(a_name);
+	if (l_it == a_object->container.end()) {
+		a_object->add(new_value<esr_number, double>(a_name, a_value));
+		return;
+	}
+	esr_number_ptr l_number = as_number(l_it->second);
+	if (l_number)
+		l_number->value = a_value;
+}
+
+std::string esr::number_str(double a_value)
+{
+	// counters are whole numbers, don't give them a fraction
+	if ((a_value == (double)(std::int64_t)a_value) && (a_value < 1e15) && (a_value > -1e15))
+		return std::format("{}", (std::int64_t)a_value);
+	return std::format("{}", a_value);
+}
+
+void esr::text_of(esr_object_ptr a_object, const std::string& a_path, std::string& a_out)
+{
+	for (auto& [l_name, l_item] : a_object->container) {
+		std::string l_path = a_path.empty() ? l_name : a_path + "." + l_name;
+		switch (l_item->type) {
+			case esr_item_type::OBJECT:
+				text_of(as_object(l_item), l_path, a_out);
+				break;
+			case esr_item_type::STRING:
+				a_out += std::format("{} = {}\n", l_path, as_string(l_item)->value);
+				break;
+			case esr_item_type::NUMBER:
+				a_out += std::format("{} = {}\n", l_path, number_str(as_number(l_item)->value));
+				break;
+			case esr_item_type::BOOLEAN:
+				a_out += std::format("{} = {}\n", l_path, as_boolean(l_item)->value ? "true" : "false");
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+std::string esr::to_text()
+{
+	std::lock_guard<std::mutex> l_guard(m_root_mtx);
+	std::string l_ret;
+	text_of(m_root, "", l_ret);
+	return l_ret;
+}
+
+std::string esr::metric_name(const std::string& a_name)
+{
+	std::string l_ret = a_name;
+	for (auto& c : l_ret) {
+		if (!(std::isalnum((unsigned char)c) || (c == '_') || (c == ':')))
+			c = '_';
+	}
+	return l_ret;
+}
+
+std::string esr::label_value(const std::string& a_value)
+{
+	std::string l_ret;
+	for (auto c : a_value) {
+		if (c == '\\')
+			l_ret += "\\\\";
+		else if (c == '"')
+			l_ret += "\\\"";
+		else if (c == '\n')
+			l_ret += "\\n";
+		else
+			l_ret += c;
+	}
+	return l_ret;
+}
+
+std::string esr::to_exposition(const std::string& a_prefix)
+{
+	std::lock_guard<std::mutex> l_guard(m_root_mtx);
+	std::string l_prefix = metric_name(a_prefix);
+	std::string l_ret;
+	std::string l_info;
+	for (auto& [l_name, l_item] : m_root->container) {
+		if (l_item->type == esr_item_type::STRING) {
+			l_info += std::format("{}{}=\"{}\"", l_info.empty() ? "" : ",", metric_name(l_name), label_value(as_string(l_item)->value));
+		} else if (l_item->type == esr_item_type::NUMBER) {
+			l_ret += std::format("{}_{} {}\n", l_prefix, metric_name(l_name), number_str(as_number(l_item)->value));
+		} else if (l_item->type == esr_item_type::OBJECT) {
+			for (auto& [l_child_name, l_child] : as_object(l_item)->container) {
+				std::string l_metric = std::format("{}_{}_{}", l_prefix, metric_name(l_name), metric_name(l_child_name));
+				if (l_child->type == esr_item_type::NUMBER) {
+					l_ret += std::format("{} {}\n", l_metric, number_str(as_number(l_child)->value));
+				} else if (l_child->type == esr_item_type::OBJECT) {
+					for (auto& [l_label, l_value] : as_object(l_child)->container) {
+						if (l_value->type == esr_item_type::NUMBER)
+							l_ret += std::format("{}{{name=\"{}\"}} {}\n", l_metric, label_value(l_label), number_str(as_number(l_value)->value));
+					}
+				}
+			}
+		}
+	}
+	if (!l_info.empty())
+		l_ret = std::format("{}_info{{{}}} 1\n", l_prefix, l_info) + l_ret;
+	return l_ret;
+}
+
 } // namespace ss
@@ -6,6 +6,10 @@
 #include <vector>
 #include <memory>
 #include <utility>
+#include <mutex>
+#include <format>
+#include <cstdint>
+#include <cctype>
 
 namespace ss {
 
@@ -130,8 +134,28 @@ public:
 	template <typename T, typename V>
 	std::shared_ptr<T> new_value(const std::string& a_name, V a_value);
 	
+	// live values: find or create a child object of root (or of another object), and update a number inside it
+	esr_object_ptr child_object(const std::string& a_name);
+	esr_object_ptr child_object(esr_object_ptr a_parent, const std::string& a_name);
+	void set_number(esr_object_ptr a_object, const std::string& a_name, double a_value);
+	
+	// renderings of the whole tree, each taken under the tree lock:
+	// one "path.to.item = value" line per value
+	std::string to_text();
+	// text exposition format for scrapers: numbers become a_prefix_path_to_item samples, with
+	// values nested two objects deep labelled by name, and the strings of root go into one
+	// a_prefix_info sample as labels
+	std::string to_exposition(const std::string& a_prefix);
+	
+	
 protected:
+	void text_of(esr_object_ptr a_object, const std::string& a_path, std::string& a_out);
+	static std::string metric_name(const std::string& a_name);
+	static std::string label_value(const std::string& a_value);
+	static std::string number_str(double a_value);
+	
 	esr_object_ptr m_root;
+	std::mutex m_root_mtx; // guards the tree while live values are being published
 };
 
 template <typename T, typename V>
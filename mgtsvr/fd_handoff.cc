@@ -0,0 +1,199 @@
+#include "fd_handoff.h"
+
+namespace ss {
+namespace net {
+
+fd_handoff::fd_handoff(int a_fd)
+: m_fd(a_fd)
+{ }
+
+fd_handoff::~fd_handoff()
+{
+	if (m_fd != -1)
+		close(m_fd);
+}
+
+bool fd_handoff::send(message_type a_type, const std::string& a_payload, const std::vector<int>& a_fds)
+{
+	if (a_fds.size() > MAX_FDS) {
+		std::size_t l_max = MAX_FDS;
+		ctx.log_p(ss::log::ERR, std::format("fd_handoff: {} descriptors in one message, at most {} allowed", a_fds.size(), l_max));
+		return false;
+	}
+	header l_header { a_type, std::uint32_t(a_fds.size()), a_payload.size() };
+	struct iovec l_iov;
+	l_iov.iov_base = &l_header;
+	l_iov.iov_len = sizeof(l_header);
+	alignas(struct cmsghdr) char l_control[CMSG_SPACE(MAX_FDS * sizeof(int))];
+	struct msghdr l_msg;
+	memset(&l_msg, 0, sizeof(l_msg));
+	l_msg.msg_iov = &l_iov;
+	l_msg.msg_iovlen = 1;
+	if (!a_fds.empty()) {
+		l_msg.msg_control = l_control;
+		l_msg.msg_controllen = CMSG_SPACE(a_fds.size() * sizeof(int));
+		struct cmsghdr *l_cmsg = CMSG_FIRSTHDR(&l_msg);
+		l_cmsg->cmsg_level = SOL_SOCKET;
+		l_cmsg->cmsg_type = SCM_RIGHTS;
+		l_cmsg->cmsg_len = CMSG_LEN(a_fds.size() * sizeof(int));
+		memcpy(CMSG_DATA(l_cmsg), a_fds.data(), a_fds.size() * sizeof(int));
+	}
+	ssize_t l_ret;
+	do {
+		l_ret = sendmsg(m_fd, &l_msg, MSG_NOSIGNAL);
+	} while ((l_ret == -1) && (errno == EINTR));
+	if (l_ret != sizeof(l_header)) {
+		ctx.log_p(ss::log::ERR, std::format("fd_handoff: sendmsg failed, errno = {} ({})", errno, strerror(errno)));
+		return false;
+	}
+	std::size_t l_sent = 0;
+	while (l_sent < a_payload.size()) {
+		l_ret = ::send(m_fd, a_payload.data() + l_sent, a_payload.size() - l_sent, MSG_NOSIGNAL);
+		if (l_ret > 0) {
+			l_sent += l_ret;
+		} else if ((l_ret == -1) && (errno == EINTR)) {
+			continue;
+		} else {
+			ctx.log_p(ss::log::ERR, std::format("fd_handoff: send failed, errno = {} ({})", errno, strerror(errno)));
+			return false;
+		}
+	}
+	return true;
+}
+
+bool fd_handoff::receive(message_type& a_type, std::string& a_payload, std::vector<int>& a_fds, int a_timeout_ms)
+{
+	auto l_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(a_timeout_ms);
+	a_payload.clear();
+	a_fds.clear();
+	if (!wait_readable(l_deadline))
+		return false;
+	// the descriptors come with the first byte of the header, so the header is read in one
+	// recvmsg() and only what might be left of it afterwards is read plainly
+	header l_header;
+	struct iovec l_iov;
+	l_iov.iov_base = &l_header;
+	l_iov.iov_len = sizeof(l_header);
+	alignas(struct cmsghdr) char l_control[CMSG_SPACE(MAX_FDS * sizeof(int))];
+	struct msghdr l_msg;
+	memset(&l_msg, 0, sizeof(l_msg));
+	l_msg.msg_iov = &l_iov;
+	l_msg.msg_iovlen = 1;
+	l_msg.msg_control = l_control;
+	l_msg.msg_controllen = sizeof(l_control);
+	ssize_t l_ret;
+	do {
+		l_ret = recvmsg(m_fd, &l_msg, MSG_CMSG_CLOEXEC);
+	} while ((l_ret == -1) && (errno == EINTR));
+	if (l_ret <= 0) {
+		if (l_ret == -1)
+			ctx.log_p(ss::log::ERR, std::format("fd_handoff: recvmsg failed, errno = {} ({})", errno, strerror(errno)));
+		return false;
+	}
+	for (struct cmsghdr *l_cmsg = CMSG_FIRSTHDR(&l_msg); l_cmsg != nullptr; l_cmsg = CMSG_NXTHDR(&l_msg, l_cmsg)) {
+		if ((l_cmsg->cmsg_level != SOL_SOCKET) || (l_cmsg->cmsg_type != SCM_RIGHTS))
+			continue;
+		std::size_t l_count = (l_cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		std::size_t l_at = a_fds.size();
+		a_fds.resize(l_at + l_count);
+		memcpy(a_fds.data() + l_at, CMSG_DATA(l_cmsg), l_count * sizeof(int));
+	}
+	bool l_ok = (l_msg.msg_flags & MSG_CTRUNC) == 0;
+	if (l_ok && (std::size_t(l_ret) < sizeof(l_header)))
+		l_ok = read_all((char *)&l_header + l_ret, sizeof(l_header) - l_ret, l_deadline);
+	if (l_ok && ((l_header.m_fds != a_fds.size()) || (l_header.m_payload_len > MAX_PAYLOAD))) {
+		ctx.log_p(ss::log::ERR, std::format("fd_handoff: malformed message, {} descriptors for {} announced, payload {} bytes", a_fds.size(), l_header.m_fds, l_header.m_payload_len));
+		l_ok = false;
+	}
+	if (l_ok) {
+		a_payload.resize(l_header.m_payload_len);
+		l_ok = read_all(a_payload.data(), a_payload.size(), l_deadline);
+	}
+	if (!l_ok) {
+		for (int l_fd : a_fds)
+			close(l_fd);
+		a_fds.clear();
+		a_payload.clear();
+		return false;
+	}
+	a_type = message_type(l_header.m_type);
+	return true;
+}
+
+bool fd_handoff::wait_readable(std::chrono::steady_clock::time_point a_deadline)
+{
+	while (1) {
+		int l_left = std::chrono::duration_cast<std::chrono::milliseconds>(a_deadline - std::chrono::steady_clock::now()).count();
+		if (l_left < 0)
+			l_left = 0;
+		struct pollfd l_pfd;
+		l_pfd.fd = m_fd;
+		l_pfd.events = POLLIN;
+		l_pfd.revents = 0;
+		int l_ret = poll(&l_pfd, 1, l_left);
+		if (l_ret > 0)
+			return true; // readable, or hung up, which the read will tell
+		if ((l_ret == -1) && (errno == EINTR))
+			continue;
+		if (l_ret == 0)
+			ctx.log_p(ss::log::ERR, "fd_handoff: timed out waiting for the other side");
+		return false;
+	}
+}
+
+bool fd_handoff::read_all(void *a_buf, std::size_t a_len, std::chrono::steady_clock::time_point a_deadline)
+{
+	std::size_t l_got = 0;
+	while (l_got < a_len) {
+		if (!wait_readable(a_deadline))
+			return false;
+		ssize_t l_ret = read(m_fd, (char *)a_buf + l_got, a_len - l_got);
+		if (l_ret > 0) {
+			l_got += l_ret;
+		} else if ((l_ret == -1) && (errno == EINTR)) {
+			continue;
+		} else {
+			ctx.log_p(ss::log::ERR, "fd_handoff: the other side hung up mid message");
+			return false;
+		}
+	}
+	return true;
+}
+
+void fd_handoff::put(std::string& a_to, std::uint64_t a_value)
+{
+	a_to.append((const char *)&a_value, sizeof(a_value));
+}
+
+void fd_handoff::put(std::string& a_to, const std::string& a_value)
+{
+	put(a_to, std::uint64_t(a_value.size()));
+	a_to.append(a_value);
+}
+
+std::uint64_t fd_handoff::reader::get_u64()
+{
+	std::uint64_t l_value = 0;
+	if (!m_ok || (m_payload.size() - m_pos < sizeof(l_value))) {
+		m_ok = false;
+		return 0;
+	}
+	memcpy(&l_value, m_payload.data() + m_pos, sizeof(l_value));
+	m_pos += sizeof(l_value);
+	return l_value;
+}
+
+std::string fd_handoff::reader::get_string()
+{
+	std::uint64_t l_len = get_u64();
+	if (!m_ok || (m_payload.size() - m_pos < l_len)) {
+		m_ok = false;
+		return "";
+	}
+	std::string l_value = m_payload.substr(m_pos, l_len);
+	m_pos += l_len;
+	return l_value;
+}
+
+} // namespace net
+} // namespace ss
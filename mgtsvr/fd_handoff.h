@@ -0,0 +1,79 @@
+#ifndef FD_HANDOFF_H
+#define FD_HANDOFF_H
+
+#include <string>
+#include <vector>
+#include <format>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "log.h"
+
+namespace ss {
+namespace net {
+
+// one end of the UNIX socket a server hands its sockets over to its successor on. Messages are
+// a typed payload plus up to MAX_FDS descriptors, which travel as SCM_RIGHTS with the message's
+// header so they arrive in the successor as descriptors of its own. Both ends block, every
+// receive has a deadline so a process that died on the other end can't hang us.
+
+class fd_handoff {
+public:
+	enum message_type : std::uint32_t {
+		HANDOFF_LISTENERS = 1, // old -> new: listening sockets
+		HANDOFF_READY, // new -> old: up and accepting, send the rest
+		HANDOFF_CLIENTS, // old -> new: a batch of connections and their state
+		HANDOFF_END // old -> new: that's everything
+	};
+
+	fd_handoff(int a_fd); // takes the socket over, closed on destruction
+	~fd_handoff();
+
+	const static std::size_t MAX_FDS = 64; // per message
+	const static std::size_t MAX_PAYLOAD = 1 << 30;
+
+	bool send(message_type a_type, const std::string& a_payload, const std::vector<int>& a_fds);
+	// false on timeout, error or hangup. Received descriptors are close-on-exec.
+	bool receive(message_type& a_type, std::string& a_payload, std::vector<int>& a_fds, int a_timeout_ms);
+
+	// payloads are built from fixed width integers and length prefixed strings, in host byte
+	// order: both ends are the same program on the same machine
+	static void put(std::string& a_to, std::uint64_t a_value);
+	static void put(std::string& a_to, const std::string& a_value);
+	class reader {
+	public:
+		reader(const std::string& a_payload) : m_payload(a_payload), m_pos(0), m_ok(true) { }
+		std::uint64_t get_u64();
+		std::string get_string();
+		bool ok() const { return m_ok; } // false once a read ran past the end
+		bool at_end() const { return m_pos >= m_payload.size(); }
+	protected:
+		const std::string& m_payload;
+		std::size_t m_pos;
+		bool m_ok;
+	};
+
+protected:
+	struct header {
+		std::uint32_t m_type;
+		std::uint32_t m_fds;
+		std::uint64_t m_payload_len;
+	};
+	bool wait_readable(std::chrono::steady_clock::time_point a_deadline);
+	bool read_all(void *a_buf, std::size_t a_len, std::chrono::steady_clock::time_point a_deadline);
+
+	ss::log::ctx& ctx = ss::log::ctx::get();
+	int m_fd;
+};
+
+} // namespace net
+} // namespace ss
+
+#endif // FD_HANDOFF_H
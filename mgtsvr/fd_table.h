@@ -0,0 +1,147 @@
+#ifndef FD_TABLE_H
+#define FD_TABLE_H
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+
+namespace ss {
+namespace net {
+
+// connection table indexed by fd. Records are spread over SHARDS independently locked
+// shards (fd % SHARDS), and within a shard live in a vector slot indexed by fd / SHARDS,
+// so a lookup is two array indexes and clients in different shards never contend.
+
+template <typename T>
+class fd_table {
+public:
+	const static std::size_t SHARDS = 256;
+
+	fd_table();
+	~fd_table();
+
+	// lock the shard holding a_fd and return its record. If there is no record the shard
+	// is unlocked again and nullptr is returned, otherwise release() must follow.
+	T *acquire(int a_fd);
+	void release(int a_fd);
+	// lookup for a caller that already holds the shard
+	T *find(int a_fd);
+
+	bool insert(int a_fd, const T& a_rec); // locks the shard
+	bool erase(int a_fd); // caller holds the shard
+	std::size_t size() const { return m_size.load(std::memory_order_relaxed); }
+
+	// visit every record, holding one shard at a time. a_fn must not acquire other records.
+	template <typename F>
+	void for_each(F a_fn);
+	// same, for the records of a single shard
+	template <typename F>
+	void for_each_in_shard(std::size_t a_shard, F&& a_fn);
+
+protected:
+	struct shard {
+		std::mutex m_mtx;
+		std::vector<std::unique_ptr<T>> m_slots;
+	};
+	std::array<shard, SHARDS> m_shards;
+	std::atomic<std::size_t> m_size;
+};
+
+template <typename T>
+fd_table<T>::fd_table()
+: m_size(0)
+{ }
+
+template <typename T>
+fd_table<T>::~fd_table()
+{ }
+
+template <typename T>
+T *fd_table<T>::acquire(int a_fd)
+{
+	if (a_fd < 0)
+		return nullptr;
+	shard& l_shard = m_shards[a_fd % SHARDS];
+	l_shard.m_mtx.lock();
+	T *l_ret = find(a_fd);
+	if (l_ret == nullptr)
+		l_shard.m_mtx.unlock();
+	return l_ret;
+}
+
+template <typename T>
+void fd_table<T>::release(int a_fd)
+{
+	m_shards[a_fd % SHARDS].m_mtx.unlock();
+}
+
+template <typename T>
+T *fd_table<T>::find(int a_fd)
+{
+	if (a_fd < 0)
+		return nullptr;
+	shard& l_shard = m_shards[a_fd % SHARDS];
+	std::size_t l_slot = a_fd / SHARDS;
+	if (l_slot >= l_shard.m_slots.size())
+		return nullptr;
+	return l_shard.m_slots[l_slot].get();
+}
+
+template <typename T>
+bool fd_table<T>::insert(int a_fd, const T& a_rec)
+{
+	if (a_fd < 0)
+		return false;
+	shard& l_shard = m_shards[a_fd % SHARDS];
+	std::lock_guard<std::mutex> l_guard(l_shard.m_mtx);
+	std::size_t l_slot = a_fd / SHARDS;
+	if (l_slot >= l_shard.m_slots.size())
+		l_shard.m_slots.resize(l_slot + 1);
+	if (l_shard.m_slots[l_slot])
+		return false;
+	l_shard.m_slots[l_slot] = std::make_unique<T>(a_rec);
+	m_size.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+template <typename T>
+bool fd_table<T>::erase(int a_fd)
+{
+	if (a_fd < 0)
+		return false;
+	shard& l_shard = m_shards[a_fd % SHARDS];
+	std::size_t l_slot = a_fd / SHARDS;
+	if ((l_slot >= l_shard.m_slots.size()) || !l_shard.m_slots[l_slot])
+		return false;
+	l_shard.m_slots[l_slot].reset();
+	m_size.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+template <typename T>
+template <typename F>
+void fd_table<T>::for_each(F a_fn)
+{
+	for (std::size_t i = 0; i < SHARDS; ++i)
+		for_each_in_shard(i, a_fn);
+}
+
+template <typename T>
+template <typename F>
+void fd_table<T>::for_each_in_shard(std::size_t a_shard, F&& a_fn)
+{
+	shard& l_shard = m_shards[a_shard];
+	std::lock_guard<std::mutex> l_guard(l_shard.m_mtx);
+	for (std::size_t l_slot = 0; l_slot < l_shard.m_slots.size(); ++l_slot) {
+		if (l_shard.m_slots[l_slot])
+			a_fn((int)(l_slot * SHARDS + a_shard), *l_shard.m_slots[l_slot]);
+	}
+}
+
+} // namespace net
+} // namespace ss
+
+#endif // FD_TABLE_H
@@ -4,6 +4,10 @@ fortune_server::fortune_server()
 : ss::net::command_server("fortune_server", "fortune_auth_db.json")
 {
 	ctx.log("fortune_server starting up..");
+	register_command("FORTUNE", PRIV_ANYONE, COMMAND_INLINE_SAFE, [this](command_call& a_call) {
+		send_to_client(a_call.client_sockfd, "You will move mountains.. in bed.");
+		return false;
+	});
 	ctx.log("fortune_server UP");
 }
 
@@ -21,9 +25,6 @@ void fortune_server::shutdown()
 
 void fortune_server::external_command(int client_sockfd, std::vector<std::string>& a_cmdv)
 {
-	if (a_cmdv[0] == "FORTUNE") {
-		send_to_client(client_sockfd, "You will move mountains.. in bed.");
-	} else {
-		send_to_client(client_sockfd, "[fortune_server: unrecognized command.]");
-	}
-}
\ No newline at end of file
+	// anything registered never gets here
+	send_to_client(client_sockfd, "[fortune_server: unrecognized command.]");
+}
@@ -0,0 +1,71 @@
+#include "histogram.h"
+
+namespace ss {
+namespace net {
+
+histogram::histogram()
+{
+	for (auto& i : m_counts)
+		i.store(0, std::memory_order_relaxed);
+}
+
+histogram::~histogram()
+{
+
+}
+
+unsigned int histogram::bucket(std::uint64_t a_ns)
+{
+	// values below SUB_BUCKETS are exact, above that the top SUB_BITS + 1 bits pick the bucket
+	if (a_ns < SUB_BUCKETS)
+		return a_ns;
+	unsigned int l_magnitude = std::bit_width(a_ns) - SUB_BITS; // >= 1
+	unsigned int l_sub = (a_ns >> (l_magnitude - 1)) & (SUB_BUCKETS - 1);
+	return l_magnitude * SUB_BUCKETS + l_sub;
+}
+
+std::uint64_t histogram::bucket_value(unsigned int a_bucket)
+{
+	unsigned int l_magnitude = a_bucket / SUB_BUCKETS;
+	std::uint64_t l_sub = a_bucket % SUB_BUCKETS;
+	if (l_magnitude == 0)
+		return l_sub;
+	unsigned int l_shift = l_magnitude - 1;
+	return (((SUB_BUCKETS + l_sub) << l_shift) - 1) + (std::uint64_t(1) << l_shift);
+}
+
+void histogram::record(std::uint64_t a_ns)
+{
+	std::atomic<std::uint64_t>& l_count = m_counts[bucket(a_ns)];
+	l_count.store(l_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void histogram::merge_into(std::array<std::uint64_t, BUCKETS>& a_counts, std::uint64_t& a_total) const
+{
+	std::uint64_t l_total = 0;
+	for (unsigned int i = 0; i < BUCKETS; ++i) {
+		std::uint64_t l_count = m_counts[i].load(std::memory_order_relaxed);
+		a_counts[i] += l_count;
+		l_total += l_count;
+	}
+	a_total += l_total;
+}
+
+std::uint64_t histogram::percentile(const std::array<std::uint64_t, BUCKETS>& a_counts, std::uint64_t a_total, double a_quantile)
+{
+	if (a_total == 0)
+		return 0;
+	std::uint64_t l_rank = std::uint64_t(a_quantile * a_total + 0.5);
+	if (l_rank == 0)
+		l_rank = 1;
+	std::uint64_t l_seen = 0;
+	for (unsigned int i = 0; i < BUCKETS; ++i) {
+		l_seen += a_counts[i];
+		if (l_seen >= l_rank)
+			return bucket_value(i);
+	}
+	return bucket_value(BUCKETS - 1);
+}
+
+} // namespace net
+} // namespace ss
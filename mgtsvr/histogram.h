@@ -0,0 +1,45 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <bit>
+
+namespace ss {
+namespace net {
+
+// HDR-style latency histogram in nanoseconds: each power of two is split into SUB_BUCKETS
+// linear buckets, so any value is recorded to within about 3% of itself. A histogram has one
+// writer; record() is a relaxed store, and readers on other threads may merge or take
+// percentiles from it at any time.
+
+class histogram {
+public:
+	histogram();
+	~histogram();
+
+	const static unsigned int SUB_BITS = 5;
+	const static unsigned int SUB_BUCKETS = 1 << SUB_BITS;
+	const static unsigned int MAGNITUDES = 64 - SUB_BITS + 1;
+	const static unsigned int BUCKETS = MAGNITUDES * SUB_BUCKETS;
+
+	static std::uint64_t now_ns() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+	void record(std::uint64_t a_ns); // single writer
+	void merge_into(std::array<std::uint64_t, BUCKETS>& a_counts, std::uint64_t& a_total) const;
+	// value at or below which a_quantile (0.0 - 1.0) of the recorded values fall
+	static std::uint64_t percentile(const std::array<std::uint64_t, BUCKETS>& a_counts, std::uint64_t a_total, double a_quantile);
+
+protected:
+	static unsigned int bucket(std::uint64_t a_ns);
+	static std::uint64_t bucket_value(unsigned int a_bucket); // highest value in a bucket
+
+	std::array<std::atomic<std::uint64_t>, BUCKETS> m_counts;
+};
+
+} // namespace net
+} // namespace ss
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,231 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <map>
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include "log.h"
+#include "fs.h"
+#include "icr.h"
+#include "command_server.h"
+
+// iobench: closed loop PING/PONG round trips against the same command_server running on each
+// I/O backend in turn, so the epoll and io_uring paths can be compared on one machine. A
+// reconnect storm follows: every storm client connects at once and sends a PING, and the time
+// until the last PONG is in is what a restart under load costs.
+
+class iobench_server : public ss::net::command_server {
+public:
+	iobench_server(const std::string& a_category)
+	: ss::net::command_server(a_category, "iobench_auth_db.json")
+	{ }
+	virtual ~iobench_server() { }
+	void external_command(int client_sockfd, std::vector<std::string>& a_cmdv)
+	{
+		if (a_cmdv[0] == "PING")
+			send_to_client(client_sockfd, "PONG");
+		else
+			send_to_client(client_sockfd, "[iobench_server: unrecognized command.]");
+	}
+};
+
+static bool read_line(int a_fd, std::string& a_pending, std::string& a_line)
+{
+	while (1) {
+		std::size_t l_pos = a_pending.find('\n');
+		if (l_pos != std::string::npos) {
+			a_line = a_pending.substr(0, l_pos);
+			a_pending.erase(0, l_pos + 1);
+			return true;
+		}
+		char l_buf[4096];
+		ssize_t l_ret = read(a_fd, l_buf, sizeof(l_buf));
+		if (l_ret <= 0)
+			return false;
+		a_pending.append(l_buf, l_ret);
+	}
+}
+
+static double run_backend(const std::string& a_category, int a_clients, int a_seconds)
+{
+	ss::log::ctx& ctx = ss::log::ctx::get();
+	ss::icr& l_icr = ss::icr::get();
+	int l_port = l_icr.to_integer(l_icr.keyvalue(a_category, "port"));
+	std::shared_ptr<iobench_server> l_server = std::make_shared<iobench_server>(a_category);
+	
+	std::atomic<bool> l_go(false);
+	std::atomic<bool> l_stop(false);
+	std::atomic<std::uint64_t> l_round_trips(0);
+	std::atomic<int> l_failed(0);
+	std::vector<std::thread> l_threads;
+	for (int i = 0; i < a_clients; ++i) {
+		l_threads.emplace_back([&]() {
+			int l_fd = socket(AF_INET, SOCK_STREAM, 0);
+			struct sockaddr_in l_addr = {};
+			l_addr.sin_family = AF_INET;
+			l_addr.sin_port = htons(l_port);
+			l_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if (connect(l_fd, (struct sockaddr *)&l_addr, sizeof(l_addr)) != 0) {
+				++l_failed;
+				close(l_fd);
+				return;
+			}
+			while (!l_go)
+				std::this_thread::yield();
+			std::string l_pending;
+			std::string l_line;
+			std::uint64_t l_count = 0;
+			const std::string l_ping = "PING\n";
+			while (!l_stop) {
+				if (write(l_fd, l_ping.data(), l_ping.size()) != (ssize_t)l_ping.size())
+					break;
+				bool l_ok;
+				do {
+					l_ok = read_line(l_fd, l_pending, l_line);
+				} while (l_ok && (l_line != "PONG"));
+				if (!l_ok)
+					break;
+				++l_count;
+			}
+			l_round_trips += l_count;
+			close(l_fd);
+		});
+	}
+	ss::doubletime l_start;
+	l_start.now();
+	l_go = true;
+	std::this_thread::sleep_for(std::chrono::seconds(a_seconds));
+	l_stop = true;
+	for (auto& i : l_threads)
+		i.join();
+	double l_elapsed = ss::doubletime::now_as_double() - double(l_start);
+	l_server->shutdown();
+	if (l_failed > 0)
+		ctx.log_p(ss::log::WARNING, std::format("{}: {} clients failed to connect", a_category, l_failed.load()));
+	return double(l_round_trips) / l_elapsed;
+}
+
+static double run_storm(const std::string& a_category, int a_clients, int& a_failed)
+{
+	ss::icr& l_icr = ss::icr::get();
+	int l_port = l_icr.to_integer(l_icr.keyvalue(a_category, "port"));
+	std::shared_ptr<iobench_server> l_server = std::make_shared<iobench_server>(a_category);
+	
+	// one thread drives all the clients through its own epoll, connects are fired off back to back
+	int l_epollfd = epoll_create1(EPOLL_CLOEXEC);
+	std::map<int, std::string> l_pending;
+	ss::doubletime l_start;
+	l_start.now();
+	a_failed = 0;
+	for (int i = 0; i < a_clients; ++i) {
+		int l_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		struct sockaddr_in l_addr = {};
+		l_addr.sin_family = AF_INET;
+		l_addr.sin_port = htons(l_port);
+		l_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if ((l_fd == -1) || ((connect(l_fd, (struct sockaddr *)&l_addr, sizeof(l_addr)) != 0) && (errno != EINPROGRESS))) {
+			++a_failed;
+			if (l_fd != -1)
+				close(l_fd);
+			continue;
+		}
+		struct epoll_event ev;
+		ev.events = EPOLLOUT;
+		ev.data.fd = l_fd;
+		epoll_ctl(l_epollfd, EPOLL_CTL_ADD, l_fd, &ev);
+		l_pending[l_fd] = "";
+	}
+	// writable means connected: send the PING and wait for its PONG
+	std::vector<int> l_done;
+	struct epoll_event l_events[256];
+	while (!l_pending.empty() && (ss::doubletime::now_as_double() - double(l_start) < 60.0)) {
+		int n = epoll_wait(l_epollfd, l_events, 256, 1000);
+		for (int i = 0; i < n; ++i) {
+			int l_fd = l_events[i].data.fd;
+			if (l_events[i].events & (EPOLLERR | EPOLLHUP)) {
+				++a_failed;
+			} else if (l_events[i].events & EPOLLOUT) {
+				struct epoll_event ev;
+				ev.events = EPOLLIN;
+				ev.data.fd = l_fd;
+				epoll_ctl(l_epollfd, EPOLL_CTL_MOD, l_fd, &ev);
+				if (write(l_fd, "PING\n", 5) == 5)
+					continue;
+				++a_failed;
+			} else {
+				char l_buf[4096];
+				ssize_t l_ret = read(l_fd, l_buf, sizeof(l_buf));
+				if (l_ret > 0) {
+					std::string& l_in = l_pending[l_fd];
+					l_in.append(l_buf, l_ret);
+					if (l_in.find("PONG\n") == std::string::npos)
+						continue;
+				} else if ((l_ret < 0) && (errno == EAGAIN)) {
+					continue;
+				} else {
+					++a_failed;
+				}
+			}
+			epoll_ctl(l_epollfd, EPOLL_CTL_DEL, l_fd, nullptr);
+			l_pending.erase(l_fd);
+			l_done.push_back(l_fd);
+		}
+	}
+	double l_elapsed = ss::doubletime::now_as_double() - double(l_start);
+	a_failed += l_pending.size();
+	for (auto& i : l_pending)
+		close(i.first);
+	for (auto i : l_done)
+		close(i);
+	close(l_epollfd);
+	l_server->shutdown();
+	return l_elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	ss::failure_services& l_fs = ss::failure_services::get();
+	l_fs.install_signal_handler();
+	ss::log::ctx& ctx = ss::log::ctx::get();
+	ctx.register_thread("main");
+	std::shared_ptr<ss::log::target_stdout> l_stdout =
+		std::make_shared<ss::log::target_stdout>(ss::log::NOTICE, ss::log::target_stdout::DEFAULT_FORMATTER_DEBUGINFO);
+	ctx.add_target(l_stdout, "default");
+	ss::icr& l_icr = ss::icr::get();
+	l_icr.read_file("iobench.ini", false);
+	l_icr.read_arguments(argc, argv);
+	
+	int l_clients = l_icr.to_integer(l_icr.keyvalue("iobench", "clients"));
+	int l_seconds = l_icr.to_integer(l_icr.keyvalue("iobench", "seconds"));
+	std::vector<std::pair<std::string, double>> l_results;
+	for (auto& l_category : { "iobench_epoll", "iobench_uring" }) {
+		ctx.log_p(ss::log::NOTICE, std::format("{}: {} clients for {} seconds..", l_category, l_clients, l_seconds));
+		l_results.push_back({ l_category, run_backend(l_category, l_clients, l_seconds) });
+	}
+	for (auto& [l_category, l_rate] : l_results)
+		std::cout << std::format("{:<16} {:>12.0f} round trips/sec", l_category, l_rate) << std::endl;
+	
+	// each storm client needs a descriptor at both ends, and they all live in this process
+	int l_storm = l_icr.to_integer(l_icr.keyvalue("iobench", "storm_clients"));
+	struct rlimit l_limit;
+	getrlimit(RLIMIT_NOFILE, &l_limit);
+	l_limit.rlim_cur = l_limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &l_limit);
+	if (rlim_t(l_storm) * 2 + 64 > l_limit.rlim_cur) {
+		l_storm = (l_limit.rlim_cur - 64) / 2;
+		ctx.log_p(ss::log::WARNING, std::format("descriptor limit is {}, storm cut down to {} clients", l_limit.rlim_cur, l_storm));
+	}
+	for (auto& l_category : { "iobench_epoll", "iobench_uring" }) {
+		ctx.log_p(ss::log::NOTICE, std::format("{}: reconnect storm of {} clients..", l_category, l_storm));
+		int l_failed;
+		double l_elapsed = run_storm(l_category, l_storm, l_failed);
+		std::cout << std::format("{:<16} {:>12.3f} sec until {} clients connected and served ({} failed)", l_category, l_elapsed, l_storm - l_failed, l_failed) << std::endl;
+	}
+	
+	return 0;
+}
@@ -0,0 +1,568 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <queue>
+#include <atomic>
+#include <barrier>
+#include <algorithm>
+#include <string>
+#include <format>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include "log.h"
+#include "fs.h"
+#include "icr.h"
+#include "auth.h"
+#include "histogram.h"
+
+// loadgen: drives a running command_server (fortune_server, say) with many TCP or UNIX
+// connections spread over a few threads. Each connection goes through whatever login roll the
+// server presents (none for auth_policy 0 and 1, username/password for 2, username and a
+// challenge response for 3), then issues the configured commands one at a time, either back
+// to back (closed loop) or at a fixed total rate (open loop). The end of a response is the
+// server's prompt, so the server has to run with prompts enabled.
+//
+// In open loop mode a command that can't go out when it's due (its connection is still waiting
+// on the previous one) is sent as soon as it can, and its latency is still counted from when it
+// was due, so a slow server can't hide behind the load it holds back.
+
+struct loadgen_config {
+	bool m_unix;
+	std::string m_host;
+	int m_port;
+	std::string m_unix_socket;
+	unsigned int m_connections;
+	unsigned int m_threads;
+	double m_connect_rate; // per second over all threads, 0 = all at once
+	std::string m_user_prefix;
+	unsigned int m_user_count;
+	std::string m_password;
+	std::vector<std::string> m_commands;
+	bool m_open_loop;
+	double m_rate; // commands per second over all connections, open loop only
+	int m_seconds;
+	int m_timeout; // seconds allowed for logging in, and for each response
+};
+
+class load_thread {
+public:
+	load_thread(const loadgen_config& a_config, unsigned int a_first, unsigned int a_count);
+	void run(std::barrier<>& a_ready, std::atomic<bool>& a_stop);
+
+	// results, read once the thread is joined
+	std::vector<std::unique_ptr<ss::net::histogram>> m_latency; // per command in the mix
+	std::vector<std::uint64_t> m_completed;
+	std::vector<std::uint64_t> m_errors; // responses the server refused or didn't recognize
+	ss::net::histogram m_login;
+	unsigned int m_ready;
+	unsigned int m_connect_failures;
+	unsigned int m_login_failures;
+	unsigned int m_timeouts;
+	unsigned int m_disconnects;
+
+protected:
+	enum conn_state {
+		CONN_CONNECTING,
+		CONN_LOGIN,
+		CONN_IDLE,
+		CONN_BUSY,
+		CONN_DEAD
+	};
+
+	struct connection {
+		int m_fd;
+		conn_state m_state;
+		std::string m_user;
+		std::string m_in;
+		std::string m_out;
+		std::uint64_t m_started; // connect started, or the command in flight was due (open loop) or sent
+		std::uint64_t m_sent;
+		std::uint64_t m_due; // open loop: when the next command is due
+		std::size_t m_command; // next command in the mix
+		bool m_refused;
+	};
+
+	bool open_connection(connection& a_conn);
+	void close_connection(connection& a_conn);
+	void handle_event(std::size_t a_index, std::uint32_t a_events);
+	void handle_line(connection& a_conn, const std::string& a_line);
+	void send_line(connection& a_conn, const std::string& a_line);
+	void flush(connection& a_conn);
+	void send_command(connection& a_conn, std::uint64_t a_started);
+	void command_done(std::size_t a_index);
+	void expire(std::uint64_t a_now);
+	int wait_ms(std::uint64_t a_now);
+
+	const loadgen_config& m_config;
+	unsigned int m_first;
+	int m_epollfd;
+	ss::net::auth m_auth;
+	std::vector<connection> m_conns;
+	bool m_loading; // past the barrier, commands are being issued
+	std::uint64_t m_interval; // open loop: ns between commands on one connection
+	typedef std::pair<std::uint64_t, std::size_t> due_entry;
+	std::priority_queue<due_entry, std::vector<due_entry>, std::greater<due_entry>> m_due; // idle connections by due time
+};
+
+load_thread::load_thread(const loadgen_config& a_config, unsigned int a_first, unsigned int a_count)
+: m_ready(0)
+, m_connect_failures(0)
+, m_login_failures(0)
+, m_timeouts(0)
+, m_disconnects(0)
+, m_config(a_config)
+, m_first(a_first)
+, m_epollfd(-1)
+, m_auth(ss::net::auth::role::CLIENT)
+, m_conns(a_count)
+, m_loading(false)
+, m_interval(0)
+{
+	for (std::size_t i = 0; i < m_config.m_commands.size(); ++i) {
+		m_latency.push_back(std::make_unique<ss::net::histogram>());
+		m_completed.push_back(0);
+		m_errors.push_back(0);
+	}
+	if (m_config.m_open_loop && (m_config.m_rate > 0))
+		m_interval = std::uint64_t(1e9 * m_config.m_connections / m_config.m_rate);
+}
+
+bool load_thread::open_connection(connection& a_conn)
+{
+	a_conn.m_state = CONN_DEAD;
+	a_conn.m_started = ss::net::histogram::now_ns();
+	int l_ret;
+	if (m_config.m_unix) {
+		a_conn.m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		struct sockaddr_un l_addr = {};
+		l_addr.sun_family = AF_UNIX;
+		strncpy(l_addr.sun_path, m_config.m_unix_socket.c_str(), sizeof(l_addr.sun_path) - 1);
+		l_ret = (a_conn.m_fd == -1) ? -1 : connect(a_conn.m_fd, (struct sockaddr *)&l_addr, sizeof(l_addr));
+	} else {
+		a_conn.m_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		struct sockaddr_in l_addr = {};
+		l_addr.sin_family = AF_INET;
+		l_addr.sin_port = htons(m_config.m_port);
+		inet_pton(AF_INET, m_config.m_host.c_str(), &l_addr.sin_addr);
+		l_ret = (a_conn.m_fd == -1) ? -1 : connect(a_conn.m_fd, (struct sockaddr *)&l_addr, sizeof(l_addr));
+		int l_one = 1;
+		if (a_conn.m_fd != -1)
+			setsockopt(a_conn.m_fd, IPPROTO_TCP, TCP_NODELAY, &l_one, sizeof(l_one));
+	}
+	if ((a_conn.m_fd == -1) || ((l_ret != 0) && (errno != EINPROGRESS) && (errno != EAGAIN))) {
+		if (a_conn.m_fd != -1)
+			close(a_conn.m_fd);
+		a_conn.m_fd = -1;
+		return false;
+	}
+	a_conn.m_state = (l_ret == 0) ? CONN_LOGIN : CONN_CONNECTING;
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLOUT;
+	ev.data.u64 = &a_conn - m_conns.data();
+	epoll_ctl(m_epollfd, EPOLL_CTL_ADD, a_conn.m_fd, &ev);
+	return true;
+}
+
+void load_thread::close_connection(connection& a_conn)
+{
+	if (a_conn.m_fd != -1)
+		close(a_conn.m_fd);
+	a_conn.m_fd = -1;
+	a_conn.m_state = CONN_DEAD;
+}
+
+void load_thread::send_line(connection& a_conn, const std::string& a_line)
+{
+	a_conn.m_out += a_line;
+	a_conn.m_out += '\n';
+	flush(a_conn);
+}
+
+void load_thread::flush(connection& a_conn)
+{
+	while (!a_conn.m_out.empty()) {
+		ssize_t l_ret = send(a_conn.m_fd, a_conn.m_out.data(), a_conn.m_out.size(), MSG_NOSIGNAL);
+		if (l_ret <= 0)
+			break;
+		a_conn.m_out.erase(0, l_ret);
+	}
+	// only ask to hear about writability while there's something left to write
+	struct epoll_event ev;
+	ev.events = a_conn.m_out.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT);
+	ev.data.u64 = &a_conn - m_conns.data();
+	epoll_ctl(m_epollfd, EPOLL_CTL_MOD, a_conn.m_fd, &ev);
+}
+
+void load_thread::send_command(connection& a_conn, std::uint64_t a_started)
+{
+	a_conn.m_state = CONN_BUSY;
+	a_conn.m_started = a_started;
+	a_conn.m_sent = ss::net::histogram::now_ns();
+	a_conn.m_refused = false;
+	send_line(a_conn, m_config.m_commands[a_conn.m_command]);
+}
+
+void load_thread::command_done(std::size_t a_index)
+{
+	connection& l_conn = m_conns[a_index];
+	std::uint64_t l_now = ss::net::histogram::now_ns();
+	if (l_conn.m_state == CONN_IDLE)
+		return; // nothing was asked
+	if (l_conn.m_state == CONN_BUSY) {
+		std::size_t l_command = l_conn.m_command;
+		m_latency[l_command]->record(l_now - l_conn.m_started);
+		++m_completed[l_command];
+		if (l_conn.m_refused)
+			++m_errors[l_command];
+		l_conn.m_command = (l_command + 1) % m_config.m_commands.size();
+	} else {
+		// logged in (or no login roll at all), ready for the first command
+		m_login.record(l_now - l_conn.m_started);
+		++m_ready;
+		l_conn.m_command = (m_first + a_index) % m_config.m_commands.size();
+	}
+	l_conn.m_state = CONN_IDLE;
+	if (!m_loading)
+		return;
+	if (!m_config.m_open_loop) {
+		send_command(l_conn, l_now);
+	} else if (l_conn.m_due <= l_now) {
+		// late already, go now but count from when it was due
+		std::uint64_t l_due = l_conn.m_due;
+		l_conn.m_due += m_interval;
+		send_command(l_conn, l_due);
+	} else {
+		m_due.push({ l_conn.m_due, a_index });
+	}
+}
+
+void load_thread::handle_line(connection& a_conn, const std::string& a_line)
+{
+	std::size_t l_index = &a_conn - m_conns.data();
+	if (a_line.ends_with("please enter a command.")) {
+		command_done(l_index);
+		return;
+	}
+	if (a_line == "disconnecting...") {
+		if (a_conn.m_state == CONN_LOGIN)
+			++m_login_failures;
+		else
+			++m_disconnects;
+		close_connection(a_conn);
+		return;
+	}
+	if (a_conn.m_state == CONN_BUSY) {
+		if ((a_line.find("unrecognized command") != std::string::npos) || (a_line.find("you do not have privileges") != std::string::npos))
+			a_conn.m_refused = true;
+		return;
+	}
+	if (a_conn.m_state != CONN_LOGIN)
+		return;
+	// the login roll, answered as the server asks
+	if (a_line.starts_with("username:")) {
+		send_line(a_conn, a_conn.m_user);
+	} else if (a_line.starts_with("password:")) {
+		send_line(a_conn, m_config.m_password);
+	} else if (a_line.starts_with("session: ")) {
+		std::optional<std::string> l_response = m_auth.challenge_response(a_line.substr(9), m_config.m_password);
+		if (!l_response.has_value()) {
+			++m_login_failures;
+			close_connection(a_conn);
+			return;
+		}
+		send_line(a_conn, l_response.value());
+	}
+}
+
+void load_thread::handle_event(std::size_t a_index, std::uint32_t a_events)
+{
+	connection& l_conn = m_conns[a_index];
+	if (l_conn.m_state == CONN_DEAD)
+		return;
+	if (l_conn.m_state == CONN_CONNECTING) {
+		int l_error = 0;
+		socklen_t l_len = sizeof(l_error);
+		getsockopt(l_conn.m_fd, SOL_SOCKET, SO_ERROR, &l_error, &l_len);
+		if (l_error != 0) {
+			++m_connect_failures;
+			close_connection(l_conn);
+			return;
+		}
+		l_conn.m_state = CONN_LOGIN;
+		flush(l_conn);
+	}
+	if (a_events & EPOLLOUT)
+		flush(l_conn);
+	if (!(a_events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+		return;
+	char l_buf[16384];
+	while (l_conn.m_state != CONN_DEAD) {
+		ssize_t l_ret = recv(l_conn.m_fd, l_buf, sizeof(l_buf), 0);
+		if (l_ret < 0) {
+			if ((errno == EAGAIN) || (errno == EINTR))
+				return;
+			l_ret = 0;
+		}
+		if (l_ret == 0) {
+			if (l_conn.m_state == CONN_LOGIN)
+				++m_login_failures;
+			else
+				++m_disconnects;
+			close_connection(l_conn);
+			return;
+		}
+		l_conn.m_in.append(l_buf, l_ret);
+		std::size_t l_pos = 0;
+		std::size_t l_end;
+		while ((l_conn.m_state != CONN_DEAD) && ((l_end = l_conn.m_in.find('\n', l_pos)) != std::string::npos)) {
+			handle_line(l_conn, l_conn.m_in.substr(l_pos, l_end - l_pos));
+			l_pos = l_end + 1;
+		}
+		l_conn.m_in.erase(0, l_pos);
+	}
+}
+
+void load_thread::expire(std::uint64_t a_now)
+{
+	std::uint64_t l_limit = std::uint64_t(m_config.m_timeout) * 1000000000;
+	for (auto& l_conn : m_conns) {
+		if ((l_conn.m_state == CONN_BUSY) && (a_now > l_conn.m_sent + l_limit)) {
+			++m_timeouts;
+			close_connection(l_conn);
+		}
+	}
+}
+
+int load_thread::wait_ms(std::uint64_t a_now)
+{
+	// until the next command is due, but look at the clock at least every 100ms
+	if (m_due.empty() || (m_due.top().first > a_now + 100000000))
+		return 100;
+	return (m_due.top().first > a_now) ? (m_due.top().first - a_now) / 1000000 : 0;
+}
+
+void load_thread::run(std::barrier<>& a_ready, std::atomic<bool>& a_stop)
+{
+	m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+	for (std::size_t i = 0; i < m_conns.size(); ++i) {
+		m_conns[i].m_fd = -1;
+		m_conns[i].m_state = CONN_DEAD;
+		m_conns[i].m_user = std::format("{}{}", m_config.m_user_prefix, (m_first + i) % std::max(m_config.m_user_count, 1u));
+	}
+	std::vector<struct epoll_event> l_events(256);
+
+	// connect and log in, at our share of the connect rate
+	std::uint64_t l_start = ss::net::histogram::now_ns();
+	std::uint64_t l_deadline = l_start + std::uint64_t(m_config.m_timeout) * 1000000000;
+	double l_rate = m_config.m_connect_rate / m_config.m_threads;
+	std::size_t l_opened = 0;
+	while (1) {
+		std::uint64_t l_now = ss::net::histogram::now_ns();
+		std::size_t l_allowed = (l_rate > 0) ? std::min(m_conns.size(), std::size_t((l_now - l_start) / 1e9 * l_rate) + 1) : m_conns.size();
+		for (; l_opened < l_allowed; ++l_opened) {
+			if (!open_connection(m_conns[l_opened]))
+				++m_connect_failures;
+		}
+		bool l_pending = (l_opened < m_conns.size());
+		for (auto& l_conn : m_conns)
+			l_pending |= ((l_conn.m_state == CONN_CONNECTING) || (l_conn.m_state == CONN_LOGIN));
+		if (!l_pending)
+			break;
+		if (l_now > l_deadline) {
+			// whatever is still logging in by now isn't going to
+			for (auto& l_conn : m_conns) {
+				if ((l_conn.m_state == CONN_CONNECTING) || (l_conn.m_state == CONN_LOGIN)) {
+					++m_login_failures;
+					close_connection(l_conn);
+				}
+			}
+			break;
+		}
+		int n = epoll_wait(m_epollfd, l_events.data(), l_events.size(), 10);
+		for (int i = 0; i < n; ++i)
+			handle_event(l_events[i].data.u64, l_events[i].events);
+	}
+
+	// everybody's connected, start the clock
+	a_ready.arrive_and_wait();
+	m_loading = true;
+	std::uint64_t l_now = ss::net::histogram::now_ns();
+	for (std::size_t i = 0; i < m_conns.size(); ++i) {
+		connection& l_conn = m_conns[i];
+		if (l_conn.m_state != CONN_IDLE)
+			continue;
+		if (m_config.m_open_loop) {
+			// spread the connections evenly over one interval
+			l_conn.m_due = l_now + m_interval * (m_first + i) / m_config.m_connections;
+			m_due.push({ l_conn.m_due, i });
+		} else {
+			send_command(l_conn, l_now);
+		}
+	}
+	std::uint64_t l_next_expiry = l_now + 1000000000;
+	while (!a_stop) {
+		int n = epoll_wait(m_epollfd, l_events.data(), l_events.size(), wait_ms(l_now));
+		for (int i = 0; i < n; ++i)
+			handle_event(l_events[i].data.u64, l_events[i].events);
+		l_now = ss::net::histogram::now_ns();
+		while (!m_due.empty() && (m_due.top().first <= l_now)) {
+			std::size_t l_index = m_due.top().second;
+			m_due.pop();
+			connection& l_conn = m_conns[l_index];
+			if (l_conn.m_state != CONN_IDLE)
+				continue;
+			std::uint64_t l_due = l_conn.m_due;
+			l_conn.m_due += m_interval;
+			send_command(l_conn, l_due);
+		}
+		if (l_now >= l_next_expiry) {
+			expire(l_now);
+			l_next_expiry = l_now + 1000000000;
+		}
+	}
+	for (auto& l_conn : m_conns)
+		close_connection(l_conn);
+	close(m_epollfd);
+}
+
+static std::string ms(std::uint64_t a_ns)
+{
+	return std::format("{:.3f}", a_ns / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	ss::failure_services& l_fs = ss::failure_services::get();
+	l_fs.install_signal_handler();
+	ss::log::ctx& ctx = ss::log::ctx::get();
+	ctx.register_thread("main");
+	std::shared_ptr<ss::log::target_stdout> l_stdout =
+		std::make_shared<ss::log::target_stdout>(ss::log::NOTICE, ss::log::target_stdout::DEFAULT_FORMATTER_DEBUGINFO);
+	ctx.add_target(l_stdout, "default");
+	ss::icr& l_icr = ss::icr::get();
+	l_icr.read_file("loadgen.ini", false);
+	l_icr.read_arguments(argc, argv);
+
+	auto l_key = [&](const std::string& a_key, const std::string& a_default) -> std::string {
+		return l_icr.key_is_defined("loadgen", a_key) ? l_icr.keyvalue("loadgen", a_key) : a_default;
+	};
+	loadgen_config l_config;
+	l_config.m_unix = (l_key("connection", "tcp") == "unix");
+	l_config.m_host = l_key("ip", "127.0.0.1");
+	l_config.m_port = l_icr.to_integer(l_key("port", "9734"));
+	l_config.m_unix_socket = l_key("unix_socket", "fortune.sock");
+	l_config.m_connections = l_icr.to_integer(l_key("connections", "1000"));
+	l_config.m_threads = l_icr.to_integer(l_key("threads", "4"));
+	l_config.m_connect_rate = l_icr.to_double(l_key("connect_rate", "0"));
+	l_config.m_user_prefix = l_key("user_prefix", "load");
+	l_config.m_user_count = l_icr.to_integer(l_key("user_count", "1000"));
+	l_config.m_password = l_key("password", "load");
+	l_config.m_open_loop = (l_key("mode", "closed") == "open");
+	l_config.m_rate = l_icr.to_double(l_key("rate", "10000"));
+	l_config.m_seconds = l_icr.to_integer(l_key("seconds", "10"));
+	l_config.m_timeout = l_icr.to_integer(l_key("timeout", "10"));
+	std::string l_commands = l_key("commands", "FORTUNE,/WHOAMI,/WHO");
+	std::size_t l_pos = 0;
+	while (l_pos <= l_commands.size()) {
+		std::size_t l_end = std::min(l_commands.find(',', l_pos), l_commands.size());
+		std::string l_command = l_commands.substr(l_pos, l_end - l_pos);
+		l_command.erase(0, l_command.find_first_not_of(' '));
+		l_command.erase(l_command.find_last_not_of(' ') + 1);
+		if (!l_command.empty())
+			l_config.m_commands.push_back(l_command);
+		l_pos = l_end + 1;
+	}
+	if (l_config.m_commands.empty() || (l_config.m_connections == 0) || (l_config.m_threads == 0) || (l_config.m_open_loop && (l_config.m_rate <= 0))) {
+		ctx.log_p(ss::log::NOTICE, "loadgen needs at least one command, connection and thread, and a rate above zero in open loop mode, exiting!");
+		return 1;
+	}
+	l_config.m_threads = std::min(l_config.m_threads, l_config.m_connections);
+	if (l_config.m_connections > l_config.m_user_count)
+		ctx.log_p(ss::log::WARNING, std::format("{} connections share {} user names, logins past the first {} will be refused under auth_policy 2 and 3", l_config.m_connections, l_config.m_user_count, l_config.m_user_count));
+
+	// every connection is a descriptor
+	struct rlimit l_limit;
+	getrlimit(RLIMIT_NOFILE, &l_limit);
+	l_limit.rlim_cur = l_limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &l_limit);
+	if (rlim_t(l_config.m_connections) + 64 > l_limit.rlim_cur) {
+		l_config.m_connections = l_limit.rlim_cur - 64;
+		ctx.log_p(ss::log::WARNING, std::format("descriptor limit is {}, cut down to {} connections", l_limit.rlim_cur, l_config.m_connections));
+	}
+
+	ctx.log_p(ss::log::NOTICE, std::format("{} connections over {} on {} threads, {}..", l_config.m_connections, l_config.m_unix ? l_config.m_unix_socket : std::format("{}:{}", l_config.m_host, l_config.m_port), l_config.m_threads, l_config.m_open_loop ? std::format("open loop at {} commands/sec", l_config.m_rate) : std::string("closed loop")));
+	std::vector<std::unique_ptr<load_thread>> l_loads;
+	unsigned int l_first = 0;
+	for (unsigned int i = 0; i < l_config.m_threads; ++i) {
+		unsigned int l_count = l_config.m_connections / l_config.m_threads + ((i < l_config.m_connections % l_config.m_threads) ? 1 : 0);
+		l_loads.push_back(std::make_unique<load_thread>(l_config, l_first, l_count));
+		l_first += l_count;
+	}
+	std::barrier<> l_ready(l_config.m_threads + 1);
+	std::atomic<bool> l_stop(false);
+	std::vector<std::thread> l_threads;
+	for (auto& l_load : l_loads)
+		l_threads.emplace_back(&load_thread::run, l_load.get(), std::ref(l_ready), std::ref(l_stop));
+	l_ready.arrive_and_wait();
+	ctx.log_p(ss::log::NOTICE, std::format("logins done, running for {} seconds..", l_config.m_seconds));
+	ss::doubletime l_start;
+	l_start.now();
+	std::this_thread::sleep_for(std::chrono::seconds(l_config.m_seconds));
+	l_stop = true;
+	for (auto& i : l_threads)
+		i.join();
+	double l_elapsed = ss::doubletime::now_as_double() - double(l_start);
+
+	// merge what the threads recorded
+	typedef std::array<std::uint64_t, ss::net::histogram::BUCKETS> counts;
+	std::vector<counts> l_merged(l_config.m_commands.size() + 2);
+	std::vector<std::uint64_t> l_totals(l_config.m_commands.size() + 2, 0);
+	std::vector<std::uint64_t> l_errors(l_config.m_commands.size(), 0);
+	std::size_t l_all = l_config.m_commands.size();
+	std::size_t l_login = l_all + 1;
+	unsigned int l_ready_count = 0, l_connect_failures = 0, l_login_failures = 0, l_timeouts = 0, l_disconnects = 0;
+	for (auto& l_load : l_loads) {
+		for (std::size_t i = 0; i < l_config.m_commands.size(); ++i) {
+			l_load->m_latency[i]->merge_into(l_merged[i], l_totals[i]);
+			l_load->m_latency[i]->merge_into(l_merged[l_all], l_totals[l_all]);
+			l_errors[i] += l_load->m_errors[i];
+		}
+		l_load->m_login.merge_into(l_merged[l_login], l_totals[l_login]);
+		l_ready_count += l_load->m_ready;
+		l_connect_failures += l_load->m_connect_failures;
+		l_login_failures += l_load->m_login_failures;
+		l_timeouts += l_load->m_timeouts;
+		l_disconnects += l_load->m_disconnects;
+	}
+
+	std::cout << std::format("connections: {} ready, {} failed to connect, {} failed to log in", l_ready_count, l_connect_failures, l_login_failures) << std::endl;
+	std::cout << std::format("{:<20} {:>10} {:>12} {:>10} {:>10} {:>10} {:>8}", "command", "count", "per sec", "p50 ms", "p99 ms", "p999 ms", "errors") << std::endl;
+	auto l_row = [&](const std::string& a_name, std::size_t a_index, std::uint64_t a_errors, double a_elapsed) {
+		const counts& l_counts = l_merged[a_index];
+		std::uint64_t l_total = l_totals[a_index];
+		std::cout << std::format("{:<20} {:>10} {:>12.1f} {:>10} {:>10} {:>10} {:>8}", a_name, l_total, (a_elapsed > 0) ? l_total / a_elapsed : 0.0, ms(ss::net::histogram::percentile(l_counts, l_total, 0.5)), ms(ss::net::histogram::percentile(l_counts, l_total, 0.99)), ms(ss::net::histogram::percentile(l_counts, l_total, 0.999)), a_errors) << std::endl;
+	};
+	std::uint64_t l_all_errors = 0;
+	for (std::size_t i = 0; i < l_config.m_commands.size(); ++i) {
+		l_row(l_config.m_commands[i], i, l_errors[i], l_elapsed);
+		l_all_errors += l_errors[i];
+	}
+	l_row("(all)", l_all, l_all_errors, l_elapsed);
+	l_row("(login)", l_login, l_login_failures, 0);
+	std::cout << std::format("{} responses timed out, {} connections dropped by the server during the run", l_timeouts, l_disconnects) << std::endl;
+
+	return 0;
+}
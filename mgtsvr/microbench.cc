@@ -0,0 +1,271 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+#include <new>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "log.h"
+#include "fs.h"
+#include "icr.h"
+#include "esr.h"
+#include "auth.h"
+#include "command_server.h"
+
+// microbench: ns/op and allocations/op for the functions run per command or per login, one line
+// per benchmark in a fixed order so the output of two releases can be diffed. Each benchmark is
+// calibrated to run for about min_time seconds, and the median of repeats runs is reported.
+// Allocations are counted through the global operator new, on the benchmarking thread only, so
+// the server's own threads don't show up in the numbers.
+
+static thread_local std::uint64_t s_allocs = 0;
+
+void *operator new(std::size_t a_size)
+{
+	++s_allocs;
+	void *l_ret = std::malloc(a_size ? a_size : 1);
+	if (l_ret == nullptr)
+		throw std::bad_alloc();
+	return l_ret;
+}
+
+void *operator new(std::size_t a_size, const std::nothrow_t&) noexcept
+{
+	++s_allocs;
+	return std::malloc(a_size ? a_size : 1);
+}
+
+void operator delete(void *a_ptr) noexcept
+{
+	std::free(a_ptr);
+}
+
+void operator delete(void *a_ptr, std::size_t) noexcept
+{
+	std::free(a_ptr);
+}
+
+void operator delete(void *a_ptr, const std::nothrow_t&) noexcept
+{
+	std::free(a_ptr);
+}
+
+// keep the optimizer from dropping a result nobody looks at
+template <typename T>
+static void keep(T&& a_value)
+{
+	asm volatile("" : : "r"(&a_value) : "memory");
+}
+
+class microbench_server : public ss::net::command_server {
+public:
+	microbench_server(const std::string& a_category)
+	: ss::net::command_server(a_category, "microbench_auth_db.json")
+	, m_client(-1)
+	{ }
+	virtual ~microbench_server() { }
+	void newly_accepted_client(int client_sockfd)
+	{
+		m_client = client_sockfd;
+	}
+	void external_command(int client_sockfd, std::vector<std::string>& a_cmdv) { }
+	using command_server::split_command;
+	using command_server::pad;
+	using command_server::send_to_client;
+	std::atomic<int> m_client; // server side of the one connection we make
+};
+
+class microbench {
+public:
+	microbench(double a_min_time, int a_repeats, const std::string& a_filter)
+	: m_min_time(a_min_time)
+	, m_repeats(a_repeats)
+	, m_filter(a_filter)
+	{
+		std::cout << std::format("{:<32} {:>14} {:>12} {:>12}", "benchmark", "ns/op", "allocs/op", "iterations") << std::endl;
+	}
+
+	template <typename F>
+	void run(const std::string& a_name, F&& a_op)
+	{
+		if (!m_filter.empty() && (a_name.find(m_filter) == std::string::npos))
+			return;
+		// grow the batch until it takes a measurable time, then size it for m_min_time
+		std::uint64_t l_iterations = 1;
+		double l_elapsed;
+		while (1) {
+			l_elapsed = time(a_op, l_iterations).first;
+			if ((l_elapsed >= m_min_time / 10) || (l_iterations >= (1ull << 40)))
+				break;
+			l_iterations *= 10;
+		}
+		if (l_elapsed < m_min_time)
+			l_iterations = std::max<std::uint64_t>(1, l_iterations * (m_min_time / std::max(l_elapsed, 1e-9)));
+		std::vector<double> l_ns;
+		std::uint64_t l_allocs = 0;
+		for (int i = 0; i < m_repeats; ++i) {
+			auto [l_run, l_run_allocs] = time(a_op, l_iterations);
+			l_ns.push_back(l_run * 1e9 / l_iterations);
+			l_allocs = l_run_allocs;
+		}
+		std::sort(l_ns.begin(), l_ns.end());
+		std::cout << std::format("{:<32} {:>14.1f} {:>12.2f} {:>12}", a_name, l_ns[l_ns.size() / 2], double(l_allocs) / l_iterations, l_iterations) << std::endl;
+	}
+
+	// a benchmark that couldn't run still gets its line, so the output of two runs lines up
+	void skip(const std::string& a_name, const std::string& a_reason)
+	{
+		if (!m_filter.empty() && (a_name.find(m_filter) == std::string::npos))
+			return;
+		std::cout << std::format("{:<32} skipped ({})", a_name, a_reason) << std::endl;
+	}
+
+protected:
+	template <typename F>
+	std::pair<double, std::uint64_t> time(F& a_op, std::uint64_t a_iterations)
+	{
+		std::uint64_t l_allocs = s_allocs;
+		auto l_start = std::chrono::steady_clock::now();
+		for (std::uint64_t i = 0; i < a_iterations; ++i)
+			a_op();
+		auto l_end = std::chrono::steady_clock::now();
+		return { std::chrono::duration<double>(l_end - l_start).count(), s_allocs - l_allocs };
+	}
+
+	double m_min_time;
+	int m_repeats;
+	std::string m_filter;
+};
+
+static void bench_auth(microbench& a_bench, unsigned int a_max_users)
+{
+	ss::net::auth l_server(ss::net::auth::role::SERVER);
+	ss::net::auth l_client(ss::net::auth::role::CLIENT);
+	std::string l_hash = l_server.generate_hash("banana");
+	for (int i = 0; i < 10; ++i)
+		l_server.add_user(std::format("user{}", i), l_hash);
+	a_bench.run("auth::generate_hash", [&]() {
+		keep(l_server.generate_hash("banana"));
+	});
+	a_bench.run("auth::challenge", [&]() {
+		keep(l_server.challenge("user5"));
+	});
+	std::optional<ss::net::challenge_pack> l_pack = l_server.challenge("user5");
+	std::string l_response = l_client.challenge_response(l_pack.value().session, "banana").value();
+	a_bench.run("auth::authenticate", [&]() {
+		keep(l_server.authenticate("user5", l_pack.value(), l_response));
+	});
+
+	// auth DBs of a few sizes, all users sharing the one hash so building them stays cheap
+	for (unsigned int l_users : { 10u, 10000u, 1000000u }) {
+		if (l_users > a_max_users) {
+			a_bench.skip(std::format("auth::save_authdb/{}", l_users), "over max_users");
+			a_bench.skip(std::format("auth::load_authdb/{}", l_users), "over max_users");
+			continue;
+		}
+		std::string l_file = std::format("microbench_authdb_{}.json", l_users);
+		{
+			ss::net::auth l_db(ss::net::auth::role::SERVER);
+			for (unsigned int i = 0; i < l_users; ++i)
+				l_db.add_user(std::format("user{}", i), l_hash);
+			a_bench.run(std::format("auth::save_authdb/{}", l_users), [&]() {
+				keep(l_db.save_authdb(l_file));
+			});
+		}
+		a_bench.run(std::format("auth::load_authdb/{}", l_users), [&]() {
+			ss::net::auth l_db(ss::net::auth::role::SERVER);
+			keep(l_db.load_authdb(l_file));
+		});
+		std::filesystem::remove(l_file);
+	}
+}
+
+static void bench_esr(microbench& a_bench)
+{
+	a_bench.run("esr::esr", [&]() {
+		ss::esr l_esr;
+		keep(l_esr);
+	});
+	ss::esr_base_ptr l_object = std::make_shared<ss::esr_object>("object");
+	ss::esr_base_ptr l_number = std::make_shared<ss::esr_number>("number", 1.0);
+	a_bench.run("esr as_object", [&]() {
+		keep(ss::as_object(l_object));
+	});
+	a_bench.run("esr as_number", [&]() {
+		keep(ss::as_number(l_number));
+	});
+	a_bench.run("esr as_string (mismatch)", [&]() {
+		keep(ss::as_string(l_number));
+	});
+}
+
+static void bench_command_server(microbench& a_bench)
+{
+	ss::icr& l_icr = ss::icr::get();
+	std::shared_ptr<microbench_server> l_server = std::make_shared<microbench_server>("microbench_server");
+	a_bench.run("command_server::split_command", [&]() {
+		keep(l_server->split_command("/BROADCAST hello there everybody"));
+	});
+	a_bench.run("command_server::pad", [&]() {
+		keep(l_server->pad("privilege level:", 20));
+	});
+
+	// one real client, its output drained by a thread of its own
+	int l_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	struct sockaddr_un l_addr = {};
+	l_addr.sun_family = AF_UNIX;
+	strncpy(l_addr.sun_path, l_icr.keyvalue("microbench_server", "unix_socket").c_str(), sizeof(l_addr.sun_path) - 1);
+	if (connect(l_fd, (struct sockaddr *)&l_addr, sizeof(l_addr)) == 0) {
+		while (l_server->m_client == -1)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		std::thread l_drain([l_fd]() {
+			char l_buf[65536];
+			while (read(l_fd, l_buf, sizeof(l_buf)) > 0)
+				;
+		});
+		int l_client = l_server->m_client;
+		a_bench.run("command_server::send_to_client", [&]() {
+			l_server->send_to_client(l_client, "You will move mountains.. in bed.");
+		});
+		shutdown(l_fd, SHUT_RD);
+		l_drain.join();
+	} else {
+		a_bench.skip("command_server::send_to_client", "connect failed");
+	}
+	close(l_fd);
+	l_server->shutdown();
+}
+
+int main(int argc, char **argv)
+{
+	ss::failure_services& l_fs = ss::failure_services::get();
+	l_fs.install_signal_handler();
+	ss::log::ctx& ctx = ss::log::ctx::get();
+	ctx.register_thread("main");
+	std::shared_ptr<ss::log::target_stdout> l_stdout =
+		std::make_shared<ss::log::target_stdout>(ss::log::NOTICE, ss::log::target_stdout::DEFAULT_FORMATTER_DEBUGINFO);
+	ctx.add_target(l_stdout, "default");
+	ss::icr& l_icr = ss::icr::get();
+	l_icr.read_file("microbench.ini", false);
+	l_icr.read_arguments(argc, argv);
+
+	double l_min_time = l_icr.to_double(l_icr.keyvalue("microbench", "min_time"));
+	int l_repeats = l_icr.to_integer(l_icr.keyvalue("microbench", "repeats"));
+	unsigned int l_max_users = l_icr.to_integer(l_icr.keyvalue("microbench", "max_users"));
+	std::string l_filter;
+	if (l_icr.key_is_defined("microbench", "filter"))
+		l_filter = l_icr.keyvalue("microbench", "filter");
+	microbench l_bench(l_min_time, std::max(l_repeats, 1), l_filter);
+	bench_command_server(l_bench);
+	bench_auth(l_bench, l_max_users);
+	bench_esr(l_bench);
+
+	return 0;
+}
@@ -0,0 +1,136 @@
+#include "out_queue.h"
+
+namespace ss {
+namespace net {
+
+out_queue::out_queue()
+: m_owned_head(0)
+, m_size(0)
+{
+
+}
+
+out_queue::~out_queue()
+{
+
+}
+
+void out_queue::clear()
+{
+	m_owned.clear();
+	m_owned_head = 0;
+	m_attachments.clear();
+	m_size = 0;
+}
+
+void out_queue::write(const std::uint8_t *a_data, std::size_t a_len)
+{
+	m_owned.write(a_data, a_len);
+	m_size += a_len;
+}
+
+void out_queue::write_std_str(const std::string& a_string)
+{
+	write((const std::uint8_t *)a_string.data(), a_string.size());
+}
+
+void out_queue::write_std_str_delim(const std::string& a_string, std::uint8_t a_delim)
+{
+	write((const std::uint8_t *)a_string.data(), a_string.size());
+	write(&a_delim, 1);
+}
+
+void out_queue::attach(std::shared_ptr<const std::string> a_payload)
+{
+	if (!a_payload || a_payload->empty())
+		return;
+	attachment l_att;
+	l_att.m_payload = a_payload;
+	l_att.m_at = m_owned_head + m_owned.size();
+	l_att.m_offset = 0;
+	m_size += a_payload->size();
+	m_attachments.push_back(l_att);
+}
+
+int out_queue::gather(struct iovec *a_iov, int a_max) const
+{
+	int l_cnt = 0;
+	std::uint64_t l_pos = m_owned_head;
+	struct iovec l_seg[2];
+	for (auto& l_att : m_attachments) {
+		if (l_att.m_at > l_pos) {
+			// owned bytes written before this payload was attached
+			int l_segs = m_owned.data_segments(l_seg, l_pos - m_owned_head, l_att.m_at - l_pos);
+			for (int i = 0; i < l_segs; ++i) {
+				if (l_cnt == a_max)
+					return l_cnt;
+				a_iov[l_cnt++] = l_seg[i];
+			}
+			l_pos = l_att.m_at;
+		}
+		if (l_cnt == a_max)
+			return l_cnt;
+		a_iov[l_cnt].iov_base = (void *)(l_att.m_payload->data() + l_att.m_offset);
+		a_iov[l_cnt].iov_len = l_att.m_payload->size() - l_att.m_offset;
+		++l_cnt;
+	}
+	// whatever is left in the owned buffer
+	int l_segs = m_owned.data_segments(l_seg, l_pos - m_owned_head, m_owned.size());
+	for (int i = 0; (i < l_segs) && (l_cnt < a_max); ++i)
+		a_iov[l_cnt++] = l_seg[i];
+	return l_cnt;
+}
+
+int out_queue::gather_pinned(struct iovec *a_iov, int a_max, std::string& a_copy, std::vector<std::shared_ptr<const std::string>>& a_refs) const
+{
+	int l_cnt = gather(a_iov, a_max);
+	// size the copy up front so the iovecs pointing into it stay valid
+	std::size_t l_owned = 0;
+	auto l_att = m_attachments.begin();
+	for (int i = 0; i < l_cnt; ++i) {
+		if ((l_att != m_attachments.end()) && (a_iov[i].iov_base == (void *)(l_att->m_payload->data() + l_att->m_offset)))
+			++l_att;
+		else
+			l_owned += a_iov[i].iov_len;
+	}
+	a_copy.clear();
+	a_copy.reserve(l_owned);
+	a_refs.clear();
+	l_att = m_attachments.begin();
+	for (int i = 0; i < l_cnt; ++i) {
+		if ((l_att != m_attachments.end()) && (a_iov[i].iov_base == (void *)(l_att->m_payload->data() + l_att->m_offset))) {
+			a_refs.push_back(l_att->m_payload);
+			++l_att;
+		} else {
+			std::size_t l_at = a_copy.size();
+			a_copy.append((const char *)a_iov[i].iov_base, a_iov[i].iov_len);
+			a_iov[i].iov_base = (void *)(a_copy.data() + l_at);
+		}
+	}
+	return l_cnt;
+}
+
+void out_queue::consume(std::size_t a_len)
+{
+	m_size -= std::min(a_len, m_size);
+	while (a_len > 0) {
+		std::size_t l_owned_before = m_attachments.empty() ? m_owned.size() : m_attachments.front().m_at - m_owned_head;
+		std::size_t l_take = std::min(a_len, l_owned_before);
+		if (l_take > 0) {
+			m_owned.consume(l_take);
+			m_owned_head += l_take;
+			a_len -= l_take;
+		}
+		if ((a_len == 0) || m_attachments.empty())
+			break;
+		attachment& l_att = m_attachments.front();
+		l_take = std::min(a_len, l_att.m_payload->size() - l_att.m_offset);
+		l_att.m_offset += l_take;
+		a_len -= l_take;
+		if (l_att.m_offset == l_att.m_payload->size())
+			m_attachments.pop_front();
+	}
+}
+
+} // namespace net
+} // namespace ss
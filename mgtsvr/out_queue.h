@@ -0,0 +1,58 @@
+#ifndef OUT_QUEUE_H
+#define OUT_QUEUE_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include <sys/uio.h>
+
+#include "circbuff.h"
+
+namespace ss {
+namespace net {
+
+// per-client output queue. Small writes are copied into a circular buffer, large or shared
+// payloads are attached by reference and spliced into the byte stream at the point they
+// were attached, so they go out with writev() without ever being concatenated.
+
+class out_queue {
+public:
+	out_queue();
+	~out_queue();
+
+	std::size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	void clear();
+
+	void write(const std::uint8_t *a_data, std::size_t a_len);
+	void write_std_str(const std::string& a_string);
+	void write_std_str_delim(const std::string& a_string, std::uint8_t a_delim = '\n');
+	void attach(std::shared_ptr<const std::string> a_payload);
+
+	// fill up to a_max iovecs with pending output in stream order, returns count
+	int gather(struct iovec *a_iov, int a_max) const;
+	// as gather(), but for output that stays in flight while the queue keeps changing: owned
+	// bytes are copied into a_copy and attached payloads are pinned in a_refs
+	int gather_pinned(struct iovec *a_iov, int a_max, std::string& a_copy, std::vector<std::shared_ptr<const std::string>>& a_refs) const;
+	void consume(std::size_t a_len);
+
+protected:
+	struct attachment {
+		std::shared_ptr<const std::string> m_payload;
+		std::uint64_t m_at; // position in the owned byte stream this payload goes in front of
+		std::size_t m_offset; // bytes of the payload already consumed
+	};
+
+	ss::net::circbuff m_owned;
+	std::uint64_t m_owned_head; // stream position of the first byte in m_owned
+	std::deque<attachment> m_attachments;
+	std::size_t m_size;
+};
+
+} // namespace net
+} // namespace ss
+
+#endif // OUT_QUEUE_H
@@ -3,6 +3,8 @@
 namespace ss {
 namespace net {
 
+const char *server_base::HANDOFF_ENV = "SS_SERVER_HANDOFF_FD";
+
 server_base::server_base(const std::string& a_category)
 : ss::net::auth(ss::net::auth::role::SERVER)
 , ss::esr()
@@ -10,6 +12,10 @@ server_base::server_base(const std::string& a_category)
 , m_category(a_category)
 , m_request_down(false)
 , m_request_hup(false)
+, m_request_upgrade(false)
+, m_request_seq(0)
+, m_server_sockfd(-1)
+, m_server_sockfd_un(-1)
 {
 	ctx.log("server_base starting up..");
 	ss::icr& l_icr = ss::icr::get();
@@ -19,7 +25,7 @@ server_base::server_base(const std::string& a_category)
 		throw std::runtime_error("server_base: key <auth_policy> must be defined in ini file, exiting!");
 	}
 	m_auth_policy = l_icr.to_integer(l_icr.keyvalue(m_category, "auth_policy"));
-	ctx.log_p(ss::log::INFO, std::format("authorization policy: {}", m_auth_policy));
+	ctx.log_p(ss::log::INFO, std::format("authorization policy: {}", m_auth_policy.load()));
 	
 	if (!l_icr.key_is_defined(m_category, "port")) {
 		ctx.log_p(ss::log::NOTICE, "key <port> must be defined in ini file, exiting!");
@@ -46,203 +52,1354 @@ server_base::server_base(const std::string& a_category)
 		throw std::runtime_error("server_base: one or both of the available listening methods must be enabled, exiting!");
 	}
 	
-	// init epoll
-	if ((m_epollfd = epoll_create(50)) == -1) {
-		ctx.log_p(ss::log::NOTICE, std::format("unable to initialize epoll, errno = {} ({}), exiting!", errno, strerror(errno)));
-		throw std::runtime_error("server_base: unable to initialize epoll, exiting!");
+	// reactors (optional, defaults to a single epoll loop)
+	m_reactor_count = 1;
+	if (l_icr.key_is_defined(m_category, "reactors"))
+		m_reactor_count = l_icr.to_integer(l_icr.keyvalue(m_category, "reactors"));
+	if ((m_reactor_count > 64) || (m_reactor_count == 0)) {
+		ctx.log_p(ss::log::NOTICE, "key <reactors> can be set to a maximum of 64 and may not be zero, exiting!");
+		throw std::runtime_error("server_base: key <reactors> can be set to a maximum of 64 and may not be zero, exiting!");
+	}
+	m_next_reactor = 0;
+	m_next_serial = 1;
+	ctx.log_p(ss::log::INFO, std::format("reactors: {}", m_reactor_count));
+	
+	// I/O backend (optional, defaults to epoll)
+	m_io_backend = IO_BACKEND_EPOLL;
+	if (l_icr.key_is_defined(m_category, "io_backend")) {
+		std::string l_backend = l_icr.keyvalue(m_category, "io_backend");
+		if (l_backend == "io_uring") {
+			m_io_backend = IO_BACKEND_URING;
+		} else if (l_backend != "epoll") {
+			ctx.log_p(ss::log::NOTICE, std::format("key <io_backend> must be either epoll or io_uring, not {}, exiting!", l_backend));
+			throw std::runtime_error("server_base: key <io_backend> must be either epoll or io_uring, exiting!");
+		}
 	}
-	ctx.log(std::format("initialized epoll, fd = {}", m_epollfd));
+	if (m_io_backend == IO_BACKEND_URING) {
+		// asked for, but the kernel (or a seccomp policy) may not be up to it
+		std::string l_reason;
+		if (!ss::net::uring::probe(l_reason)) {
+			ctx.log_p(ss::log::NOTICE, std::format("io_uring backend unavailable ({}), falling back to epoll", l_reason));
+			m_io_backend = IO_BACKEND_EPOLL;
+		}
+	}
+	ctx.log_p(ss::log::INFO, std::format("I/O backend: {}", (m_io_backend == IO_BACKEND_URING) ? "io_uring" : "epoll"));
+	
+	// connection timeouts in seconds (optional, 0 or absent disables them)
+	auto l_timeout = [&](const std::string& a_key) -> std::uint64_t {
+		if (!l_icr.key_is_defined(m_category, a_key))
+			return 0;
+		int l_seconds = l_icr.to_integer(l_icr.keyvalue(m_category, a_key));
+		if (l_seconds < 0) {
+			ctx.log_p(ss::log::NOTICE, std::format("key <{}> may not be negative, exiting!", a_key));
+			throw std::runtime_error(std::format("server_base: key <{}> may not be negative, exiting!", a_key));
+		}
+		ctx.log_p(ss::log::INFO, std::format("{}: {} seconds", a_key, l_seconds));
+		return std::uint64_t(l_seconds) * 1000 / TIMER_TICK_MS;
+	};
+	m_login_timeout = l_timeout("login_timeout");
+	m_idle_timeout = l_timeout("idle_timeout");
+	m_stall_timeout = l_timeout("output_stall_timeout");
+	m_linger_timeout = l_icr.key_is_defined(m_category, "linger_timeout") ? l_timeout("linger_timeout") : DEFAULT_LINGER_MS / TIMER_TICK_MS;
+	if (m_linger_timeout == 0)
+		m_linger_timeout = 1;
 	
-	// init the server
-	if (l_enable_tcp) {
-		ctx.log_p(ss::log::INFO, "starting TCP server..");
-		setup_server_tcp();
+	// output backpressure in bytes (optional, 0 or absent disables each of them)
+	auto l_unsigned = [&](const std::string& a_key, std::size_t a_default) -> std::size_t {
+		if (!l_icr.key_is_defined(m_category, a_key))
+			return a_default;
+		int l_value = l_icr.to_integer(l_icr.keyvalue(m_category, a_key));
+		if (l_value < 0) {
+			ctx.log_p(ss::log::NOTICE, std::format("key <{}> may not be negative, exiting!", a_key));
+			throw std::runtime_error(std::format("server_base: key <{}> may not be negative, exiting!", a_key));
+		}
+		return l_value;
+	};
+	m_out_high = l_unsigned("output_high_water", 0);
+	m_out_low = l_unsigned("output_low_water", m_out_high / 4);
+	m_global_high = l_unsigned("output_global_high_water", 0);
+	m_global_low = l_unsigned("output_global_low_water", m_global_high / 2);
+	m_out_hard_cap = l_unsigned("output_hard_cap", 0);
+	if ((m_out_low > m_out_high) || (m_global_low > m_global_high)) {
+		ctx.log_p(ss::log::NOTICE, "output low water marks may not be above their high water marks, exiting!");
+		throw std::runtime_error("server_base: output low water marks may not be above their high water marks, exiting!");
+	}
+	m_cap_policy = CAP_POLICY_DROP;
+	if (l_icr.key_is_defined(m_category, "output_cap_policy")) {
+		std::string l_policy = l_icr.keyvalue(m_category, "output_cap_policy");
+		if (l_policy == "disconnect") {
+			m_cap_policy = CAP_POLICY_DISCONNECT;
+		} else if (l_policy != "drop") {
+			ctx.log_p(ss::log::NOTICE, std::format("key <output_cap_policy> must be either drop or disconnect, not {}, exiting!", l_policy));
+			throw std::runtime_error("server_base: key <output_cap_policy> must be either drop or disconnect, exiting!");
+		}
 	}
+	m_pause_commands = false;
+	if (l_icr.key_is_defined(m_category, "pause_commands"))
+		m_pause_commands = l_icr.to_boolean(l_icr.keyvalue(m_category, "pause_commands"));
+	m_out_total = 0;
+	m_global_pressure = false;
+	ctx.log_p(ss::log::INFO, std::format("output water marks: {}/{} per client, {}/{} global, hard cap {} ({}){}", m_out_high, m_out_low, m_global_high, m_global_low, m_out_hard_cap, (m_cap_policy == CAP_POLICY_DROP) ? "drop" : "disconnect", m_pause_commands ? ", commands paused with input" : ""));
 	
-	if (l_enable_unix) {
-		ctx.log_p(ss::log::INFO, "starting UNIX socket server..");
-		setup_server_un();
+	// input in bytes (optional, 0 is unlimited): a client whose line grows past this is disconnected
+	m_in_max = l_unsigned("input_max", DEFAULT_INPUT_MAX);
+	ctx.log_p(ss::log::INFO, std::format("input cap: {} bytes per client", m_in_max));
+	
+	// listening sockets (optional, all default to the kernel's own settings except the backlog)
+	auto l_boolean = [&](const std::string& a_key) -> bool {
+		return l_icr.key_is_defined(m_category, a_key) && l_icr.to_boolean(l_icr.keyvalue(m_category, a_key));
+	};
+	m_listen_backlog = l_unsigned("listen_backlog", SOMAXCONN);
+	m_tcp_nodelay = l_boolean("tcp_nodelay");
+	m_tcp_defer_accept = l_unsigned("tcp_defer_accept", 0);
+	m_socket_sndbuf = l_unsigned("socket_sndbuf", 0);
+	m_socket_rcvbuf = l_unsigned("socket_rcvbuf", 0);
+	m_tcp_keepalive = l_boolean("tcp_keepalive");
+	m_tcp_keepidle = l_unsigned("tcp_keepidle", 0);
+	m_tcp_keepintvl = l_unsigned("tcp_keepintvl", 0);
+	m_tcp_keepcnt = l_unsigned("tcp_keepcnt", 0);
+	ctx.log_p(ss::log::INFO, std::format("listen backlog: {}", m_listen_backlog));
+	
+	// admission control per source address for TCP clients (optional, disabled unless a rate or a cap is set)
+	std::uint32_t l_admission_rate = l_unsigned("admission_rate", 0);
+	std::uint32_t l_admission_max = l_unsigned("admission_max_connections", 0);
+	if ((l_admission_rate != 0) || (l_admission_max != 0)) {
+		std::uint32_t l_burst = l_unsigned("admission_burst", l_admission_rate);
+		if ((l_burst > ss::net::admission::MAX_BURST) || (l_admission_max > ss::net::admission::MAX_CONNECTIONS)) {
+			ctx.log_p(ss::log::NOTICE, std::format("keys <admission_burst> and <admission_max_connections> can be set to a maximum of {} and {}, exiting!", ss::net::admission::MAX_BURST, ss::net::admission::MAX_CONNECTIONS));
+			throw std::runtime_error("server_base: keys <admission_burst> and <admission_max_connections> out of range, exiting!");
+		}
+		m_admission = std::make_unique<ss::net::admission>(l_unsigned("admission_table_size", 16384), l_admission_rate, l_burst, l_admission_max);
+		ctx.log_p(ss::log::INFO, std::format("admission control: {} connections/sec (burst {}), {} concurrent per address, {} addresses tracked", l_admission_rate, l_burst, l_admission_max, m_admission->slots()));
+	}
+	
+	// zero downtime upgrades (optional, by default only the listeners are handed over and the
+	// old server waits a minute at most for its clients to leave)
+	m_upgrade_connections = l_boolean("upgrade_connections");
+	m_upgrade_drain_timeout = l_unsigned("upgrade_drain_timeout", 60);
+	std::error_code l_ec;
+	m_exe_path = std::filesystem::read_symlink("/proc/self/exe", l_ec).string();
+	if (l_ec)
+		ctx.log_p(ss::log::WARNING, std::format("unable to find our own binary ({}), upgrades are disabled", l_ec.message()));
+	else
+		ctx.log_p(ss::log::INFO, std::format("upgrades: run {}, {}, drain for {} seconds", m_exe_path, m_upgrade_connections ? "clients handed over" : "listeners only", m_upgrade_drain_timeout));
+	
+	if ((m_drain_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+		ctx.log_p(ss::log::NOTICE, std::format("unable to create eventfd, errno = {} ({}), exiting!", errno, strerror(errno)));
+		throw std::runtime_error("server_base: unable to create eventfd, exiting!");
+	}
+	
+	// init the reactors: a wakeup eventfd each, plus an epoll instance or an io_uring
+	for (unsigned int i = 0; i < m_reactor_count; ++i) {
+		m_reactors.push_back(std::make_unique<reactor>());
+		reactor& l_reactor = *m_reactors.back();
+		l_reactor.m_index = i;
+		l_reactor.m_epollfd = -1;
+		l_reactor.m_halting = false;
+		if ((l_reactor.m_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+			ctx.log_p(ss::log::NOTICE, std::format("unable to create eventfd, errno = {} ({}), exiting!", errno, strerror(errno)));
+			throw std::runtime_error("server_base: unable to create eventfd, exiting!");
+		}
+		if (m_io_backend == IO_BACKEND_URING) {
+			uring_setup(l_reactor);
+			ctx.log(std::format("initialized io_uring for reactor {}", i));
+			continue;
+		}
+		if ((l_reactor.m_epollfd = epoll_create(50)) == -1) {
+			ctx.log_p(ss::log::NOTICE, std::format("unable to initialize epoll, errno = {} ({}), exiting!", errno, strerror(errno)));
+			throw std::runtime_error("server_base: unable to initialize epoll, exiting!");
+		}
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.fd = l_reactor.m_wakefd;
+		epoll_ctl(l_reactor.m_epollfd, EPOLL_CTL_ADD, l_reactor.m_wakefd, &ev);
+		ctx.log(std::format("initialized epoll for reactor {}, fd = {}", i, l_reactor.m_epollfd));
+	}
+	
+	// init the server, or take over the listeners of the server we've been started to replace
+	int l_stats_fd = -1;
+	const char *l_handoff = getenv(HANDOFF_ENV);
+	if (l_handoff != nullptr) {
+		m_handoff = std::make_unique<ss::net::fd_handoff>(atoi(l_handoff));
+		unsetenv(HANDOFF_ENV); // not for anything we start in turn
+		ctx.log_p(ss::log::INFO, "taking over from the server we're replacing..");
+		l_stats_fd = adopt_listeners();
+	} else {
+		if (l_enable_tcp) {
+			ctx.log_p(ss::log::INFO, "starting TCP server..");
+			setup_server_tcp();
+		}
+		
+		if (l_enable_unix) {
+			ctx.log_p(ss::log::INFO, "starting UNIX socket server..");
+			setup_server_un();
+		}
 	}
 	
+	// statistics scrape listener (optional, disabled unless a port is given)
+	int l_stats_port = l_unsigned("stats_port", 0);
+	if (l_stats_fd != -1) {
+		m_stats_listener = std::make_unique<ss::net::stats_listener>(m_category + "_stats", l_stats_fd, [this]() {
+			return stats_exposition();
+		});
+	} else if (l_stats_port != 0) {
+		std::string l_stats_address = "127.0.0.1";
+		if (l_icr.key_is_defined(m_category, "stats_address"))
+			l_stats_address = l_icr.keyvalue(m_category, "stats_address");
+		m_stats_listener = std::make_unique<ss::net::stats_listener>(m_category + "_stats", l_stats_address, l_stats_port, [this]() {
+			return stats_exposition();
+		});
+	}
+	
+	m_last_publish.now();
+	m_last_accepts = 0;
+	for (unsigned int i = 1; i < m_reactor_count; ++i) {
+		m_reactor_threads.push_back(std::make_unique<reactor_thread>(*this, i));
+		m_reactor_threads.back()->start();
+	}
 	start();
 	m_uptime.now();
+	if (m_stats_listener)
+		m_stats_listener->start();
 	ctx.log_p(ss::log::INFO, "server UP");
 }
 
 server_base::~server_base()
 {
-	
+	if (m_drain_wakefd != -1)
+		close(m_drain_wakefd);
+}
+
+bool server_base::reload()
+{
+	// cleared first, so a HUP that comes in while we're at it isn't lost
+	m_request_hup = false;
+	ctx.log("server_base reloading configuration..");
+	ss::icr& l_icr = ss::icr::get();
+	if (!l_icr.key_is_defined(m_category, "auth_policy")) {
+		ctx.log_p(ss::log::NOTICE, std::format("key <auth_policy> must be defined in ini file, keeping authorization policy {}", m_auth_policy.load()));
+		return false;
+	}
+	m_auth_policy = l_icr.to_integer(l_icr.keyvalue(m_category, "auth_policy"));
+	ctx.log_p(ss::log::INFO, std::format("authorization policy: {}", m_auth_policy.load()));
+	return true;
 }
 
 void server_base::shutdown()
 {
 	ctx.log("Shutting down server_base subsystem..");
+	if (m_stats_listener)
+		m_stats_listener->halt();
+	// reactors sleep until there's I/O, so stop them blocking and kick them before halting
+	for (auto& i : m_reactors) {
+		i->m_halting = true;
+		wake(*i);
+	}
 	halt();
-	close(m_epollfd);
-	close(m_server_sockfd);
-	close(m_server_sockfd_un);
+	for (auto& i : m_reactor_threads)
+		i->halt();
+	for (auto& i : m_reactors) {
+		if (i->m_epollfd != -1)
+			close(i->m_epollfd);
+		close(i->m_wakefd);
+		i->m_ring.reset();
+	}
+	if (m_server_sockfd != -1)
+		close(m_server_sockfd);
+	if (m_server_sockfd_un != -1)
+		close(m_server_sockfd_un);
 	// kick off remaining clients
-	m_client_list_mtx.lock();
-	for (auto& [key, value] : m_client_list)
-		close(key);
-	m_client_list_mtx.unlock();
+	m_clients.for_each([](int a_fd, client_rec& a_rec) {
+		close(a_fd);
+	});
+	std::unique_lock<std::mutex> l_publish_lock(m_publish_mtx);
+	publish_stats();
+	l_publish_lock.unlock();
+	std::uint64_t l_wakeups = m_io_stats.m_read_wakeups;
+	std::uint64_t l_bytes = m_io_stats.m_read_bytes;
+	std::uint64_t l_copied = m_io_stats.m_copied_bytes;
+	ctx.log(std::format("input: {} bytes in {} wakeups ({} bytes/wakeup, {} copies/byte)", l_bytes, l_wakeups, (l_wakeups > 0) ? double(l_bytes) / l_wakeups : 0.0, (l_bytes > 0) ? double(l_copied) / l_bytes : 0.0));
 	ctx.log(std::format("server DOWN (up for {} seconds)", ss::doubletime::now_as_double() - double(m_uptime)));
 }
 
+server_base::reactor_thread::reactor_thread(server_base& a_server, unsigned int a_index)
+: ss::ccl::dispatchable(std::format("{}_reactor{}", a_server.m_category, a_index))
+, m_server(a_server)
+, m_index(a_index)
+{
+	
+}
+
+server_base::reactor_thread::~reactor_thread()
+{
+	
+}
+
+bool server_base::reactor_thread::dispatch()
+{
+	return m_server.run_reactor(*m_server.m_reactors[m_index]);
+}
+
 bool server_base::dispatch()
 {
-	struct epoll_event events[100];
-	int n = epoll_wait(m_epollfd, events, 100, 20);
-	if (n == 0) {
-		// housekeeping tasks while waiting for data go here
-		return true;
+	// our own thread drives reactor 0
+	return run_reactor(*m_reactors[0]);
+}
+
+bool server_base::run_reactor(reactor& a_reactor)
+{
+	if (m_io_backend == IO_BACKEND_URING)
+		return run_reactor_uring(a_reactor);
+	return run_reactor_epoll(a_reactor);
+}
+
+void server_base::post(unsigned int a_reactor, std::function<void()> a_task)
+{
+	// queue a task to run on a reactor's own thread. Only the post that finds the mailbox
+	// empty needs to wake the reactor, later ones ride along with that wakeup.
+	reactor& l_reactor = *m_reactors[a_reactor];
+	bool l_wake;
+	{
+		std::lock_guard<std::mutex> l_guard(l_reactor.m_mailbox_mtx);
+		l_wake = l_reactor.m_mailbox.empty();
+		l_reactor.m_mailbox.push_back(std::move(a_task));
+	}
+	if (l_wake)
+		wake(l_reactor);
+}
+
+void server_base::wake(reactor& a_reactor)
+{
+	std::uint64_t l_one = 1;
+	write(a_reactor.m_wakefd, &l_one, sizeof(l_one));
+}
+
+void server_base::run_mailbox(reactor& a_reactor)
+{
+	std::vector<std::function<void()>> l_tasks;
+	{
+		std::lock_guard<std::mutex> l_guard(a_reactor.m_mailbox_mtx);
+		l_tasks.swap(a_reactor.m_mailbox);
 	}
+	for (auto& l_task : l_tasks)
+		l_task();
+}
+
+bool server_base::run_reactor_epoll(reactor& a_reactor)
+{
+	// sleep until the next timer is due, anything else that needs the reactor's attention
+	// wakes it through its eventfd
+	struct epoll_event events[100];
+	bool l_carry = !a_reactor.m_drain_hints.empty();
+	int n = epoll_wait(a_reactor.m_epollfd, events, 100, (a_reactor.m_halting || l_carry) ? 0 : a_reactor.m_timers.timeout_ms());
 	bool l_did_input = false;
+	bool l_woken = false;
+	// clients whose read budget ran out last time get their turn alongside the new events
+	std::map<int, std::uint32_t> l_carried;
+	l_carried.swap(a_reactor.m_drain_hints);
 	while (n-- > 0) {
+		int client_sockfd = events[n].data.fd;
+		if (client_sockfd == a_reactor.m_wakefd) {
+			read(a_reactor.m_wakefd, &a_reactor.m_wake_buf, sizeof(a_reactor.m_wake_buf));
+			l_woken = true;
+			continue;
+		}
+		if ((client_sockfd == m_server_sockfd) || (client_sockfd == m_server_sockfd_un)) {
+			if (events[n].events & EPOLLIN)
+				accept_clients(client_sockfd);
+			continue;
+		}
+		// client sockets are edge triggered, so one event can carry both EPOLLIN and EPOLLOUT
+		// and neither edge will be reported again - service everything it carries.
 		if (events[n].events & EPOLLIN) {
-			if ((events[n].data.fd == m_server_sockfd) || (events[n].data.fd == m_server_sockfd_un)) {
-				// accept connection
-				int l_client = accept_client(events[n].data.fd);
-				if (l_client == -1) {
-					ctx.log_p(ss::log::ERR, std::format("error accepting client at: {}", ss::doubletime::now_as_iso8601_ms()));
-					continue;
-				} else {
-					// client accepted successfully
-//					ctx.log_p(ss::log::INFO, std::format("accepted client at: {} on fd {}", ss::doubletime::now_as_iso8601_ms(), l_client));
-					newly_accepted_client(l_client);
-				}
-			} else {
-				// EPOLLIN on a client socket
-				int client_sockfd = events[n].data.fd;
-//				std::cout << "EPOLLIN on " << client_sockfd << std::endl;
-				drain_socket(client_sockfd);
-				l_did_input = true;
-			}
-		} else if (events[n].events & EPOLLHUP) {
-			int client_sockfd = events[n].data.fd;
+//			std::cout << "EPOLLIN on " << client_sockfd << std::endl;
+			l_carried.erase(client_sockfd);
+			if (!drain_socket(client_sockfd))
+				continue; // EOF or error, client has been removed
+			l_did_input = true;
+		} else if (events[n].events & (EPOLLHUP | EPOLLERR)) {
 //			std::cout << "EPOLLHUP on " << client_sockfd << std::endl;
 			// had a client hang up, so remove its connection
 			remove_client(client_sockfd);
-		} else if (events[n].events & EPOLLOUT) {
+			continue;
+		}
+		if (events[n].events & EPOLLOUT) {
 			// EPOLLOUT on a client socket
-			flushout(events[n].data.fd);
+			flushout(client_sockfd);
 		}
 	}
+	for (auto& [l_fd, l_serial] : l_carried)
+		if (drain_socket(l_fd, l_serial))
+			l_did_input = true;
 	if (l_did_input)
-		serve();
+		serve(a_reactor);
+	if (l_woken)
+		run_mailbox(a_reactor);
+	run_timers(a_reactor);
+	housekeeping();
 
 	return true;
 }
 
-void server_base::flushout(int client_sockfd)
+std::uint64_t server_base::uring_data(uring_op a_op, int a_fd, std::uint32_t a_serial)
 {
-	std::lock_guard<std::mutex> l_guard(m_client_list_mtx);
-	// find our client record
-	std::map<int, client_rec>::iterator l_client_list_it = m_client_list.find(client_sockfd);
-	int l_datalen = l_client_list_it->second.m_out_circbuff.size();
-	// write in chunks
-	int l_towrite = (l_datalen >(int)WRITE_CHUNK_SIZE) ? WRITE_CHUNK_SIZE : l_datalen;
-	int l_ret = write(client_sockfd, l_client_list_it->second.m_out_circbuff.buffer(), l_towrite);
-	if (l_ret < 0) {
-		// error
-		ctx.log_p(ss::log::WARNING, std::format("possible error writing to fd: {} - {}", client_sockfd, strerror(errno)));
+	return (std::uint64_t(a_op) << 56) | (std::uint64_t(a_serial & 0xffffff) << 32) | std::uint32_t(a_fd);
+}
+
+void server_base::uring_setup(reactor& a_reactor)
+{
+	try {
+		a_reactor.m_ring.reset(new ss::net::uring(URING_ENTRIES));
+	} catch (std::exception& e) {
+		ctx.log_p(ss::log::NOTICE, std::format("unable to initialize io_uring: {}, exiting!", e.what()));
+		throw std::runtime_error("server_base: unable to initialize io_uring, exiting!");
+	}
+	// hand the kernel a pool of receive buffers, multishot receives pick from it as data arrives
+	a_reactor.m_ring_buffers = std::make_unique<std::uint8_t[]>(URING_BUFFERS * URING_BUFFER_SIZE);
+	a_reactor.m_ring->prep_provide_buffers(a_reactor.m_ring_buffers.get(), URING_BUFFER_SIZE, URING_BUFFERS, URING_BUFFER_GROUP, 0, uring_data(URING_OP_PROVIDE, -1, 0));
+	uring_arm_wake(a_reactor);
+	a_reactor.m_ring->submit();
+}
+
+void server_base::uring_arm_accept(int a_server_fd)
+{
+	// listeners belong to reactor 0, one multishot accept keeps delivering connections
+	m_reactors[0]->m_ring->prep_accept_multishot(a_server_fd, SOCK_NONBLOCK | SOCK_CLOEXEC, uring_data(URING_OP_ACCEPT, a_server_fd, 0));
+}
+
+void server_base::uring_arm_recv(reactor& a_reactor, int client_sockfd, std::uint32_t a_serial)
+{
+	a_reactor.m_ring->prep_recv_multishot(client_sockfd, URING_BUFFER_GROUP, uring_data(URING_OP_RECV, client_sockfd, a_serial));
+}
+
+void server_base::uring_arm_wake(reactor& a_reactor)
+{
+	a_reactor.m_ring->prep_read(a_reactor.m_wakefd, &a_reactor.m_wake_buf, sizeof(a_reactor.m_wake_buf), uring_data(URING_OP_WAKE, a_reactor.m_wakefd, 0));
+}
+
+bool server_base::run_reactor_uring(reactor& a_reactor)
+{
+	// submits everything prepared since the last pass (sends, re-armed receives, recycled
+	// buffers) and reaps completions in the same system call
+	bool l_retry = !a_reactor.m_send_retries.empty();
+	int l_ret = a_reactor.m_ring->submit_and_wait(1, (a_reactor.m_halting || l_retry) ? 0 : a_reactor.m_timers.timeout_ms());
+	if ((l_ret < 0) && (l_ret != -EBUSY))
+		ctx.log_p(ss::log::WARNING, std::format("io_uring_enter failed on reactor {}: {}", a_reactor.m_index, strerror(-l_ret)));
+	struct io_uring_cqe *l_cqes[256];
+	unsigned int n = a_reactor.m_ring->peek_cqes(l_cqes, 256);
+	bool l_did_input = false;
+	bool l_woken = false;
+	for (unsigned int i = 0; i < n; ++i) {
+		if ((l_cqes[i]->user_data >> 56) == URING_OP_WAKE)
+			l_woken = true;
+		uring_completion(a_reactor, l_cqes[i], l_did_input);
+	}
+	if (n > 0)
+		a_reactor.m_ring->cq_advance(n);
+	if (l_retry) {
+		// sends that found the submission queue full last time
+		std::map<int, std::uint32_t> l_retries;
+		l_retries.swap(a_reactor.m_send_retries);
+		for (auto& [l_fd, l_serial] : l_retries)
+			uring_send(a_reactor, l_fd, l_serial);
+	}
+	if (l_did_input)
+		serve(a_reactor);
+	if (l_woken)
+		run_mailbox(a_reactor);
+	run_timers(a_reactor);
+	housekeeping();
+
+	return true;
+}
+
+void server_base::uring_completion(reactor& a_reactor, struct io_uring_cqe *a_cqe, bool& a_did_input)
+{
+	uring_op l_op = uring_op(a_cqe->user_data >> 56);
+	std::uint32_t l_serial = (a_cqe->user_data >> 32) & 0xffffff;
+	int l_fd = int(a_cqe->user_data & 0xffffffff);
+	int l_res = a_cqe->res;
+	bool l_more = (a_cqe->flags & IORING_CQE_F_MORE);
+	switch (l_op) {
+		case URING_OP_ACCEPT:
+			if (l_res >= 0) {
+				struct sockaddr_storage l_addr;
+				socklen_t l_len = sizeof(l_addr);
+				memset(&l_addr, 0, sizeof(l_addr));
+				getpeername(l_res, (struct sockaddr *)&l_addr, &l_len);
+				l_addr.ss_family = (l_fd == m_server_sockfd_un) ? AF_UNIX : AF_INET;
+				m_io_stats.m_accepts.fetch_add(1, std::memory_order_relaxed);
+				int l_slot;
+				if (admit_client(l_res, (struct sockaddr *)&l_addr, l_slot))
+					register_client(l_res, (struct sockaddr *)&l_addr, l_slot);
+			} else if (accept_exhausted(-l_res)) {
+				// the back-off re-arms the multishot accept, this one goes if it hasn't ended already
+				if (l_more)
+					a_reactor.m_ring->prep_cancel(uring_data(URING_OP_ACCEPT, l_fd, 0), uring_data(URING_OP_CANCEL, l_fd, 0));
+				pause_accepting(l_fd, -l_res);
+				break;
+			} else if (l_res != -ECANCELED) {
+				ctx.log_p(ss::log::ERR, std::format("error accepting client at: {} ({})", ss::doubletime::now_as_iso8601_ms(), strerror(-l_res)));
+			}
+			if (!l_more && (l_res != -ECANCELED))
+				uring_arm_accept(l_fd);
+			break;
+		case URING_OP_RECV: {
+			// whatever happens, a provided buffer that was used goes straight back to the pool
+			if (a_cqe->flags & IORING_CQE_F_BUFFER) {
+				std::uint16_t l_bid = a_cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+				std::uint8_t *l_buf = a_reactor.m_ring_buffers.get() + std::size_t(l_bid) * URING_BUFFER_SIZE;
+				client_rec *l_client = m_clients.acquire(l_fd);
+				if (l_client != nullptr) {
+					if ((l_client->m_serial == l_serial) && (l_res > 0)) {
+						l_client->m_in_circbuff.write(l_buf, l_res);
+						l_client->m_last_input = a_reactor.m_timers.now();
+						l_client->m_input_ns = ss::net::histogram::now_ns();
+						a_reactor.m_input_hints.insert(l_fd);
+						a_did_input = true;
+					}
+					m_clients.release(l_fd);
+				}
+				a_reactor.m_ring->prep_provide_buffers(l_buf, URING_BUFFER_SIZE, 1, URING_BUFFER_GROUP, l_bid, uring_data(URING_OP_PROVIDE, -1, 0));
+			}
+			if (l_res > 0) {
+				m_io_stats.m_read_wakeups.fetch_add(1, std::memory_order_relaxed);
+				m_io_stats.m_read_calls.fetch_add(1, std::memory_order_relaxed);
+				m_io_stats.m_read_bytes.fetch_add(l_res, std::memory_order_relaxed);
+				m_io_stats.m_copied_bytes.fetch_add(l_res, std::memory_order_relaxed);
+			}
+			if ((l_res == 0) || ((l_res < 0) && (l_res != -ENOBUFS) && (l_res != -ECANCELED))) {
+				// EOF or error
+				remove_client(l_fd, l_serial);
+			} else if (!l_more) {
+				// the kernel ended the multishot receive: it ran out of buffers, or it was cancelled
+				// because the client is gone or has too much output queued. Re-arm it unless so.
+				client_rec *l_client = m_clients.acquire(l_fd);
+				if (l_client != nullptr) {
+					if (l_client->m_serial == l_serial) {
+						l_client->m_recv_armed = !l_client->m_read_paused;
+						if (l_client->m_recv_armed)
+							uring_arm_recv(a_reactor, l_fd, l_serial);
+					}
+					m_clients.release(l_fd);
+				}
+			}
+			break;
+		}
+		case URING_OP_SEND: {
+			// the send's snapshot of the output queue can go now the kernel is done with it
+			a_reactor.m_sends.erase(a_cqe->user_data);
+			if (l_res == -ECANCELED)
+				break;
+			client_rec *l_client = m_clients.acquire(l_fd);
+			if (l_client == nullptr)
+				break;
+			if (l_client->m_serial != l_serial) {
+				m_clients.release(l_fd);
+				break;
+			}
+			if (l_res < 0) {
+				m_clients.release(l_fd);
+				ctx.log_p(ss::log::WARNING, std::format("possible error writing to fd: {} - {}", l_fd, strerror(-l_res)));
+				remove_client(l_fd, l_serial);
+				break;
+			}
+			l_client->m_out_queue.consume(l_res);
+			m_io_stats.m_write_wakeups.fetch_add(1, std::memory_order_relaxed);
+			m_io_stats.m_write_bytes.fetch_add(l_res, std::memory_order_relaxed);
+			track_output_stall(l_fd, *l_client, l_res > 0);
+			account_output(l_fd, *l_client);
+			bool l_pending = !l_client->m_out_queue.empty();
+			if (!l_pending) {
+				l_client->m_send_posted = false;
+				linger_drained(l_fd, *l_client);
+			}
+			m_clients.release(l_fd);
+			if (l_pending)
+				uring_send(a_reactor, l_fd, l_serial);
+			break;
+		}
+		case URING_OP_WAKE:
+			uring_arm_wake(a_reactor);
+			break;
+		case URING_OP_PROVIDE:
+			if (l_res < 0)
+				ctx.log_p(ss::log::ERR, std::format("unable to provide receive buffers on reactor {}: {}", a_reactor.m_index, strerror(-l_res)));
+			break;
+		case URING_OP_CANCEL:
+			break;
+	}
+}
+
+void server_base::uring_send(reactor& a_reactor, int client_sockfd, std::uint32_t a_serial)
+{
+	// one send in flight per client. It works from a snapshot of the head of the output queue,
+	// so workers can keep appending while the kernel has it; the completion consumes what went.
+	client_rec *l_client = m_clients.acquire(client_sockfd);
+	if (l_client == nullptr)
 		return;
-	} else if (l_ret == 0) {
-		// EOF
-		ctx.log(std::format("possible EOF writing to fd: {}", client_sockfd));
+	if (l_client->m_serial != a_serial) {
+		m_clients.release(client_sockfd);
 		return;
-	} else if (l_ret < l_towrite) {
-		// partial write... (why?)
-		ctx.log(std::format("wrote {} bytes to fd: {}, expected to write {}", l_ret, client_sockfd, l_towrite));
-	} else if (l_ret == l_towrite) {
-		// all bytes written
 	}
+	if (l_client->m_out_queue.empty()) {
+		l_client->m_send_posted = false;
+		m_clients.release(client_sockfd);
+		return;
+	}
+	std::unique_ptr<send_op> l_op = std::make_unique<send_op>();
+	l_op->m_iov.resize(WRITEV_MAX_SEGMENTS);
+	int l_cnt = l_client->m_out_queue.gather_pinned(l_op->m_iov.data(), WRITEV_MAX_SEGMENTS, l_op->m_copy, l_op->m_refs);
+	memset(&l_op->m_msg, 0, sizeof(l_op->m_msg));
+	l_op->m_msg.msg_iov = l_op->m_iov.data();
+	l_op->m_msg.msg_iovlen = l_cnt;
+	std::uint64_t l_data = uring_data(URING_OP_SEND, client_sockfd, a_serial);
+	bool l_ok = a_reactor.m_ring->prep_sendmsg(client_sockfd, &l_op->m_msg, MSG_NOSIGNAL, l_data);
+	if (l_ok) {
+		a_reactor.m_sends[l_data] = std::move(l_op);
+		m_io_stats.m_write_calls.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		// the kernel wouldn't take even a flushed queue (its completions are backed up), so
+		// try again on the next pass, once those have been reaped. The send stays posted.
+		a_reactor.m_send_retries[client_sockfd] = a_serial;
+		m_io_stats.m_sq_full.fetch_add(1, std::memory_order_relaxed);
+	}
+	m_clients.release(client_sockfd);
+}
 
-	l_client_list_it->second.m_out_circbuff.truncate_front(l_ret);
+void server_base::flushout(int client_sockfd)
+{
+	// EPOLLOUT: the kernel has room again for a client whose send buffer filled up
+	m_io_stats.m_write_wakeups.fetch_add(1, std::memory_order_relaxed);
+	// find our client record
+	client_rec *l_client = m_clients.acquire(client_sockfd);
+	if (l_client == nullptr)
+		return; // client went away while the event was in flight
+	bool l_ok = flush_client(client_sockfd, *l_client);
+	m_clients.release(client_sockfd);
+	if (!l_ok)
+		remove_client(client_sockfd);
+}
 
-	if (l_client_list_it->second.m_out_circbuff.size() == 0) {
+bool server_base::flush_client(int client_sockfd, client_rec& a_rec)
+{
+	// caller holds the client's shard of the table
+	if (m_io_backend == IO_BACKEND_URING) {
+		// the owning reactor issues sends through its ring, one in flight per client. Ask it
+		// for one unless it's already got one going, which will pick up this output as well.
+		if (!a_rec.m_out_queue.empty() && !a_rec.m_send_posted) {
+			a_rec.m_send_posted = true;
+			unsigned int l_reactor = a_rec.m_reactor;
+			std::uint32_t l_serial = a_rec.m_serial;
+			post(l_reactor, [this, l_reactor, client_sockfd, l_serial]() {
+				uring_send(*m_reactors[l_reactor], client_sockfd, l_serial);
+			});
+		}
+		track_output_stall(client_sockfd, a_rec, false);
+		account_output(client_sockfd, a_rec);
+		linger_drained(client_sockfd, a_rec);
+		return true;
+	}
+	// Keep handing the kernel everything we have queued,
+	// gathered straight out of the output queue's segments, until it's all gone or the socket
+	// would block. Only in the latter case do we need epoll to tell us when to carry on.
+	std::uint64_t l_calls = 0;
+	std::uint64_t l_bytes = 0;
+	bool l_ok = true;
+	while (!a_rec.m_out_queue.empty()) {
+		struct iovec l_iov[WRITEV_MAX_SEGMENTS];
+		struct msghdr l_msg = {};
+		l_msg.msg_iov = l_iov;
+		l_msg.msg_iovlen = a_rec.m_out_queue.gather(l_iov, WRITEV_MAX_SEGMENTS);
+		ssize_t l_ret = sendmsg(client_sockfd, &l_msg, MSG_NOSIGNAL);
+		++l_calls;
+		if (l_ret > 0) {
+			a_rec.m_out_queue.consume(l_ret);
+			l_bytes += l_ret;
+		} else if ((l_ret < 0) && (errno == EINTR)) {
+			continue;
+		} else if ((l_ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+			// kernel buffer is full
+			if (!a_rec.m_epollout) {
+				set_epollout_for_fd(client_sockfd, a_rec.m_reactor, true);
+				a_rec.m_epollout = true;
+				m_io_stats.m_epollout_arms.fetch_add(1, std::memory_order_relaxed);
+			}
+			break;
+		} else {
+			// error
+			ctx.log_p(ss::log::WARNING, std::format("possible error writing to fd: {} - {}", client_sockfd, strerror(errno)));
+			l_ok = false;
+			break;
+		}
+	}
+	if (a_rec.m_out_queue.empty() && a_rec.m_epollout) {
 		// we emptied it, so clear EPOLLOUT flag for fd
-//		log << ulog::debug << "dispatch: clearing EPOLLOUT for fd:" << client_sockfd << std::endl;
-		struct epoll_event l_client_info;
-		l_client_info.events = EPOLLIN | EPOLLHUP;
-		l_client_info.data.fd = client_sockfd;
-		epoll_ctl(m_epollfd, EPOLL_CTL_MOD, client_sockfd, &l_client_info);
+		set_epollout_for_fd(client_sockfd, a_rec.m_reactor, false);
+		a_rec.m_epollout = false;
 	}
+	track_output_stall(client_sockfd, a_rec, l_bytes > 0);
+	account_output(client_sockfd, a_rec);
+	if (l_ok)
+		linger_drained(client_sockfd, a_rec);
+	m_io_stats.m_write_calls.fetch_add(l_calls, std::memory_order_relaxed);
+	m_io_stats.m_write_bytes.fetch_add(l_bytes, std::memory_order_relaxed);
+	return l_ok;
 }
 
-void server_base::set_epollout_for_fd(int a_fd)
+void server_base::set_epollout_for_fd(int a_fd, unsigned int a_reactor, bool a_enable)
 {
 	struct epoll_event l_client_info;
-	l_client_info.events = EPOLLIN | EPOLLHUP | EPOLLOUT;
+	l_client_info.events = a_enable ? (CLIENT_EPOLL_EVENTS | EPOLLOUT) : CLIENT_EPOLL_EVENTS;
 	l_client_info.data.fd = a_fd;
-	epoll_ctl(m_epollfd, EPOLL_CTL_MOD, a_fd, &l_client_info);
+	epoll_ctl(m_reactors[a_reactor]->m_epollfd, EPOLL_CTL_MOD, a_fd, &l_client_info);
 }
 
-void server_base::serve()
+void server_base::serve(reactor& a_reactor)
 {
 	// iterate input hints set and execute waiting commands for each client
-	std::lock_guard<std::mutex> l_guard(m_client_list_mtx);
-	std::set<int>::iterator l_input_hints_it = m_input_hints.begin();
-	while (l_input_hints_it != m_input_hints.end()) {
+	std::set<int>::iterator l_input_hints_it = a_reactor.m_input_hints.begin();
+	while (l_input_hints_it != a_reactor.m_input_hints.end()) {
 		int l_curfd = (*l_input_hints_it);
-		data_from_client(l_curfd);
+		// a hint can be stale if the client was removed since, so skip those. Commands from a
+		// client that's backed up on output may wait until it has drained, resume_reading() hints it again.
+		client_rec *l_client = m_clients.acquire(l_curfd);
+		if (l_client != nullptr) {
+			bool l_overrun = false;
+			if (l_client->m_linger_until != 0) {
+				l_client->m_in_circbuff.clear(); // closing, we only read on to notice the hangup
+			} else if (!(l_client->m_read_paused && m_pause_commands)) {
+				data_from_client(l_curfd);
+				// whatever is left is a line that hasn't ended yet, and it can't grow for ever
+				l_overrun = (m_in_max != 0) && (l_client->m_in_circbuff.size() > m_in_max);
+			}
+			std::uint32_t l_serial = l_client->m_serial;
+			if (l_overrun) {
+				m_io_stats.m_input_overruns.fetch_add(1, std::memory_order_relaxed);
+				ctx.log_p(ss::log::NOTICE, std::format("input from fd: {} over the cap ({} bytes without a line end), disconnecting client", l_curfd, l_client->m_in_circbuff.size()));
+			}
+			m_clients.release(l_curfd);
+			if (l_overrun)
+				remove_client(l_curfd, l_serial);
+		}
 		++l_input_hints_it;
 	}
-	m_input_hints.clear();
+	a_reactor.m_input_hints.clear();
+	input_served();
 }
 
-void server_base::drain_socket(int client_sockfd)
+bool server_base::drain_socket(int client_sockfd, std::uint32_t a_serial)
 {
-	std::array<std::uint8_t, DRAIN_BUFFER_SIZE> l_buffer;
-	int l_readbytes = read(client_sockfd, l_buffer.data(), DRAIN_BUFFER_SIZE);
-//	ctx.log(std::format("read {} bytes from fd: {}", l_readbytes, client_sockfd));
-	if (l_readbytes <= 0) {
-		// EOF
+	// client sockets are edge triggered, so keep reading until the kernel runs dry, or the
+	// client's read budget for this pass runs out and its reactor comes back for the rest. Data
+	// goes straight into the free segments at the tail of the client's input buffer, and the
+	// client's shard of the table is locked once for the whole drain rather than once per read.
+	std::uint64_t l_reads = 0;
+	std::uint64_t l_bytes = 0;
+	bool l_eof = false;
+	bool l_more = false;
+	client_rec *l_client = m_clients.acquire(client_sockfd);
+	if (l_client == nullptr)
+		return false;
+	if ((a_serial != 0) && (l_client->m_serial != a_serial)) {
+		m_clients.release(client_sockfd);
+		return false; // the fd has been reused by a newer client since, its own events drain it
+	}
+	if (l_client->m_read_paused) {
+		// leave it in the kernel, resume_reading() comes back for it
+		m_clients.release(client_sockfd);
+		return true;
+	}
+	ss::net::circbuff& l_in = l_client->m_in_circbuff;
+	while (1) {
+		if (l_bytes >= READ_BUDGET) {
+			l_more = true;
+			break;
+		}
+		l_in.reserve(DRAIN_BUFFER_SIZE);
+		struct iovec l_iov[2];
+		int l_cnt = l_in.free_segments(l_iov);
+		ssize_t l_readbytes = readv(client_sockfd, l_iov, l_cnt);
+		++l_reads;
+		if (l_readbytes > 0) {
+			l_in.commit(l_readbytes);
+			l_bytes += l_readbytes;
+		} else if (l_readbytes == 0) {
+			// EOF
+			l_eof = true;
+			break;
+		} else if (errno == EINTR) {
+			continue;
+		} else {
+			// EAGAIN means we're drained, anything else is fatal for this client
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				l_eof = true;
+			break;
+		}
+	}
+//	ctx.log(std::format("read {} bytes from fd: {} in {} calls", l_bytes, client_sockfd, l_reads));
+	if (l_bytes > 0) {
+		reactor& l_reactor = *m_reactors[l_client->m_reactor];
+		l_reactor.m_input_hints.insert(client_sockfd);
+		l_client->m_last_input = l_reactor.m_timers.now();
+		l_client->m_input_ns = ss::net::histogram::now_ns();
+		if (l_more)
+			l_reactor.m_drain_hints[client_sockfd] = l_client->m_serial;
+	}
+	m_clients.release(client_sockfd);
+	m_io_stats.m_read_wakeups.fetch_add(1, std::memory_order_relaxed);
+	m_io_stats.m_read_calls.fetch_add(l_reads, std::memory_order_relaxed);
+	m_io_stats.m_read_bytes.fetch_add(l_bytes, std::memory_order_relaxed);
+	if (l_eof) {
 		remove_client(client_sockfd);
+		return false;
+	}
+	return true;
+}
+
+std::uint64_t server_base::next_deadline(const client_rec& a_rec)
+{
+	// earliest tick at which one of the client's timeouts could run out, 0 if none apply
+	std::uint64_t l_next = 0;
+	auto l_earliest = [&](std::uint64_t a_tick) {
+		if ((l_next == 0) || (a_tick < l_next))
+			l_next = a_tick;
+	};
+	if ((m_login_timeout != 0) && (m_auth_policy > 1) && (a_rec.m_auth_state != auth_state::AUTH_STATE_LOGGED_ON))
+		l_earliest(a_rec.m_connect_tick + m_login_timeout);
+	if (m_idle_timeout != 0)
+		l_earliest(a_rec.m_last_input + m_idle_timeout);
+	if ((m_stall_timeout != 0) && (a_rec.m_stall_since != 0))
+		l_earliest(a_rec.m_stall_since + m_stall_timeout);
+	if (a_rec.m_linger_until != 0)
+		l_earliest(a_rec.m_linger_until);
+	return l_next;
+}
+
+void server_base::request_timer(int client_sockfd, const client_rec& a_rec)
+{
+	// any thread. Deadlines only ever move out, except when one comes into play that wasn't
+	// there before - then the owning reactor may need an earlier entry on its wheel.
+	std::uint64_t l_next = next_deadline(a_rec);
+	if ((l_next == 0) || ((a_rec.m_timer_at != 0) && (a_rec.m_timer_at <= l_next)))
+		return;
+	unsigned int l_reactor = a_rec.m_reactor;
+	std::uint32_t l_serial = a_rec.m_serial;
+	post(l_reactor, [this, l_reactor, client_sockfd, l_serial]() {
+		client_rec *l_client = m_clients.acquire(client_sockfd);
+		if (l_client == nullptr)
+			return;
+		if (l_client->m_serial == l_serial)
+			schedule_timer(*m_reactors[l_reactor], client_sockfd, *l_client);
+		m_clients.release(client_sockfd);
+	});
+}
+
+void server_base::schedule_timer(reactor& a_reactor, int client_sockfd, client_rec& a_rec)
+{
+	// reactor thread, caller holds the client's shard
+	std::uint64_t l_next = next_deadline(a_rec);
+	if ((l_next == 0) || ((a_rec.m_timer_at != 0) && (a_rec.m_timer_at <= l_next)))
+		return;
+	a_rec.m_timer_at = l_next;
+	a_reactor.m_timers.insert(client_sockfd, a_rec.m_serial, l_next);
+}
+
+void server_base::track_output_stall(int client_sockfd, client_rec& a_rec, bool a_progress)
+{
+	// caller holds the client's shard. Output left queued starts the stall clock, progress restarts it.
+	if (m_stall_timeout == 0)
+		return;
+	if (a_rec.m_out_queue.empty()) {
+		a_rec.m_stall_since = 0;
+	} else if (a_rec.m_stall_since == 0) {
+		a_rec.m_stall_since = m_reactors[a_rec.m_reactor]->m_timers.now();
+		request_timer(client_sockfd, a_rec);
+	} else if (a_progress) {
+		a_rec.m_stall_since = m_reactors[a_rec.m_reactor]->m_timers.now();
+	}
+}
+
+void server_base::run_timers(reactor& a_reactor)
+{
+	a_reactor.m_expired.clear();
+	a_reactor.m_timers.advance(a_reactor.m_expired);
+	for (auto& l_entry : a_reactor.m_expired) {
+		if (l_entry.m_serial == 0)
+			resume_accepting(l_entry.m_fd); // a listener's back-off
+		else
+			expire_client(a_reactor, l_entry);
+	}
+}
+
+void server_base::expire_client(reactor& a_reactor, const ss::net::timer_wheel::entry& a_entry)
+{
+	client_rec *l_client = m_clients.acquire(a_entry.m_fd);
+	if (l_client == nullptr)
+		return;
+	if ((l_client->m_serial != a_entry.m_serial) || (l_client->m_timer_at != a_entry.m_tick)) {
+		// client has gone, or this entry was superseded by an earlier one
+		m_clients.release(a_entry.m_fd);
+		return;
+	}
+	l_client->m_timer_at = 0;
+	std::uint64_t l_now = a_reactor.m_timers.now();
+	std::string l_reason;
+	if ((l_client->m_linger_until != 0) && (l_client->m_linger_until <= l_now)) {
+		l_reason = "linger timeout";
+		m_io_stats.m_linger_timeouts.fetch_add(1, std::memory_order_relaxed);
+	} else if ((m_login_timeout != 0) && (m_auth_policy > 1) && (l_client->m_auth_state != auth_state::AUTH_STATE_LOGGED_ON) && (l_client->m_connect_tick + m_login_timeout <= l_now)) {
+		l_reason = "login timeout";
+		m_io_stats.m_login_timeouts.fetch_add(1, std::memory_order_relaxed);
+	} else if ((m_idle_timeout != 0) && (l_client->m_last_input + m_idle_timeout <= l_now)) {
+		l_reason = "idle timeout";
+		m_io_stats.m_idle_timeouts.fetch_add(1, std::memory_order_relaxed);
+	} else if ((m_stall_timeout != 0) && (l_client->m_stall_since != 0) && (l_client->m_stall_since + m_stall_timeout <= l_now)) {
+		l_reason = "output stalled";
+		m_io_stats.m_stall_timeouts.fetch_add(1, std::memory_order_relaxed);
+	}
+	if (l_reason.empty()) {
+		// activity pushed the deadline out since the entry went on the wheel, go round again
+		schedule_timer(a_reactor, a_entry.m_fd, *l_client);
+		m_clients.release(a_entry.m_fd);
+		return;
+	}
+	m_clients.release(a_entry.m_fd);
+	ctx.log_p(ss::log::NOTICE, std::format("{} on fd: {}, disconnecting client", l_reason, a_entry.m_fd));
+	remove_client(a_entry.m_fd, a_entry.m_serial);
+}
+
+bool server_base::enqueue_output(int client_sockfd, client_rec& a_rec, const std::string& a_string, bool a_delimit)
+{
+	if (!admit_output(client_sockfd, a_rec, a_string.size() + (a_delimit ? 1 : 0)))
+		return false;
+	if (a_delimit)
+		a_rec.m_out_queue.write_std_str_delim(a_string);
+	else
+		a_rec.m_out_queue.write_std_str(a_string);
+	return true;
+}
+
+bool server_base::enqueue_output(int client_sockfd, client_rec& a_rec, std::shared_ptr<const std::string> a_payload)
+{
+	if (!admit_output(client_sockfd, a_rec, a_payload ? a_payload->size() : 0))
+		return false;
+	a_rec.m_out_queue.attach(a_payload);
+	return true;
+}
+
+bool server_base::admit_output(int client_sockfd, client_rec& a_rec, std::size_t a_len)
+{
+	// caller holds the client's shard
+	if (a_rec.m_out_closed || (a_rec.m_linger_until != 0))
+		return false;
+	if ((m_out_hard_cap == 0) || (a_rec.m_out_queue.size() + a_len <= m_out_hard_cap))
+		return true;
+	if (m_cap_policy == CAP_POLICY_DROP) {
+		m_io_stats.m_cap_drops.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	// we can't remove the client while our caller holds it, so its reactor does that
+	a_rec.m_out_closed = true;
+	m_io_stats.m_cap_disconnects.fetch_add(1, std::memory_order_relaxed);
+	ctx.log_p(ss::log::NOTICE, std::format("output for fd: {} over the hard cap ({} bytes queued), disconnecting client", client_sockfd, a_rec.m_out_queue.size()));
+	std::uint32_t l_serial = a_rec.m_serial;
+	post(a_rec.m_reactor, [this, client_sockfd, l_serial]() {
+		remove_client(client_sockfd, l_serial);
+	});
+	return false;
+}
+
+void server_base::account_output(int client_sockfd, client_rec& a_rec)
+{
+	// caller holds the client's shard. Brings the global total up to date with this client's
+	// queue and pauses or resumes reading from it as the water marks say.
+	std::size_t l_size = a_rec.m_out_queue.size();
+	if (l_size != a_rec.m_out_accounted) {
+		adjust_out_total(std::int64_t(l_size) - std::int64_t(a_rec.m_out_accounted));
+		a_rec.m_out_accounted = l_size;
+	}
+	bool l_pressure = m_global_pressure.load(std::memory_order_relaxed);
+	if (!a_rec.m_read_paused) {
+		if ((m_out_high != 0) && (l_size > m_out_high))
+			pause_reading(client_sockfd, a_rec);
+		else if (l_pressure && (l_size > m_out_low))
+			pause_reading(client_sockfd, a_rec);
+	} else if ((l_size <= m_out_low) && !a_rec.m_out_closed) {
+		resume_reading(client_sockfd, a_rec);
+	}
+}
+
+void server_base::adjust_out_total(std::int64_t a_delta)
+{
+	if (a_delta == 0)
+		return;
+	std::int64_t l_total = m_out_total.fetch_add(a_delta, std::memory_order_relaxed) + a_delta;
+	if (m_global_high == 0)
+		return;
+	if ((l_total > std::int64_t(m_global_high)) && !m_global_pressure.load(std::memory_order_relaxed)) {
+		if (!m_global_pressure.exchange(true)) {
+			m_io_stats.m_global_pressure.fetch_add(1, std::memory_order_relaxed);
+			post(0, [this]() {
+				pressure_sweep(0);
+			});
+		}
+	} else if ((l_total <= std::int64_t(m_global_low)) && m_global_pressure.load(std::memory_order_relaxed)) {
+		m_global_pressure = false;
+	}
+}
+
+void server_base::pressure_sweep(std::size_t a_shard)
+{
+	// reactor 0's thread. Nothing left to do once the pressure is off again, the clients that
+	// are still over the low mark resume as they drain whether we got to them or not.
+	if (!m_global_pressure.load(std::memory_order_relaxed))
+		return;
+	const std::size_t l_shards = fd_table<client_rec>::SHARDS;
+	std::size_t l_stop = std::min(a_shard + FAN_OUT_SHARDS_PER_PASS, l_shards);
+	for (std::size_t i = a_shard; i < l_stop; ++i) {
+		m_clients.for_each_in_shard(i, [&](int a_fd, client_rec& a_rec) {
+			if (!a_rec.m_read_paused && (a_rec.m_out_queue.size() > m_out_low))
+				account_output(a_fd, a_rec);
+		});
+	}
+	if (l_stop < l_shards) {
+		post(0, [this, l_stop]() {
+			pressure_sweep(l_stop);
+		});
+	}
+}
+
+void server_base::pause_reading(int client_sockfd, client_rec& a_rec)
+{
+	// caller holds the client's shard. epoll: drain_socket() leaves the socket alone from now on.
+	// io_uring: the multishot receive is cancelled, its completion won't re-arm it while paused.
+	a_rec.m_read_paused = true;
+	m_io_stats.m_read_pauses.fetch_add(1, std::memory_order_relaxed);
+	if (m_io_backend != IO_BACKEND_URING)
+		return;
+	unsigned int l_reactor = a_rec.m_reactor;
+	std::uint32_t l_serial = a_rec.m_serial;
+	post(l_reactor, [this, l_reactor, client_sockfd, l_serial]() {
+		m_reactors[l_reactor]->m_ring->prep_cancel(uring_data(URING_OP_RECV, client_sockfd, l_serial), uring_data(URING_OP_CANCEL, client_sockfd, l_serial));
+	});
+}
+
+void server_base::resume_reading(int client_sockfd, client_rec& a_rec)
+{
+	// caller holds the client's shard. Input that arrived meanwhile is still waiting in the kernel
+	// (and maybe commands in the input buffer), so the owning reactor picks up where it left off.
+	a_rec.m_read_paused = false;
+	m_io_stats.m_read_resumes.fetch_add(1, std::memory_order_relaxed);
+	unsigned int l_reactor = a_rec.m_reactor;
+	std::uint32_t l_serial = a_rec.m_serial;
+	post(l_reactor, [this, l_reactor, client_sockfd, l_serial]() {
+		reactor& l_r = *m_reactors[l_reactor];
+		client_rec *l_client = m_clients.acquire(client_sockfd);
+		if (l_client == nullptr)
+			return;
+		if ((l_client->m_serial != l_serial) || l_client->m_read_paused) {
+			m_clients.release(client_sockfd);
+			return;
+		}
+		if ((m_io_backend == IO_BACKEND_URING) && !l_client->m_recv_armed) {
+			// otherwise the cancel is still on its way and its completion re-arms
+			l_client->m_recv_armed = true;
+			uring_arm_recv(l_r, client_sockfd, l_serial);
+		}
+		l_r.m_input_hints.insert(client_sockfd);
+		m_clients.release(client_sockfd);
+		if (m_io_backend == IO_BACKEND_EPOLL)
+			drain_socket(client_sockfd);
+		serve(l_r);
+	});
+}
+
+void server_base::fan_out(std::shared_ptr<const std::string> a_payload, fan_out_filter a_filter, std::function<void(std::size_t)> a_done)
+{
+	std::shared_ptr<fan_out_state> l_state = std::make_shared<fan_out_state>();
+	l_state->m_payload = a_payload;
+	l_state->m_filter = a_filter;
+	l_state->m_done = a_done;
+	l_state->m_sweeps = m_reactor_count;
+	const std::size_t l_shards = fd_table<client_rec>::SHARDS;
+	for (unsigned int i = 0; i < m_reactor_count; ++i) {
+		std::size_t l_first = l_shards * i / m_reactor_count;
+		std::size_t l_end = l_shards * (i + 1) / m_reactor_count;
+		post(i, [this, l_state, i, l_first, l_end]() {
+			fan_out_sweep(l_state, i, l_first, l_end);
+		});
+	}
+}
+
+void server_base::fan_out_sweep(std::shared_ptr<fan_out_state> a_state, unsigned int a_reactor, std::size_t a_shard, std::size_t a_end)
+{
+	// reactor thread. Every client gets a reference to the same payload, then goes back in the
+	// mailbox if there's more to do, so the reactor gets round to its own I/O in between.
+	std::size_t l_stop = std::min(a_shard + FAN_OUT_SHARDS_PER_PASS, a_end);
+	std::size_t l_reached = 0;
+	std::vector<std::pair<int, std::uint32_t>> l_failed; // removed once we're out of the shards
+	for (std::size_t i = a_shard; i < l_stop; ++i) {
+		m_clients.for_each_in_shard(i, [&](int a_fd, client_rec& a_rec) {
+			if (a_state->m_filter && !a_state->m_filter(a_fd, a_rec))
+				return;
+			if (enqueue_output(a_fd, a_rec, a_state->m_payload)) {
+				if (!flush_client(a_fd, a_rec))
+					l_failed.emplace_back(a_fd, a_rec.m_serial);
+				++l_reached;
+			}
+		});
+	}
+	for (auto& [l_fd, l_serial] : l_failed)
+		remove_client(l_fd, l_serial);
+	a_state->m_reached.fetch_add(l_reached);
+	if (l_stop < a_end) {
+		post(a_reactor, [this, a_state, a_reactor, l_stop, a_end]() {
+			fan_out_sweep(a_state, a_reactor, l_stop, a_end);
+		});
+		return;
+	}
+	if ((a_state->m_sweeps.fetch_sub(1) == 1) && a_state->m_done)
+		a_state->m_done(a_state->m_reached.load());
+}
+
+void server_base::raise_request(std::atomic<bool>& a_request)
+{
+	// may run in a signal handler: atomics, a futex wake and a write() only
+	a_request = true;
+	m_request_seq.fetch_add(1);
+	m_request_seq.notify_all();
+	wake_drain();
+}
+
+void server_base::wait_for_request()
+{
+	while (1) {
+		std::uint32_t l_seq = m_request_seq.load();
+		if (m_request_down || m_request_hup || m_request_upgrade)
+			return;
+		m_request_seq.wait(l_seq);
+	}
+}
+
+void server_base::housekeeping()
+{
+	// runs after every batch of events. Counters only move when there's traffic, so publishing
+	// them from here (at most once a second, by whichever reactor gets in first) needs no timer.
+	std::unique_lock<std::mutex> l_lock(m_publish_mtx, std::try_to_lock);
+	if (l_lock.owns_lock() && (ss::doubletime::now_as_double() - double(m_last_publish) >= 1.0))
+		publish_stats();
+}
+
+void server_base::add_stats_source(std::function<void()> a_source)
+{
+	std::lock_guard<std::mutex> l_guard(m_publish_mtx);
+	m_stats_sources.push_back(a_source);
+}
+
+std::string server_base::stats_text()
+{
+	{
+		std::lock_guard<std::mutex> l_guard(m_publish_mtx);
+		publish_stats();
+	}
+	return to_text();
+}
+
+std::string server_base::stats_exposition()
+{
+	{
+		std::lock_guard<std::mutex> l_guard(m_publish_mtx);
+		publish_stats();
+	}
+	return to_exposition(m_category);
+}
+
+void server_base::publish_stats()
+{
+	// everything in here is an atomic or a copy, none of it is worth holding up a client for
+	double l_now = ss::doubletime::now_as_double();
+	double l_elapsed = l_now - double(m_last_publish);
+	m_last_publish.now();
+	ss::esr_object_ptr l_server = child_object("server");
+	std::uint64_t l_all_accepts = m_io_stats.m_accepts.load(std::memory_order_relaxed);
+	set_number(l_server, "connections", m_clients.size());
+	set_number(l_server, "uptime", l_now - double(m_uptime));
+	if (l_elapsed > 0)
+		set_number(l_server, "accepts_per_sec", (l_all_accepts - m_last_accepts) / l_elapsed);
+	m_last_accepts = l_all_accepts;
+	ss::esr_object_ptr l_io = child_object("io");
+	double l_wakeups = m_io_stats.m_read_wakeups.load(std::memory_order_relaxed);
+	double l_bytes = m_io_stats.m_read_bytes.load(std::memory_order_relaxed);
+	double l_copied = m_io_stats.m_copied_bytes.load(std::memory_order_relaxed);
+	set_number(l_io, "read_wakeups", l_wakeups);
+	set_number(l_io, "read_calls", m_io_stats.m_read_calls.load(std::memory_order_relaxed));
+	set_number(l_io, "read_bytes", l_bytes);
+	set_number(l_io, "bytes_per_wakeup", (l_wakeups > 0) ? l_bytes / l_wakeups : 0.0);
+	set_number(l_io, "copies_per_byte", (l_bytes > 0) ? l_copied / l_bytes : 0.0);
+	double l_write_wakeups = m_io_stats.m_write_wakeups.load(std::memory_order_relaxed);
+	double l_write_calls = m_io_stats.m_write_calls.load(std::memory_order_relaxed);
+	double l_write_bytes = m_io_stats.m_write_bytes.load(std::memory_order_relaxed);
+	set_number(l_io, "write_wakeups", l_write_wakeups);
+	set_number(l_io, "write_calls", l_write_calls);
+	set_number(l_io, "write_bytes", l_write_bytes);
+	set_number(l_io, "bytes_per_write", (l_write_calls > 0) ? l_write_bytes / l_write_calls : 0.0);
+	set_number(l_io, "epollout_arms", m_io_stats.m_epollout_arms.load(std::memory_order_relaxed));
+	set_number(l_io, "sq_full", m_io_stats.m_sq_full.load(std::memory_order_relaxed));
+	set_number(l_io, "login_timeouts", m_io_stats.m_login_timeouts.load(std::memory_order_relaxed));
+	set_number(l_io, "idle_timeouts", m_io_stats.m_idle_timeouts.load(std::memory_order_relaxed));
+	set_number(l_io, "stall_timeouts", m_io_stats.m_stall_timeouts.load(std::memory_order_relaxed));
+	set_number(l_io, "linger_closes", m_io_stats.m_linger_closes.load(std::memory_order_relaxed));
+	set_number(l_io, "linger_timeouts", m_io_stats.m_linger_timeouts.load(std::memory_order_relaxed));
+	set_number(l_io, "out_queued_bytes", m_out_total.load(std::memory_order_relaxed));
+	set_number(l_io, "read_pauses", m_io_stats.m_read_pauses.load(std::memory_order_relaxed));
+	set_number(l_io, "read_resumes", m_io_stats.m_read_resumes.load(std::memory_order_relaxed));
+	set_number(l_io, "global_pressure", m_io_stats.m_global_pressure.load(std::memory_order_relaxed));
+	set_number(l_io, "cap_drops", m_io_stats.m_cap_drops.load(std::memory_order_relaxed));
+	set_number(l_io, "cap_disconnects", m_io_stats.m_cap_disconnects.load(std::memory_order_relaxed));
+	set_number(l_io, "input_overruns", m_io_stats.m_input_overruns.load(std::memory_order_relaxed));
+	double l_accepts = m_io_stats.m_accepts.load(std::memory_order_relaxed);
+	double l_accept_wakeups = m_io_stats.m_accept_wakeups.load(std::memory_order_relaxed);
+	set_number(l_io, "accepts", l_accepts);
+	set_number(l_io, "accepts_per_wakeup", (l_accept_wakeups > 0) ? l_accepts / l_accept_wakeups : 0.0);
+	set_number(l_io, "accept_backoffs", m_io_stats.m_accept_backoffs.load(std::memory_order_relaxed));
+	if (m_admission) {
+		ss::esr_object_ptr l_admission = child_object("admission");
+		set_number(l_admission, "rejects_rate", m_io_stats.m_rejects_rate.load(std::memory_order_relaxed));
+		set_number(l_admission, "rejects_connections", m_io_stats.m_rejects_connections.load(std::memory_order_relaxed));
+		set_number(l_admission, "table_full", m_io_stats.m_admission_table_full.load(std::memory_order_relaxed));
+		set_number(l_admission, "addresses_tracked", m_admission->used());
+	}
+	for (auto& l_source : m_stats_sources)
+		l_source();
+}
+
+void server_base::accept_clients(int a_server_fd)
+{
+	// one readiness event can stand for a whole queue of connections (a reconnect storm after
+	// a restart, say), so take everything that's waiting before going back to epoll
+	std::uint64_t l_accepts = 0;
+	while (1) {
+		struct sockaddr_storage l_addr;
+		socklen_t l_len = sizeof(l_addr);
+		memset(&l_addr, 0, sizeof(l_addr));
+		int client_sockfd = accept4(a_server_fd, (struct sockaddr *)&l_addr, &l_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (client_sockfd == -1) {
+			if ((errno == EINTR) || (errno == ECONNABORTED))
+				continue; // interrupted, or the client gave up while queued
+			if (accept_exhausted(errno))
+				pause_accepting(a_server_fd, errno);
+			else if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+				ctx.log_p(ss::log::ERR, std::format("error accepting client at: {} ({})", ss::doubletime::now_as_iso8601_ms(), strerror(errno)));
+			break;
+		}
+		++l_accepts;
+		l_addr.ss_family = (a_server_fd == m_server_sockfd_un) ? AF_UNIX : AF_INET;
+		int l_slot;
+		if (admit_client(client_sockfd, (struct sockaddr *)&l_addr, l_slot))
+			register_client(client_sockfd, (struct sockaddr *)&l_addr, l_slot);
+	}
+	m_io_stats.m_accept_wakeups.fetch_add(1, std::memory_order_relaxed);
+	m_io_stats.m_accepts.fetch_add(l_accepts, std::memory_order_relaxed);
+}
+
+bool server_base::accept_exhausted(int a_errno)
+{
+	// the connection stays queued in the kernel, trying again at once would only fail again
+	return (a_errno == EMFILE) || (a_errno == ENFILE) || (a_errno == ENOBUFS) || (a_errno == ENOMEM);
+}
+
+void server_base::pause_accepting(int a_server_fd, int a_errno)
+{
+	m_io_stats.m_accept_backoffs.fetch_add(1, std::memory_order_relaxed);
+	if (m_io_backend == IO_BACKEND_EPOLL) {
+		struct epoll_event ev;
+		ev.events = 0;
+		ev.data.fd = a_server_fd;
+		epoll_ctl(m_reactors[0]->m_epollfd, EPOLL_CTL_MOD, a_server_fd, &ev);
+	}
+	reactor& l_reactor = *m_reactors[0];
+	std::uint64_t l_ticks = std::max<std::uint64_t>(1, ACCEPT_BACKOFF_MS / TIMER_TICK_MS);
+	l_reactor.m_timers.insert(a_server_fd, 0, l_reactor.m_timers.now() + l_ticks);
+	std::uint32_t l_ms = ACCEPT_BACKOFF_MS;
+	ctx.log_p(ss::log::ERR, std::format("unable to accept clients on fd {} ({}), not accepting for {} ms", a_server_fd, strerror(a_errno), l_ms));
+}
+
+void server_base::resume_accepting(int a_server_fd)
+{
+	if (m_accept_stopped)
+		return;
+	if (m_io_backend == IO_BACKEND_URING) {
+		uring_arm_accept(a_server_fd);
 	} else {
-		// stick the data in client's input circular buffer
-		m_client_list_mtx.lock();
-		std::map<int, client_rec>::iterator client_list_it = m_client_list.find(client_sockfd);
-		client_list_it->second.m_in_circbuff.assign(l_buffer.data(), l_readbytes);
-		m_input_hints.insert(client_sockfd);
-		m_client_list_mtx.unlock();
+		// level triggered, so connections that queued up meanwhile fire it right away
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.fd = a_server_fd;
+		epoll_ctl(m_reactors[0]->m_epollfd, EPOLL_CTL_MOD, a_server_fd, &ev);
+	}
+}
+
+void server_base::tune_listener(int a_fd, bool a_tcp)
+{
+	// none of these are fatal, the server works without them
+	auto l_set = [&](int a_level, int a_option, int a_value, const char *a_name) {
+		if (setsockopt(a_fd, a_level, a_option, &a_value, sizeof(a_value)) < 0)
+			ctx.log_p(ss::log::WARNING, std::format("unable to set {} on fd: {}, errno = {} ({})", a_name, a_fd, errno, strerror(errno)));
+	};
+	if (m_socket_sndbuf != 0)
+		l_set(SOL_SOCKET, SO_SNDBUF, m_socket_sndbuf, "SO_SNDBUF");
+	if (m_socket_rcvbuf != 0)
+		l_set(SOL_SOCKET, SO_RCVBUF, m_socket_rcvbuf, "SO_RCVBUF");
+	if (!a_tcp)
+		return;
+	if (m_tcp_nodelay)
+		l_set(IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+	if (m_tcp_defer_accept != 0)
+		l_set(IPPROTO_TCP, TCP_DEFER_ACCEPT, m_tcp_defer_accept, "TCP_DEFER_ACCEPT");
+	if (m_tcp_keepalive) {
+		l_set(SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+		if (m_tcp_keepidle != 0)
+			l_set(IPPROTO_TCP, TCP_KEEPIDLE, m_tcp_keepidle, "TCP_KEEPIDLE");
+		if (m_tcp_keepintvl != 0)
+			l_set(IPPROTO_TCP, TCP_KEEPINTVL, m_tcp_keepintvl, "TCP_KEEPINTVL");
+		if (m_tcp_keepcnt != 0)
+			l_set(IPPROTO_TCP, TCP_KEEPCNT, m_tcp_keepcnt, "TCP_KEEPCNT");
+	}
+}
+
+bool server_base::admit_client(int client_sockfd, const struct sockaddr *a_addr, int& a_slot)
+{
+	// reactor 0 only, before anything is set up for the client: a refused socket is simply closed
+	a_slot = -1;
+	if (!m_admission || (a_addr->sa_family != AF_INET))
+		return true;
+	const struct sockaddr_in *l_addr = (const struct sockaddr_in *)a_addr;
+	switch (m_admission->admit(ntohl(l_addr->sin_addr.s_addr), a_slot)) {
+		case ss::net::admission::ADMIT:
+			return true;
+		case ss::net::admission::ADMIT_TABLE_FULL:
+			m_io_stats.m_admission_table_full.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		case ss::net::admission::REJECT_RATE:
+			m_io_stats.m_rejects_rate.fetch_add(1, std::memory_order_relaxed);
+			break;
+		case ss::net::admission::REJECT_CONNECTIONS:
+			m_io_stats.m_rejects_connections.fetch_add(1, std::memory_order_relaxed);
+			break;
 	}
+	close(client_sockfd);
+	return false;
 }
 
-int server_base::accept_client(int a_server_fd)
+int server_base::register_client(int client_sockfd, const struct sockaddr *a_addr, int a_admission_slot)
 {
+	// reactor 0 only: build client record, hand the client to the next reactor in round robin order
 	client_rec l_rec;
-	l_rec.m_auth_state = auth_state::AUTH_STATE_NOAUTH;
-	l_rec.m_auth_username = "";
-	l_rec.m_in_circbuff.set_circular_mode(true);
-	l_rec.m_out_circbuff.set_circular_mode(true);
-	socklen_t client_len;
-	int client_sockfd = 0;
-	struct sockaddr_in client_address;
-	struct sockaddr_un client_address_un;
-	if (a_server_fd == m_server_sockfd) {
-		client_len = sizeof(client_address);
-		client_sockfd = accept4(m_server_sockfd, (struct sockaddr *)&client_address, &client_len, SOCK_NONBLOCK);
-		if (client_sockfd == -1) return -1; // some error accepting so just keep on going
-		l_rec.m_family = AF_INET;
-		l_rec.m_sockaddr_in = client_address;
-	} else if (a_server_fd == m_server_sockfd_un) {
-		client_len = sizeof(client_address_un);
-		client_sockfd = accept4(m_server_sockfd_un, (struct sockaddr *)&client_address_un, &client_len, SOCK_NONBLOCK);
-		if (client_sockfd == -1) return -1;
-		l_rec.m_family = AF_UNIX;
-		l_rec.m_sockaddr_un = client_address_un;
-	}
-	// build client record
+	init_client_rec(l_rec, a_addr, a_admission_slot);
 	l_rec.m_connect_time.now();
-	m_client_list_mtx.lock();
-	m_client_list.insert(std::pair<int, client_rec>(client_sockfd, l_rec));
-	// add socket to epoll
-	struct epoll_event l_client_info;
-	l_client_info.events = EPOLLIN | EPOLLHUP;
-	l_client_info.data.fd = client_sockfd;
-	epoll_ctl(m_epollfd, EPOLL_CTL_ADD, client_sockfd, &l_client_info);
-	m_client_list_mtx.unlock();
+	if (install_client(client_sockfd, l_rec, true) == -1)
+		return -1;
 
 	switch (l_rec.m_family) {
 		case AF_INET:
@@ -255,27 +1412,157 @@ int server_base::accept_client(int a_server_fd)
 	return client_sockfd;
 }
 
-void server_base::remove_client(int client_sockfd)
+void server_base::init_client_rec(client_rec& a_rec, const struct sockaddr *a_addr, int a_admission_slot)
+{
+	// a client that has to log on is waiting for its username from the start
+	a_rec.m_auth_state = (m_auth_policy > 1) ? auth_state::AUTH_STATE_AWAIT_USERNAME : auth_state::AUTH_STATE_NOAUTH;
+	a_rec.m_auth_username = "";
+	a_rec.m_epollout = false;
+	a_rec.m_send_posted = false;
+	a_rec.m_recv_armed = (m_io_backend == IO_BACKEND_URING);
+	a_rec.m_out_accounted = 0;
+	a_rec.m_read_paused = false;
+	a_rec.m_out_closed = false;
+	a_rec.m_admission_slot = a_admission_slot;
+	a_rec.m_family = a_addr->sa_family;
+	if (a_rec.m_family == AF_INET)
+		a_rec.m_sockaddr_in = *(const struct sockaddr_in *)a_addr;
+	else
+		a_rec.m_sockaddr_un = *(const struct sockaddr_un *)a_addr;
+	a_rec.m_input_ns = 0;
+	a_rec.m_stall_since = 0;
+	a_rec.m_timer_at = 0;
+	a_rec.m_linger_until = 0;
+	a_rec.m_linger_shut = false;
+}
+
+int server_base::install_client(int client_sockfd, client_rec& a_rec, bool a_greet)
+{
+	// reactor 0 only: the record goes into the table and the client's reactor starts serving it
+	a_rec.m_reactor = m_next_reactor;
+	m_next_reactor = (m_next_reactor + 1) % m_reactor_count;
+	a_rec.m_connect_tick = m_reactors[a_rec.m_reactor]->m_timers.now();
+	a_rec.m_last_input = a_rec.m_connect_tick;
+	// serials travel in 24 bits of io_uring user_data, and 0 means "any client"
+	a_rec.m_serial = m_next_serial;
+	m_next_serial = (m_next_serial + 1) & 0xffffff;
+	if (m_next_serial == 0)
+		m_next_serial = 1;
+	if (!m_clients.insert(client_sockfd, a_rec)) {
+		ctx.log_p(ss::log::ERR, std::format("stale client record found for fd: {}, refusing client", client_sockfd));
+		if (m_admission)
+			m_admission->release(a_rec.m_admission_slot);
+		close(client_sockfd);
+		return -1;
+	}
+	if (a_greet) {
+		// greeted before its reactor starts reading from it, so the greeting goes out ahead of
+		// whatever its first commands produce
+		newly_accepted_client(client_sockfd);
+		client_rec *l_client = m_clients.acquire(client_sockfd);
+		if (l_client == nullptr)
+			return -1; // couldn't even take its greeting
+		a_rec.m_epollout = l_client->m_epollout;
+		m_clients.release(client_sockfd);
+	}
+	if (m_io_backend == IO_BACKEND_URING) {
+		// the owning reactor arms a multishot receive on its own ring
+		if (a_rec.m_reactor == 0) {
+			uring_arm_recv(*m_reactors[0], client_sockfd, a_rec.m_serial);
+		} else {
+			unsigned int l_reactor = a_rec.m_reactor;
+			std::uint32_t l_serial = a_rec.m_serial;
+			post(l_reactor, [this, l_reactor, client_sockfd, l_serial]() {
+				uring_arm_recv(*m_reactors[l_reactor], client_sockfd, l_serial);
+			});
+		}
+	} else {
+		// add socket to its reactor's epoll, with EPOLLOUT if the greeting filled the send buffer
+		struct epoll_event l_client_info;
+		l_client_info.events = a_rec.m_epollout ? (CLIENT_EPOLL_EVENTS | EPOLLOUT) : CLIENT_EPOLL_EVENTS;
+		l_client_info.data.fd = client_sockfd;
+		epoll_ctl(m_reactors[a_rec.m_reactor]->m_epollfd, EPOLL_CTL_ADD, client_sockfd, &l_client_info);
+	}
+	request_timer(client_sockfd, a_rec);
+	return client_sockfd;
+}
+
+void server_base::remove_client(int client_sockfd, std::uint32_t a_serial)
 {
-	std::lock_guard<std::mutex> l_guard(m_client_list_mtx);
+	client_rec *l_client = m_clients.acquire(client_sockfd);
+	if (l_client == nullptr)
+		return; // already removed (e.g. EPOLLHUP and EOF on read both reported)
+	if ((a_serial != 0) && (l_client->m_serial != a_serial)) {
+		m_clients.release(client_sockfd);
+		return; // the fd has been reused by a newer client since
+	}
+	if (m_io_backend == IO_BACKEND_URING) {
+		// the ring holds its own reference to the socket, so shut it down to end the receive
+		// and any send in flight, and have the owning reactor cancel whatever is left
+		::shutdown(client_sockfd, SHUT_RDWR);
+		unsigned int l_reactor = l_client->m_reactor;
+		std::uint32_t l_serial = l_client->m_serial;
+		post(l_reactor, [this, l_reactor, client_sockfd, l_serial]() {
+			reactor& l_r = *m_reactors[l_reactor];
+			l_r.m_ring->prep_cancel(uring_data(URING_OP_RECV, client_sockfd, l_serial), uring_data(URING_OP_CANCEL, client_sockfd, l_serial));
+			l_r.m_ring->prep_cancel(uring_data(URING_OP_SEND, client_sockfd, l_serial), uring_data(URING_OP_CANCEL, client_sockfd, l_serial));
+		});
+	} else {
+		// remove from its reactor's epoll
+		struct epoll_event l_client_info;
+		l_client_info.events = 0;
+		epoll_ctl(m_reactors[l_client->m_reactor]->m_epollfd, EPOLL_CTL_DEL, client_sockfd, &l_client_info);
+	}
 	close(client_sockfd);
-	// remove from epoll
-	struct epoll_event l_client_info;
-	l_client_info.events = 0;
-	epoll_ctl(m_epollfd, EPOLL_CTL_DEL, client_sockfd, &l_client_info);
-	std::map<int, client_rec>::iterator client_list_it = m_client_list.find(client_sockfd);
-	double l_ct = double(client_list_it->second.m_connect_time);
-	switch (client_list_it->second.m_family) {
+	adjust_out_total(-std::int64_t(l_client->m_out_accounted));
+	if (m_admission)
+		m_admission->release(l_client->m_admission_slot);
+	double l_ct = double(l_client->m_connect_time);
+	switch (l_client->m_family) {
 		case AF_INET:
-			ctx.log_p(ss::log::INFO, std::format("disconnected TCP client fd: {} ({}) at: {} connected for {} seconds.", client_sockfd, ip_str(&client_list_it->second.m_sockaddr_in), ss::doubletime::now_as_iso8601_ms(), ss::doubletime::now_as_double() - l_ct));
+			ctx.log_p(ss::log::INFO, std::format("disconnected TCP client fd: {} ({}) at: {} connected for {} seconds.", client_sockfd, ip_str(&l_client->m_sockaddr_in), ss::doubletime::now_as_iso8601_ms(), ss::doubletime::now_as_double() - l_ct));
 			break;
 		case AF_UNIX:
-			ctx.log_p(ss::log::INFO, std::format("disconnected UNIX client fd: {} ({}) at: {} connected for {} seconds.", client_sockfd, un_str(&client_list_it->second.m_sockaddr_un), ss::doubletime::now_as_iso8601_ms(), ss::doubletime::now_as_double() - l_ct));
+			ctx.log_p(ss::log::INFO, std::format("disconnected UNIX client fd: {} ({}) at: {} connected for {} seconds.", client_sockfd, un_str(&l_client->m_sockaddr_un), ss::doubletime::now_as_iso8601_ms(), ss::doubletime::now_as_double() - l_ct));
 			break;
 	}
-	m_client_list.erase(client_list_it);
-	// remove client_sockfd from hints list
-	m_input_hints.erase(client_sockfd);
+	client_removed(client_sockfd, *l_client);
+	// the reactor's input hints are left alone, serve() skips hints for fd's that are gone
+	m_clients.erase(client_sockfd);
+	m_clients.release(client_sockfd);
+	if (m_clients.size() == 0)
+		wake_drain();
+}
+
+void server_base::close_client(int client_sockfd, std::uint32_t a_serial)
+{
+	client_rec *l_client = m_clients.acquire(client_sockfd);
+	if (l_client == nullptr)
+		return;
+	if (((a_serial != 0) && (l_client->m_serial != a_serial)) || (l_client->m_linger_until != 0)) {
+		m_clients.release(client_sockfd);
+		return; // somebody else's by now, or already closing
+	}
+	std::uint32_t l_serial = l_client->m_serial;
+	l_client->m_linger_until = m_reactors[l_client->m_reactor]->m_timers.now() + m_linger_timeout;
+	l_client->m_in_circbuff.clear();
+	m_io_stats.m_linger_closes.fetch_add(1, std::memory_order_relaxed);
+	bool l_ok = flush_client(client_sockfd, *l_client);
+	request_timer(client_sockfd, *l_client);
+	m_clients.release(client_sockfd);
+	if (!l_ok)
+		remove_client(client_sockfd, l_serial);
+}
+
+void server_base::linger_drained(int client_sockfd, client_rec& a_rec)
+{
+	// caller holds the client's shard. Shutting down our side once a closing client's output
+	// is all with the kernel sends it a FIN behind the data, rather than a reset that could
+	// throw the data away; its hangup (or the linger timeout) then removes it.
+	if ((a_rec.m_linger_until == 0) || a_rec.m_linger_shut || !a_rec.m_out_queue.empty() || a_rec.m_send_posted)
+		return;
+	::shutdown(client_sockfd, SHUT_WR);
+	a_rec.m_linger_shut = true;
 }
 
 std::string server_base::ip_str(const struct sockaddr_in *a_addr)
@@ -297,10 +1584,26 @@ std::string server_base::un_str(const struct sockaddr_un *a_addr)
 	return "UNIX socket connection";
 }
 
+void server_base::listen_on(int a_fd, const std::string& a_caller)
+{
+	// hand the listener to reactor 0
+	if (m_io_backend == IO_BACKEND_URING) {
+		uring_arm_accept(a_fd);
+		m_reactors[0]->m_ring->submit();
+	} else {
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.fd = a_fd;
+		if (epoll_ctl(m_reactors[0]->m_epollfd, EPOLL_CTL_ADD, a_fd, &ev) == -1) {
+			ctx.log_p(ss::log::ERR, std::format("{}: unable to add server socket to epoll, errno = {} ({}), exiting!", a_caller, errno, strerror(errno)));
+			throw std::runtime_error(a_caller + ": unable to add server socket to epoll, exiting!");
+		}
+	}
+}
+
 void server_base::setup_server_tcp()
 {
 	int listen_port;
-	int backlog = 5;
 
 	ss::icr& l_icr = ss::icr::get();
 	listen_port = l_icr.to_integer(l_icr.keyvalue(m_category, "port"));
@@ -321,15 +1624,6 @@ void server_base::setup_server_tcp()
 		throw std::runtime_error("setup_server_tcp: unable to set server_sockfd flags, exiting!");
 	}
 
-	// add server socket to epoll
-	struct epoll_event ev;
-	ev.events = EPOLLIN | EPOLLRDHUP;
-	ev.data.fd = m_server_sockfd;
-	if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_server_sockfd, &ev) == -1) {
-		ctx.log_p(ss::log::ERR, std::format("setup_server_tcp: unable to add server socket to epoll, errno = {} ({}), exiting!", errno, strerror(errno)));
-		throw std::runtime_error("setup_server_tcp: unable to add server socket to epoll, exiting!");
-	}
-
 	// name the socket
 	m_server_address.sin_family = AF_INET;
 	m_server_address.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -343,6 +1637,7 @@ void server_base::setup_server_tcp()
 		throw std::runtime_error("setup_server_tcp: setsockopt SO_REUSEADDR returned error, exiting!");
 	}
 	ctx.log("setup_server_tcp: set reuse");
+	tune_listener(m_server_sockfd, true);
 
 	if (bind(m_server_sockfd, (struct sockaddr *)&m_server_address, server_len) != 0)
 	{
@@ -350,17 +1645,18 @@ void server_base::setup_server_tcp()
 		throw std::runtime_error("setup_server_tcp: bind failed, exiting!");
 	}
 
-	if (listen(m_server_sockfd, backlog) < 0) {
+	if (listen(m_server_sockfd, m_listen_backlog) < 0) {
 		ctx.log_p(ss::log::ERR, "setup_server_tcp: listen failed, exiting!");
 		throw std::runtime_error("setup_server_tcp: listen failed, exiting!");
 	}
 
+	listen_on(m_server_sockfd, "setup_server_tcp");
+
 	ctx.log(std::format("setup_server_tcp: server_sockfd = {}", m_server_sockfd));
 }
 
 void server_base::setup_server_un()
 {
-	int backlog = 5;
 	ss::icr& l_icr = ss::icr::get();
 
 	// remove any old sockets and create an unnamed socket for the server
@@ -378,15 +1674,6 @@ void server_base::setup_server_un()
 		throw std::runtime_error("setup_server_un: unable to set server_sockfd flags, exiting!");
 	}
 
-	// add server socket to epoll
-	struct epoll_event ev;
-	ev.events = EPOLLIN | EPOLLRDHUP;
-	ev.data.fd = m_server_sockfd_un;
-	if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_server_sockfd_un, &ev) == -1) {
-		ctx.log_p(ss::log::ERR, std::format("setup_server_un: unable to add server socket to epoll, errno = {} ({}), exiting!", errno, strerror(errno)));
-		throw std::runtime_error("setup_server_un: unable to add server socket to epoll, exiting!");
-	}
-
 	// name the socket
 	m_server_address_un.sun_family = AF_UNIX;
 	std::string l_sockname = l_icr.keyvalue(m_category, "unix_socket");
@@ -394,6 +1681,7 @@ void server_base::setup_server_un()
 	int server_len = sizeof(m_server_address);
 	unlink(l_sockname.c_str());
 	ctx.log(std::format("setup_server_un: UNIX socket name = {}", l_sockname));
+	tune_listener(m_server_sockfd_un, false);
 
 	if (bind(m_server_sockfd_un, (struct sockaddr *)&m_server_address_un, server_len) != 0)
 	{
@@ -401,13 +1689,376 @@ void server_base::setup_server_un()
 		throw std::runtime_error("setup_server_un: bind failed, exiting!");
 	}
 
-	if (listen(m_server_sockfd_un, backlog) < 0) {
+	if (listen(m_server_sockfd_un, m_listen_backlog) < 0) {
 		ctx.log_p(ss::log::ERR, "setup_server_un: listen failed, exiting!");
 		throw std::runtime_error("setup_server_un: listen failed, exiting!");
 	}
 
+	listen_on(m_server_sockfd_un, "setup_server_un");
+
 	ctx.log(std::format("setup_server_un: server_sockfd_un = {}", m_server_sockfd_un));
 }
 
+int server_base::adopt_listeners()
+{
+	// started by upgrade(): the old server's listeners are the first thing it sends, bound,
+	// listening, and with whatever connections are queued on them still in there
+	ss::net::fd_handoff::message_type l_type;
+	std::string l_payload;
+	std::vector<int> l_fds;
+	if (!m_handoff->receive(l_type, l_payload, l_fds, HANDOFF_TIMEOUT_MS) || (l_type != ss::net::fd_handoff::HANDOFF_LISTENERS)) {
+		for (int l_fd : l_fds)
+			close(l_fd);
+		ctx.log_p(ss::log::NOTICE, "no listeners from the server we're replacing, exiting!");
+		throw std::runtime_error("server_base: no listeners from the server we're replacing, exiting!");
+	}
+	ss::net::fd_handoff::reader l_reader(l_payload);
+	bool l_tcp = l_reader.get_u64();
+	bool l_un = l_reader.get_u64();
+	bool l_stats = l_reader.get_u64();
+	if (!l_reader.ok() || (l_fds.size() != std::size_t(l_tcp) + std::size_t(l_un) + std::size_t(l_stats))) {
+		for (int l_fd : l_fds)
+			close(l_fd);
+		ctx.log_p(ss::log::NOTICE, "listeners from the server we're replacing don't add up, exiting!");
+		throw std::runtime_error("server_base: listeners from the server we're replacing don't add up, exiting!");
+	}
+	std::size_t l_next = 0;
+	if (l_tcp) {
+		m_server_sockfd = l_fds[l_next++];
+		listen_on(m_server_sockfd, "adopt_listeners");
+	}
+	if (l_un) {
+		m_server_sockfd_un = l_fds[l_next++];
+		listen_on(m_server_sockfd_un, "adopt_listeners");
+	}
+	int l_stats_fd = l_stats ? l_fds[l_next++] : -1;
+	ctx.log_p(ss::log::INFO, std::format("took over listeners: server_sockfd = {}, server_sockfd_un = {}, stats = {}", m_server_sockfd, m_server_sockfd_un, l_stats_fd));
+	return l_stats_fd;
+}
+
+bool server_base::upgrade(char **a_argv)
+{
+	// cleared first, so a request that comes in while we're at it isn't lost
+	m_request_upgrade = false;
+	if (m_exe_path.empty()) {
+		ctx.log_p(ss::log::NOTICE, "upgrade: don't know which binary to run, not upgrading");
+		return false;
+	}
+	ctx.log_p(ss::log::NOTICE, std::format("upgrade: starting {}", m_exe_path));
+	int l_pair[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, l_pair) == -1) {
+		ctx.log_p(ss::log::ERR, std::format("upgrade: socketpair failed, errno = {} ({}), not upgrading", errno, strerror(errno)));
+		return false;
+	}
+	// the child does nothing but exec, so its environment is put together beforehand
+	std::string l_prefix = std::format("{}=", HANDOFF_ENV);
+	std::string l_handoff_var = std::format("{}{}", l_prefix, l_pair[1]);
+	std::vector<char *> l_envp;
+	for (char **e = environ; *e != nullptr; ++e)
+		if (strncmp(*e, l_prefix.c_str(), l_prefix.size()) != 0)
+			l_envp.push_back(*e);
+	l_envp.push_back(l_handoff_var.data());
+	l_envp.push_back(nullptr);
+	pid_t l_pid = fork();
+	if (l_pid == 0) {
+		// of our descriptors only the handoff socket goes across, the listeners travel over it
+		close_range(3, ~0U, CLOSE_RANGE_CLOEXEC);
+		fcntl(l_pair[1], F_SETFD, 0);
+		execve(m_exe_path.c_str(), a_argv, l_envp.data());
+		_exit(127);
+	}
+	close(l_pair[1]);
+	if (l_pid == -1) {
+		ctx.log_p(ss::log::ERR, std::format("upgrade: fork failed, errno = {} ({}), not upgrading", errno, strerror(errno)));
+		close(l_pair[0]);
+		return false;
+	}
+	ss::net::fd_handoff l_handoff(l_pair[0]);
+	
+	// listeners go across straight away, but we keep accepting on them until the successor is up
+	std::string l_payload;
+	std::vector<int> l_fds;
+	ss::net::fd_handoff::put(l_payload, std::uint64_t(m_server_sockfd != -1));
+	ss::net::fd_handoff::put(l_payload, std::uint64_t(m_server_sockfd_un != -1));
+	ss::net::fd_handoff::put(l_payload, std::uint64_t(m_stats_listener != nullptr));
+	for (int l_fd : { m_server_sockfd, m_server_sockfd_un, m_stats_listener ? m_stats_listener->fd() : -1 })
+		if (l_fd != -1)
+			l_fds.push_back(l_fd);
+	ss::net::fd_handoff::message_type l_type;
+	std::string l_reply;
+	std::vector<int> l_reply_fds;
+	if (!l_handoff.send(ss::net::fd_handoff::HANDOFF_LISTENERS, l_payload, l_fds)
+		|| !l_handoff.receive(l_type, l_reply, l_reply_fds, HANDOFF_TIMEOUT_MS)
+		|| (l_type != ss::net::fd_handoff::HANDOFF_READY)) {
+		ctx.log_p(ss::log::NOTICE, std::format("upgrade: pid {} didn't come up, carrying on as we were", l_pid));
+		kill(l_pid, SIGKILL);
+		waitpid(l_pid, nullptr, 0);
+		return false;
+	}
+	stop_accepting();
+	ctx.log_p(ss::log::NOTICE, std::format("upgrade: pid {} is up and accepting, we no longer are", l_pid));
+	
+	std::size_t l_moved = 0;
+	if (m_upgrade_connections) {
+		if (m_io_backend == IO_BACKEND_EPOLL)
+			l_moved = hand_over_clients(l_handoff);
+		else
+			ctx.log_p(ss::log::NOTICE, "upgrade: clients can only be handed over from the epoll backend, ours stay until they leave");
+	}
+	l_handoff.send(ss::net::fd_handoff::HANDOFF_END, "", {});
+	ctx.log_p(ss::log::NOTICE, std::format("upgrade: handed over to pid {}, {} clients went with it, {} stay with us", l_pid, l_moved, m_clients.size()));
+	return true;
+}
+
+void server_base::stop_accepting()
+{
+	// the successor has the same listeners, from here on every connection is its. Done on
+	// reactor 0, so that by the time we go on no accept of ours is still under way.
+	std::promise<void> l_stopped;
+	post(0, [this, &l_stopped]() {
+		m_accept_stopped = true; // a listener resting after EMFILE isn't re-armed either
+		for (int l_fd : { m_server_sockfd, m_server_sockfd_un }) {
+			if (l_fd == -1)
+				continue;
+			if (m_io_backend == IO_BACKEND_URING) {
+				m_reactors[0]->m_ring->prep_cancel(uring_data(URING_OP_ACCEPT, l_fd, 0), uring_data(URING_OP_CANCEL, l_fd, 0));
+			} else {
+				struct epoll_event ev;
+				ev.events = 0;
+				epoll_ctl(m_reactors[0]->m_epollfd, EPOLL_CTL_DEL, l_fd, &ev);
+			}
+		}
+		l_stopped.set_value();
+	});
+	l_stopped.get_future().wait();
+	// the scrape endpoint went across with them, shutdown() finds it gone
+	if (m_stats_listener) {
+		m_stats_listener->halt();
+		m_stats_listener.reset();
+	}
+}
+
+std::size_t server_base::hand_over_clients(ss::net::fd_handoff& a_handoff)
+{
+	// nothing may touch a client while it's packed up: commands stop first, then every reactor
+	// drops the clients it owns from its epoll. Whatever is still in the kernel's buffers goes
+	// across with the sockets. Closing clients stay, they're nearly gone anyway.
+	quiesce();
+	std::latch l_detached(m_reactor_count);
+	for (unsigned int i = 0; i < m_reactor_count; ++i) {
+		post(i, [this, i, &l_detached]() {
+			m_clients.for_each([&](int a_fd, client_rec& a_rec) {
+				if ((a_rec.m_reactor != i) || (a_rec.m_linger_until != 0))
+					return;
+				struct epoll_event l_client_info;
+				l_client_info.events = 0;
+				epoll_ctl(m_reactors[i]->m_epollfd, EPOLL_CTL_DEL, a_fd, &l_client_info);
+			});
+			l_detached.count_down();
+		});
+	}
+	l_detached.wait();
+	
+	std::vector<int> l_clients;
+	m_clients.for_each([&](int a_fd, client_rec& a_rec) {
+		if (a_rec.m_linger_until == 0)
+			l_clients.push_back(a_fd);
+	});
+	std::size_t l_moved = 0;
+	std::string l_payload;
+	std::vector<int> l_fds;
+	auto l_send = [&]() {
+		if (l_fds.empty())
+			return;
+		if (a_handoff.send(ss::net::fd_handoff::HANDOFF_CLIENTS, l_payload, l_fds))
+			l_moved += l_fds.size();
+		else
+			ctx.log_p(ss::log::ERR, std::format("upgrade: lost {} clients handing them over", l_fds.size()));
+		// our copies go either way, they're no longer being served
+		for (int l_fd : l_fds)
+			remove_client(l_fd);
+		l_payload.clear();
+		l_fds.clear();
+	};
+	for (int l_fd : l_clients) {
+		client_rec *l_client = m_clients.acquire(l_fd);
+		if (l_client == nullptr)
+			continue;
+		serialize_client(l_payload, l_fd, *l_client);
+		m_clients.release(l_fd);
+		l_fds.push_back(l_fd);
+		if (l_fds.size() == ss::net::fd_handoff::MAX_FDS)
+			l_send();
+	}
+	l_send();
+	return l_moved;
+}
+
+void server_base::serialize_client(std::string& a_to, int client_sockfd, client_rec& a_rec)
+{
+	// caller holds the client's shard. The output queue is emptied, it isn't ours to send any more.
+	ss::net::fd_handoff::put(a_to, std::uint64_t(a_rec.m_family));
+	if (a_rec.m_family == AF_INET)
+		ss::net::fd_handoff::put(a_to, std::string((const char *)&a_rec.m_sockaddr_in, sizeof(a_rec.m_sockaddr_in)));
+	else
+		ss::net::fd_handoff::put(a_to, std::string((const char *)&a_rec.m_sockaddr_un, sizeof(a_rec.m_sockaddr_un)));
+	ss::net::fd_handoff::put(a_to, std::uint64_t(a_rec.m_auth_state));
+	ss::net::fd_handoff::put(a_to, a_rec.m_auth_username);
+	ss::net::fd_handoff::put(a_to, a_rec.m_auth_challenge_pack.username);
+	ss::net::fd_handoff::put(a_to, a_rec.m_auth_challenge_pack.session);
+	ss::net::fd_handoff::put(a_to, a_rec.m_auth_challenge_pack.expected_response);
+	ss::net::fd_handoff::put(a_to, std::bit_cast<std::uint64_t>(double(a_rec.m_connect_time)));
+	// input: commands read but not run yet, then whatever hasn't made a whole line so far
+	std::string l_input = unprocessed_input(client_sockfd, a_rec);
+	struct iovec l_iov[WRITEV_MAX_SEGMENTS];
+	int l_segs = a_rec.m_in_circbuff.data_segments(l_iov);
+	for (int i = 0; i < l_segs; ++i)
+		l_input.append((const char *)l_iov[i].iov_base, l_iov[i].iov_len);
+	ss::net::fd_handoff::put(a_to, l_input);
+	std::string l_output;
+	while (!a_rec.m_out_queue.empty()) {
+		int l_count = a_rec.m_out_queue.gather(l_iov, WRITEV_MAX_SEGMENTS);
+		std::size_t l_len = 0;
+		for (int i = 0; i < l_count; ++i) {
+			l_output.append((const char *)l_iov[i].iov_base, l_iov[i].iov_len);
+			l_len += l_iov[i].iov_len;
+		}
+		a_rec.m_out_queue.consume(l_len);
+	}
+	ss::net::fd_handoff::put(a_to, l_output);
+}
+
+void server_base::finish_upgrade()
+{
+	if (!m_handoff)
+		return;
+	std::unique_ptr<ss::net::fd_handoff> l_handoff = std::move(m_handoff);
+	if (!l_handoff->send(ss::net::fd_handoff::HANDOFF_READY, "", {})) {
+		ctx.log_p(ss::log::NOTICE, "upgrade: lost the server we're replacing, carrying on without its clients");
+		return;
+	}
+	// the old server stops accepting as soon as it hears from us, then sends its clients a
+	// batch at a time. They're set up on reactor 0, like clients we accepted ourselves.
+	std::size_t l_adopted = 0;
+	while (1) {
+		ss::net::fd_handoff::message_type l_type;
+		std::string l_payload;
+		std::vector<int> l_fds;
+		if (!l_handoff->receive(l_type, l_payload, l_fds, HANDOFF_TIMEOUT_MS)) {
+			ctx.log_p(ss::log::NOTICE, "upgrade: lost the server we're replacing part way through");
+			break;
+		}
+		if (l_type == ss::net::fd_handoff::HANDOFF_END)
+			break;
+		if (l_type != ss::net::fd_handoff::HANDOFF_CLIENTS) {
+			for (int l_fd : l_fds)
+				close(l_fd);
+			continue;
+		}
+		std::promise<std::size_t> l_done;
+		post(0, [&]() {
+			ss::net::fd_handoff::reader l_reader(l_payload);
+			std::size_t l_count = 0;
+			for (int l_fd : l_fds)
+				if (adopt_client(l_fd, l_reader))
+					++l_count;
+			l_done.set_value(l_count);
+		});
+		l_adopted += l_done.get_future().get();
+	}
+	ctx.log_p(ss::log::NOTICE, std::format("upgrade: complete, took over {} clients", l_adopted));
+}
+
+bool server_base::adopt_client(int client_sockfd, ss::net::fd_handoff::reader& a_reader)
+{
+	// reactor 0 only
+	sa_family_t l_family = a_reader.get_u64();
+	std::string l_addr = a_reader.get_string();
+	struct sockaddr_storage l_storage;
+	memset(&l_storage, 0, sizeof(l_storage));
+	memcpy(&l_storage, l_addr.data(), std::min(l_addr.size(), sizeof(l_storage)));
+	l_storage.ss_family = l_family;
+	client_rec l_rec;
+	init_client_rec(l_rec, (struct sockaddr *)&l_storage, -1);
+	l_rec.m_auth_state = auth_state(a_reader.get_u64());
+	l_rec.m_auth_username = a_reader.get_string();
+	l_rec.m_auth_challenge_pack.username = a_reader.get_string();
+	l_rec.m_auth_challenge_pack.session = a_reader.get_string();
+	l_rec.m_auth_challenge_pack.expected_response = a_reader.get_string();
+	l_rec.m_connect_time = ss::doubletime(std::bit_cast<double>(a_reader.get_u64()));
+	std::string l_input = a_reader.get_string();
+	std::string l_output = a_reader.get_string();
+	if (!a_reader.ok() || (l_rec.m_auth_state > auth_state::AUTH_STATE_LOGGED_ON)) {
+		ctx.log_p(ss::log::ERR, std::format("upgrade: state for fd {} is garbled, dropping the client", client_sockfd));
+		close(client_sockfd);
+		return false;
+	}
+	if ((l_rec.m_auth_state == auth_state::AUTH_STATE_LOGGED_ON) && !force_authenticate(l_rec.m_auth_username)) {
+		ctx.log_p(ss::log::WARNING, std::format("upgrade: user {} on fd {} is unknown to us, they'll have to log on again", l_rec.m_auth_username, client_sockfd));
+		l_rec.m_auth_state = auth_state::AUTH_STATE_AWAIT_USERNAME;
+		l_rec.m_auth_username = "";
+	}
+	if (!l_input.empty())
+		l_rec.m_in_circbuff.write((const std::uint8_t *)l_input.data(), l_input.size());
+	if (install_client(client_sockfd, l_rec) == -1)
+		return false;
+	
+	// what the old server hadn't sent yet goes first, then whatever it had read but not run
+	if (!l_output.empty()) {
+		client_rec *l_client = m_clients.acquire(client_sockfd);
+		if (l_client != nullptr) {
+			enqueue_output(client_sockfd, *l_client, l_output, false);
+			bool l_ok = flush_client(client_sockfd, *l_client);
+			m_clients.release(client_sockfd);
+			if (!l_ok) {
+				remove_client(client_sockfd);
+				return false;
+			}
+		}
+	}
+	if (!l_input.empty()) {
+		unsigned int l_reactor = l_rec.m_reactor;
+		post(l_reactor, [this, l_reactor, client_sockfd]() {
+			reactor& l_r = *m_reactors[l_reactor];
+			l_r.m_input_hints.insert(client_sockfd);
+			serve(l_r);
+		});
+	}
+	switch (l_rec.m_family) {
+		case AF_INET:
+			ctx.log_p(ss::log::INFO, std::format("took over TCP client fd: {} ({}) connected at: {}", client_sockfd, ip_str(&l_rec.m_sockaddr_in), l_rec.m_connect_time.iso8601_ms()));
+			break;
+		case AF_UNIX:
+			ctx.log_p(ss::log::INFO, std::format("took over UNIX client fd: {} ({}) connected at: {}", client_sockfd, un_str(&l_rec.m_sockaddr_un), l_rec.m_connect_time.iso8601_ms()));
+			break;
+	}
+	return true;
+}
+
+void server_base::wake_drain()
+{
+	// the eventfd stays readable until drain_clients() reads it, so a wakeup between its check
+	// and its poll() isn't lost
+	std::uint64_t l_one = 1;
+	write(m_drain_wakefd, &l_one, sizeof(l_one));
+}
+
+void server_base::drain_clients()
+{
+	// after upgrade(): whoever is still connected to us is served until they leave
+	auto l_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(m_upgrade_drain_timeout);
+	while ((m_clients.size() > 0) && !m_request_down) {
+		auto l_left = std::chrono::duration_cast<std::chrono::milliseconds>(l_deadline - std::chrono::steady_clock::now()).count();
+		if (l_left <= 0)
+			break;
+		struct pollfd l_pfd = { m_drain_wakefd, POLLIN, 0 };
+		if (poll(&l_pfd, 1, int(std::min<long long>(l_left, INT_MAX))) > 0) {
+			std::uint64_t l_count;
+			read(m_drain_wakefd, &l_count, sizeof(l_count));
+		}
+	}
+	ctx.log_p(ss::log::NOTICE, std::format("upgrade: drained, {} clients left", m_clients.size()));
+}
+
 } // namespace net
 } // namespace ss
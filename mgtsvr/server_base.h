@@ -7,6 +7,7 @@
 #include <stdexcept>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <chrono>
 #include <format>
 #include <map>
@@ -14,6 +15,13 @@
 #include <array>
 #include <cstdint>
 #include <atomic>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <filesystem>
+#include <future>
+#include <latch>
+#include <bit>
 
 #include <stdio.h>
 #include <unistd.h>
@@ -21,17 +29,32 @@
 #include <signal.h>
 #include <errno.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/epoll.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <sys/utsname.h>
+#include <sys/wait.h>
 
 #include "icr.h"
 #include "auth.h"
+#include "circbuff.h"
+#include "out_queue.h"
+#include "fd_table.h"
+#include "uring.h"
+#include "timer_wheel.h"
+#include "admission.h"
+#include "histogram.h"
+#include "stats_listener.h"
 #include "esr.h"
 #include "log.h"
 #include "doubletime.h"
 #include "dispatchable.h"
+#include "fd_handoff.h"
 
 namespace ss {
 namespace net {
@@ -44,18 +67,66 @@ public:
 	server_base(const std::string& a_category);
 	virtual ~server_base();
 	virtual void shutdown();
+	// apply the category's keys again from the ini, as re-read by the caller, without touching
+	// listeners or connections. Only keys that are safe to change under live clients are taken
+	// (auth_policy here), the rest keep their values until a restart. Clears a pending HUP
+	// request. False if a key was invalid, its old value is kept then.
+	virtual bool reload();
 	bool request_down() { return m_request_down; }
 	bool request_hup() { return m_request_hup; }
+	// down/HUP requests can come from commands or signal handlers, the main thread sleeps in
+	// wait_for_request() until one arrives
+	void post_down_request() { raise_request(m_request_down); }
+	void post_hup_request() { raise_request(m_request_hup); }
+	void post_upgrade_request() { raise_request(m_request_upgrade); }
+	bool request_upgrade() { return m_request_upgrade; }
+	void wait_for_request();
+	// zero downtime upgrade. upgrade() runs the binary we were started from again, with the
+	// arguments given (ours, normally), and passes it our listening sockets over a UNIX socket.
+	// With upgrade_connections set (epoll only) the clients go across as well, along with
+	// their login state and whatever input and output was still pending for them; otherwise
+	// they stay with us until they leave. Returns true once the successor is accepting, after
+	// which the caller should drain_clients() and shut down; false if it never came up, and
+	// we carry on as before.
+	virtual bool upgrade(char **a_argv);
+	void drain_clients(); // until they've all gone, upgrade_drain_timeout runs out, or a DOWN
+	// in the successor, once constructed: tell the old server we're up and take over its
+	// clients. Does nothing unless we were started by upgrade().
+	void finish_upgrade();
+	static const char *HANDOFF_ENV; // names the successor's end of the handoff socket
+	const static int HANDOFF_TIMEOUT_MS = 10000; // for the successor to come up, or the next message
 	virtual bool dispatch();
 	void setup_server_tcp();
 	void setup_server_un();
 	virtual void newly_accepted_client(int client_sockfd) = 0;
 	virtual void data_from_client(int client_sockfd) = 0;
+	virtual void input_served() { } // a reactor pass has been through data_from_client() for all its clients with input
 	
-	const static std::uint32_t DRAIN_BUFFER_SIZE = 16384;
-	const static std::uint32_t WRITE_CHUNK_SIZE = 4096;
+	const static std::uint32_t DRAIN_BUFFER_SIZE = 16384; // free space guaranteed at the input buffer's tail before each readv
+	const static std::uint32_t READ_BUDGET = 262144; // epoll: bytes read from a client per pass, the rest waits for the next one
+	const static std::size_t DEFAULT_INPUT_MAX = 1048576; // most of an unfinished line we hold for a client
+	const static int WRITEV_MAX_SEGMENTS = 64; // iovecs handed to the kernel per sendmsg() call
+	const static std::uint32_t CLIENT_EPOLL_EVENTS = EPOLLIN | EPOLLHUP | EPOLLRDHUP | EPOLLET;
+	const static unsigned int URING_ENTRIES = 4096; // submission queue depth per reactor
+	const static unsigned int URING_BUFFERS = 512; // provided receive buffers per reactor
+	const static unsigned int URING_BUFFER_SIZE = 16384;
+	const static std::uint16_t URING_BUFFER_GROUP = 1;
+	const static std::uint32_t TIMER_TICK_MS = 100; // resolution of connection timeouts
+	const static std::uint32_t DEFAULT_LINGER_MS = 2000; // closing clients get this long to take their output and hang up
+	const static std::uint32_t ACCEPT_BACKOFF_MS = 100; // out of descriptors: listeners rest this long before accepting again
+	const static std::size_t FAN_OUT_SHARDS_PER_PASS = 8; // client table shards a reactor sweeps before looking at its I/O again
 	
 protected:
+	enum io_backend {
+		IO_BACKEND_EPOLL,
+		IO_BACKEND_URING
+	};
+	
+	enum cap_policy {
+		CAP_POLICY_DROP, // output that would go over the cap is discarded
+		CAP_POLICY_DISCONNECT // the client is dropped instead
+	};
+	
 	enum auth_state {
 		AUTH_STATE_NOAUTH,
 		AUTH_STATE_AWAIT_USERNAME,
@@ -65,6 +136,8 @@ protected:
 	};
 	
 	struct client_rec {
+		unsigned int m_reactor; // index of the reactor that owns this fd
+		std::uint32_t m_serial; // tells apart successive clients that were given the same fd
 		auth_state m_auth_state;
 		std::string m_auth_username;
 		challenge_pack m_auth_challenge_pack;
@@ -72,24 +145,262 @@ protected:
 		struct sockaddr_in m_sockaddr_in;
 		struct sockaddr_un m_sockaddr_un;
 		ss::doubletime m_connect_time;
-		ss::data m_in_circbuff;
-		ss::data m_out_circbuff;
+		ss::net::circbuff m_in_circbuff;
+		ss::net::out_queue m_out_queue;
+		bool m_epollout; // EPOLLOUT armed because the kernel send buffer filled up
+		bool m_send_posted; // io_uring: reactor has been asked to send, or has a send in flight
+		bool m_recv_armed; // io_uring: a multishot receive is outstanding for this client
+		// timeouts, all in timer ticks. The deadlines are worked out from these when a timer
+		// fires, so activity only has to touch a field and never the timer wheel.
+		std::uint64_t m_connect_tick;
+		std::uint64_t m_last_input;
+		std::uint64_t m_stall_since; // output pending without progress since, 0 = not stalled
+		std::uint64_t m_timer_at; // tick of the wheel entry that's due to look at us, 0 = none
+		std::uint64_t m_linger_until; // closing: removed at this tick whether its output has gone or not, 0 = not closing
+		bool m_linger_shut; // closing, all output is with the kernel and our side is shut down
+		std::uint64_t m_input_ns; // when input last arrived, for command latencies (histogram::now_ns())
+		// output backpressure
+		std::size_t m_out_accounted; // our share of m_out_total
+		bool m_read_paused; // too much output queued, input is left in the kernel until it drains
+		bool m_out_closed; // hit the hard cap under the disconnect policy, removal is on its way
+		int m_admission_slot; // slot counting us in the admission table, -1 = none
 	};
 
 	ss::log::ctx& ctx = ss::log::ctx::get();
 	std::string m_category;
-	int m_auth_policy;
+	std::atomic<int> m_auth_policy; // may change on reload()
 	ss::doubletime m_uptime;
 	std::atomic<bool> m_request_down;
 	std::atomic<bool> m_request_hup;
+	std::atomic<bool> m_request_upgrade;
+	std::atomic<std::uint32_t> m_request_seq; // bumped on every request, wait_for_request() sleeps on it
+	void raise_request(std::atomic<bool>& a_request);
+	io_backend m_io_backend;
+	
+	// I/O counters, published into the esr tree by publish_stats()
+	struct io_stats {
+		std::atomic<std::uint64_t> m_read_wakeups{0}; // EPOLLIN events serviced
+		std::atomic<std::uint64_t> m_read_calls{0}; // readv() calls made while draining
+		std::atomic<std::uint64_t> m_read_bytes{0};
+		std::atomic<std::uint64_t> m_copied_bytes{0}; // input bytes memcpy'd in user space (framing included)
+		std::atomic<std::uint64_t> m_write_wakeups{0}; // EPOLLOUT events serviced
+		std::atomic<std::uint64_t> m_write_calls{0}; // sendmsg() calls made while flushing
+		std::atomic<std::uint64_t> m_write_bytes{0};
+		std::atomic<std::uint64_t> m_epollout_arms{0}; // times a full send buffer made us arm EPOLLOUT
+		std::atomic<std::uint64_t> m_sq_full{0}; // io_uring: sends put off because the submission queue was full
+		std::atomic<std::uint64_t> m_login_timeouts{0};
+		std::atomic<std::uint64_t> m_idle_timeouts{0};
+		std::atomic<std::uint64_t> m_stall_timeouts{0};
+		std::atomic<std::uint64_t> m_linger_closes{0};
+		std::atomic<std::uint64_t> m_linger_timeouts{0}; // closing clients that didn't take their output or hang up in time
+		std::atomic<std::uint64_t> m_read_pauses{0}; // clients that went over their high water mark
+		std::atomic<std::uint64_t> m_read_resumes{0};
+		std::atomic<std::uint64_t> m_global_pressure{0}; // times the total went over the global high water mark
+		std::atomic<std::uint64_t> m_cap_drops{0}; // writes discarded at the hard cap
+		std::atomic<std::uint64_t> m_cap_disconnects{0};
+		std::atomic<std::uint64_t> m_input_overruns{0}; // clients disconnected for a line longer than input_max
+		std::atomic<std::uint64_t> m_accepts{0};
+		std::atomic<std::uint64_t> m_accept_wakeups{0}; // epoll: listener readiness events serviced
+		std::atomic<std::uint64_t> m_accept_backoffs{0}; // times the listeners rested for want of descriptors
+		std::atomic<std::uint64_t> m_rejects_rate{0}; // connections refused by the per address rate limit
+		std::atomic<std::uint64_t> m_rejects_connections{0}; // refused by the per address connection cap
+		std::atomic<std::uint64_t> m_admission_table_full{0}; // let in unchecked, no room to track the address
+	};
+	io_stats m_io_stats;
+	ss::doubletime m_last_publish;
+	std::uint64_t m_last_accepts; // at m_last_publish, for the accept rate
+	std::mutex m_publish_mtx;
+	void publish_stats(); // caller holds m_publish_mtx
+	void housekeeping();
+	// statistics kept by derived classes: each source is run by publish_stats() to put its
+	// own values into the esr tree. Sources must not take client locks.
+	std::vector<std::function<void()>> m_stats_sources;
+	void add_stats_source(std::function<void()> a_source);
+	// freshly published statistics, rendered for /STATS and for the scrape listener
+	std::string stats_text();
+	std::string stats_exposition();
+	std::unique_ptr<ss::net::stats_listener> m_stats_listener; // null unless stats_port is set
+	
+	// io_uring completions are routed on user_data: op in the top byte, client serial, then fd
+	enum uring_op {
+		URING_OP_ACCEPT = 1,
+		URING_OP_RECV,
+		URING_OP_SEND,
+		URING_OP_WAKE,
+		URING_OP_PROVIDE,
+		URING_OP_CANCEL
+	};
+	
+	struct send_op {
+		std::string m_copy; // owned bytes copied out of the client's queue for the duration of the send
+		std::vector<std::shared_ptr<const std::string>> m_refs; // attached payloads pinned for the same
+		std::vector<struct iovec> m_iov;
+		struct msghdr m_msg;
+	};
+	
+	// per-reactor state. Reactor 0 runs on our own dispatchable thread and also owns the
+	// listening sockets; reactors 1..N-1 each run on a reactor_thread of their own.
+	struct reactor {
+		unsigned int m_index;
+		int m_epollfd;
+		std::set<int> m_input_hints; // fd's owned by this reactor with input data waiting to be processed (reactor thread only)
+		std::map<int, std::uint32_t> m_drain_hints; // epoll: clients (by serial) that ran out of read budget with more in the kernel (reactor thread only)
+		std::atomic<bool> m_halting; // don't block any more, the dispatch thread is about to be halted
+		// other threads hand work to the reactor through its mailbox and poke the eventfd
+		int m_wakefd;
+		std::uint64_t m_wake_buf;
+		std::mutex m_mailbox_mtx;
+		std::vector<std::function<void()>> m_mailbox;
+		// io_uring backend (reactor thread only)
+		std::unique_ptr<std::uint8_t[]> m_ring_buffers;
+		std::map<std::uint64_t, std::unique_ptr<send_op>> m_sends; // in flight, keyed by user_data
+		std::map<int, std::uint32_t> m_send_retries; // clients (by serial) whose send found the submission queue full
+		// connection timeouts for the clients this reactor owns (reactor thread only)
+		ss::net::timer_wheel m_timers{TIMER_TICK_MS};
+		std::vector<ss::net::timer_wheel::entry> m_expired;
+		std::unique_ptr<ss::net::uring> m_ring; // declared last so it goes first, before the memory it points at
+	};
+	
+	class reactor_thread : public ss::ccl::dispatchable {
+	public:
+		reactor_thread(server_base& a_server, unsigned int a_index);
+		virtual ~reactor_thread();
+		virtual bool dispatch();
+	protected:
+		server_base& m_server;
+		unsigned int m_index;
+	};
 	
 	// server functions
-	void set_epollout_for_fd(int a_fd);
+	bool run_reactor(reactor& a_reactor);
+	bool run_reactor_epoll(reactor& a_reactor);
+	bool run_reactor_uring(reactor& a_reactor);
+	void post(unsigned int a_reactor, std::function<void()> a_task);
+	void run_mailbox(reactor& a_reactor);
+	void wake(reactor& a_reactor);
+	void set_epollout_for_fd(int a_fd, unsigned int a_reactor, bool a_enable);
+	bool flush_client(int client_sockfd, client_rec& a_rec);
 	void flushout(int client_sockfd);
-	void serve();
-	void drain_socket(int client_sockfd);
-	int accept_client(int a_server_fd);
-	void remove_client(int client_sockfd);
+	void serve(reactor& a_reactor);
+	bool drain_socket(int client_sockfd, std::uint32_t a_serial = 0); // a_serial != 0 only drains that particular client
+	void accept_clients(int a_server_fd);
+	// out of descriptors: rather than have the listener fire again straight away, it's disarmed and
+	// goes on reactor 0's timer wheel under serial 0 (no client has it) for ACCEPT_BACKOFF_MS.
+	// Reactor 0 only, as is m_accept_stopped, set once stop_accepting() has taken the listeners away.
+	static bool accept_exhausted(int a_errno);
+	void pause_accepting(int a_server_fd, int a_errno);
+	void resume_accepting(int a_server_fd);
+	bool m_accept_stopped = false;
+	bool admit_client(int client_sockfd, const struct sockaddr *a_addr, int& a_slot);
+	int register_client(int client_sockfd, const struct sockaddr *a_addr, int a_admission_slot = -1);
+	void remove_client(int client_sockfd, std::uint32_t a_serial = 0); // a_serial != 0 only removes that particular client
+	// lingering close, from any thread: the client's input is ignored from here on and no more
+	// output is taken. Once what's queued has gone to the kernel our side is shut down, and the
+	// client is removed when it hangs up or m_linger_timeout runs out, whichever comes first.
+	void close_client(int client_sockfd, std::uint32_t a_serial = 0);
+	void linger_drained(int client_sockfd, client_rec& a_rec);
+	virtual void client_removed(int client_sockfd, const client_rec& a_rec) { } // from remove_client(), caller holds the client's shard
+	void init_client_rec(client_rec& a_rec, const struct sockaddr *a_addr, int a_admission_slot);
+	// reactor 0 only: give it a reactor and a serial and start serving it, after
+	// newly_accepted_client() if a_greet is set
+	int install_client(int client_sockfd, client_rec& a_rec, bool a_greet = false);
+	
+	// upgrade
+	std::string m_exe_path; // resolved at startup: the binary now at that path is the one upgrade() runs
+	bool m_upgrade_connections;
+	std::uint64_t m_upgrade_drain_timeout; // seconds
+	std::unique_ptr<ss::net::fd_handoff> m_handoff; // successor only, to the old server until finish_upgrade()
+	// drain_clients() sleeps on this eventfd, poked by the last client leaving or by a request.
+	// A write() is all it takes, so raise_request() stays safe to call from a signal handler.
+	int m_drain_wakefd = -1;
+	void wake_drain();
+	void listen_on(int a_fd, const std::string& a_caller); // hand a listener to reactor 0
+	int adopt_listeners(); // returns the stats listener's socket, -1 if none came across
+	void stop_accepting();
+	std::size_t hand_over_clients(ss::net::fd_handoff& a_handoff);
+	void serialize_client(std::string& a_to, int client_sockfd, client_rec& a_rec);
+	bool adopt_client(int client_sockfd, ss::net::fd_handoff::reader& a_reader); // reactor 0 only
+	// subclass hooks for handing clients over: quiesce() stops anything that could touch a
+	// client from here on (commands running), and unprocessed_input() gives back, as raw
+	// input, what was read from a client but not acted on yet. Caller holds the client's shard.
+	virtual void quiesce() { }
+	virtual std::string unprocessed_input(int client_sockfd, const client_rec& a_rec) { return ""; }
+	
+	// listening socket tuning. Accepted sockets inherit these from the listener, so there's
+	// nothing to set per connection.
+	int m_listen_backlog;
+	bool m_tcp_nodelay;
+	int m_tcp_defer_accept; // seconds, 0 = off
+	int m_socket_sndbuf; // bytes, 0 = kernel default
+	int m_socket_rcvbuf;
+	bool m_tcp_keepalive;
+	int m_tcp_keepidle; // seconds, 0 = kernel default
+	int m_tcp_keepintvl;
+	int m_tcp_keepcnt;
+	void tune_listener(int a_fd, bool a_tcp);
+	std::unique_ptr<ss::net::admission> m_admission; // per address admission control, null if disabled
+	
+	// connection timeouts
+	std::uint64_t m_login_timeout; // in ticks, 0 = disabled
+	std::uint64_t m_idle_timeout;
+	std::uint64_t m_stall_timeout;
+	std::uint64_t m_linger_timeout; // at least one tick
+	std::uint64_t next_deadline(const client_rec& a_rec);
+	void request_timer(int client_sockfd, const client_rec& a_rec);
+	void schedule_timer(reactor& a_reactor, int client_sockfd, client_rec& a_rec);
+	void track_output_stall(int client_sockfd, client_rec& a_rec, bool a_progress);
+	void run_timers(reactor& a_reactor);
+	void expire_client(reactor& a_reactor, const ss::net::timer_wheel::entry& a_entry);
+	
+	// output backpressure. Per client: reading pauses above the high water mark and resumes at
+	// or below the low one. While the total queued for all clients is over the global high water
+	// mark (until it's back to the global low one), the low mark is used for pausing as well.
+	// Crossing the global mark sends reactor 0 round all the clients, so those already over the
+	// low mark pause too rather than only when their queue next changes.
+	std::size_t m_out_high; // bytes, 0 = disabled
+	std::size_t m_out_low;
+	std::size_t m_out_hard_cap;
+	std::size_t m_global_high;
+	std::size_t m_global_low;
+	cap_policy m_cap_policy;
+	bool m_pause_commands; // also hold back commands already read from a paused client
+	std::atomic<std::int64_t> m_out_total;
+	std::atomic<bool> m_global_pressure;
+	std::size_t m_in_max; // bytes of a line still coming in that we hold for a client, 0 = unlimited
+	// queue output, subject to the hard cap. Caller holds the client's shard. Strings are
+	// followed by a newline unless a_delimit is false.
+	bool enqueue_output(int client_sockfd, client_rec& a_rec, const std::string& a_string, bool a_delimit = true);
+	bool enqueue_output(int client_sockfd, client_rec& a_rec, std::shared_ptr<const std::string> a_payload);
+	bool admit_output(int client_sockfd, client_rec& a_rec, std::size_t a_len);
+	void account_output(int client_sockfd, client_rec& a_rec);
+	void pause_reading(int client_sockfd, client_rec& a_rec);
+	void resume_reading(int client_sockfd, client_rec& a_rec);
+	void adjust_out_total(std::int64_t a_delta);
+	void pressure_sweep(std::size_t a_shard); // reactor 0, a few shards per pass
+	
+	// fan-out: queue one shared payload on every client a_filter accepts (all of them if it's
+	// empty). The client table is split between the reactors, each sweeping its part a few shards
+	// at a time from its mailbox, so fan_out() returns straight away. a_done gets the number of
+	// clients reached, on whichever reactor finishes last.
+	typedef std::function<bool(int, const client_rec&)> fan_out_filter;
+	struct fan_out_state {
+		std::shared_ptr<const std::string> m_payload;
+		fan_out_filter m_filter;
+		std::function<void(std::size_t)> m_done;
+		std::atomic<std::size_t> m_reached{0};
+		std::atomic<unsigned int> m_sweeps{0}; // reactors still sweeping
+	};
+	void fan_out(std::shared_ptr<const std::string> a_payload, fan_out_filter a_filter, std::function<void(std::size_t)> a_done);
+	void fan_out_sweep(std::shared_ptr<fan_out_state> a_state, unsigned int a_reactor, std::size_t a_shard, std::size_t a_end);
+	
+	// io_uring backend
+	static std::uint64_t uring_data(uring_op a_op, int a_fd, std::uint32_t a_serial);
+	void uring_setup(reactor& a_reactor);
+	void uring_arm_accept(int a_server_fd);
+	void uring_arm_recv(reactor& a_reactor, int client_sockfd, std::uint32_t a_serial);
+	void uring_arm_wake(reactor& a_reactor);
+	void uring_send(reactor& a_reactor, int client_sockfd, std::uint32_t a_serial);
+	void uring_completion(reactor& a_reactor, struct io_uring_cqe *a_cqe, bool& a_did_input);
 	std::string ip_str(const struct sockaddr_in *a_addr);
 	std::string un_str(const struct sockaddr_un *a_addr);
 	
@@ -98,14 +409,16 @@ protected:
 	struct sockaddr_in m_server_address;
 	int m_server_sockfd_un;
 	struct sockaddr_un m_server_address_un;
-	int m_epollfd;
 	
-	// these exist so we don't have to iterate the whole client_list to see if we have data waiting on a particular fd
-	std::set<int> m_input_hints; // list of fd's with input data waiting to be processed
+	// reactors
+	unsigned int m_reactor_count;
+	unsigned int m_next_reactor; // round robin cursor for handing accepted clients to reactors, only touched by reactor 0
+	std::uint32_t m_next_serial; // only touched by reactor 0
+	std::vector<std::unique_ptr<reactor>> m_reactors;
+	std::vector<std::unique_ptr<reactor_thread>> m_reactor_threads;
 
-	// the client list and her mutex
-	std::map<int, client_rec> m_client_list;
-	std::mutex m_client_list_mtx;
+	// the client table, sharded and indexed by fd
+	ss::net::fd_table<client_rec> m_clients;
 };
 
 } // namespace net
@@ -0,0 +1,111 @@
+#include "stats_listener.h"
+
+namespace ss {
+namespace net {
+
+stats_listener::stats_listener(const std::string& a_name, const std::string& a_address, int a_port, std::function<std::string()> a_render)
+: ss::ccl::dispatchable(a_name)
+, m_fd(-1)
+, m_render(a_render)
+{
+	struct sockaddr_in l_addr;
+	memset(&l_addr, 0, sizeof(l_addr));
+	l_addr.sin_family = AF_INET;
+	l_addr.sin_port = htons(a_port);
+	if (inet_pton(AF_INET, a_address.c_str(), &l_addr.sin_addr) != 1) {
+		ctx.log_p(ss::log::NOTICE, std::format("stats_listener: {} is not an IPv4 address, exiting!", a_address));
+		throw std::runtime_error("stats_listener: invalid listening address, exiting!");
+	}
+	m_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (m_fd == -1) {
+		ctx.log_p(ss::log::NOTICE, "stats_listener: socket() call failed, exiting!");
+		throw std::runtime_error("stats_listener: socket() call failed, exiting!");
+	}
+	int l_reuse = 1;
+	setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &l_reuse, sizeof(l_reuse));
+	if ((bind(m_fd, (struct sockaddr *)&l_addr, sizeof(l_addr)) != 0) || (listen(m_fd, 16) != 0)) {
+		ctx.log_p(ss::log::NOTICE, std::format("stats_listener: unable to listen on {}:{}, errno = {} ({}), exiting!", a_address, a_port, errno, strerror(errno)));
+		close(m_fd);
+		throw std::runtime_error("stats_listener: unable to listen, exiting!");
+	}
+	ctx.log_p(ss::log::INFO, std::format("stats_listener: serving statistics on {}:{}", a_address, a_port));
+}
+
+stats_listener::stats_listener(const std::string& a_name, int a_fd, std::function<std::string()> a_render)
+: ss::ccl::dispatchable(a_name)
+, m_fd(a_fd)
+, m_render(a_render)
+{
+	ctx.log_p(ss::log::INFO, std::format("stats_listener: serving statistics on fd {}, taken over", a_fd));
+}
+
+stats_listener::~stats_listener()
+{
+	if (m_fd != -1)
+		close(m_fd);
+}
+
+bool stats_listener::dispatch()
+{
+	struct pollfd l_pfd;
+	l_pfd.fd = m_fd;
+	l_pfd.events = POLLIN;
+	l_pfd.revents = 0;
+	if (poll(&l_pfd, 1, POLL_MS) <= 0)
+		return true;
+	int l_fd = accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+	if (l_fd == -1)
+		return true;
+	struct timeval l_tv;
+	l_tv.tv_sec = IO_TIMEOUT_MS / 1000;
+	l_tv.tv_usec = (IO_TIMEOUT_MS % 1000) * 1000;
+	setsockopt(l_fd, SOL_SOCKET, SO_RCVTIMEO, &l_tv, sizeof(l_tv));
+	setsockopt(l_fd, SOL_SOCKET, SO_SNDTIMEO, &l_tv, sizeof(l_tv));
+	serve(l_fd);
+	close(l_fd);
+	return true;
+}
+
+void stats_listener::serve(int a_fd)
+{
+	// read the request head, we only care about its first line
+	std::string l_request;
+	char l_buf[1024];
+	while ((l_request.find("\r\n\r\n") == std::string::npos) && (l_request.find("\n\n") == std::string::npos) && (l_request.size() < MAX_REQUEST)) {
+		ssize_t l_len = recv(a_fd, l_buf, sizeof(l_buf), 0);
+		if (l_len <= 0)
+			break;
+		l_request.append(l_buf, l_len);
+	}
+	std::string l_line = l_request.substr(0, l_request.find_first_of("\r\n"));
+	std::string l_status = "200 OK";
+	std::string l_body;
+	if (l_line.compare(0, 4, "GET ") != 0) {
+		l_status = "405 Method Not Allowed";
+		l_body = "only GET is supported\n";
+	} else {
+		std::string l_path = l_line.substr(4, l_line.find(' ', 4) - 4);
+		if ((l_path == "/") || (l_path == "/metrics")) {
+			l_body = m_render();
+		} else {
+			l_status = "404 Not Found";
+			l_body = "try /metrics\n";
+		}
+	}
+	send_all(a_fd, std::format("HTTP/1.0 {}\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}", l_status, l_body.size(), l_body));
+}
+
+bool stats_listener::send_all(int a_fd, const std::string& a_data)
+{
+	std::size_t l_sent = 0;
+	while (l_sent < a_data.size()) {
+		ssize_t l_len = send(a_fd, a_data.data() + l_sent, a_data.size() - l_sent, MSG_NOSIGNAL);
+		if (l_len <= 0)
+			return false;
+		l_sent += l_len;
+	}
+	return true;
+}
+
+} // namespace net
+} // namespace ss
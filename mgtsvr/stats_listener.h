@@ -0,0 +1,53 @@
+#ifndef STATS_LISTENER_H
+#define STATS_LISTENER_H
+
+#include <string>
+#include <functional>
+#include <stdexcept>
+#include <format>
+#include <cstring>
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "dispatchable.h"
+#include "log.h"
+
+namespace ss {
+namespace net {
+
+// scrape endpoint for the server's statistics: a TCP listener on a thread of its own that
+// answers each HTTP GET with whatever a_render returns, as text/plain, and closes the
+// connection. Requests are served one at a time, so it stays out of the reactors' way and a
+// scraper can never hold up a client.
+
+class stats_listener : public ss::ccl::dispatchable {
+public:
+	stats_listener(const std::string& a_name, const std::string& a_address, int a_port, std::function<std::string()> a_render);
+	// takes over a socket that is already listening, handed over by the server we're replacing
+	stats_listener(const std::string& a_name, int a_fd, std::function<std::string()> a_render);
+	virtual ~stats_listener();
+	virtual bool dispatch();
+	int fd() const { return m_fd; }
+
+	const static int POLL_MS = 250; // how long dispatch() blocks, bounds how long halt() takes
+	const static int IO_TIMEOUT_MS = 1000; // per request, for reading it and writing the reply
+	const static std::size_t MAX_REQUEST = 4096;
+
+protected:
+	void serve(int a_fd);
+	bool send_all(int a_fd, const std::string& a_data);
+
+	ss::log::ctx& ctx = ss::log::ctx::get();
+	int m_fd;
+	std::function<std::string()> m_render;
+};
+
+} // namespace net
+} // namespace ss
+
+#endif // STATS_LISTENER_H
@@ -2,11 +2,28 @@
 #include <thread>
 #include <chrono>
 #include <memory>
+#include <atomic>
+
+#include <signal.h>
 
 #include "log.h"
 #include "fs.h"
 #include "fortune_server.h"
 
+// the failure services don't cover SIGUSR2, so it gets a handler of its own. It's installed
+// before the server exists, a signal that comes in that early is held until the server is up.
+// Posting a request only touches atomics and an eventfd, which is safe in a signal handler.
+static std::atomic<fortune_server *> g_server{nullptr};
+static std::atomic<bool> g_usr2_pending{false};
+
+static void usr2_handler(int a_signal)
+{
+	g_usr2_pending = true;
+	fortune_server *l_server = g_server.load();
+	if (l_server != nullptr)
+		l_server->post_upgrade_request();
+}
+
 int main(int argc, char **argv)
 {
 	ss::failure_services& l_fs = ss::failure_services::get();
@@ -21,35 +38,59 @@ int main(int argc, char **argv)
 	l_icr.read_arguments(argc, argv);
 
 	ctx.log(std::format("FORTUNE COOKIE SERVER v{} build {} built on: {}", RELEASE_NUMBER, BUILD_NUMBER, BUILD_DATE));
+	struct sigaction l_usr2;
+	memset(&l_usr2, 0, sizeof(l_usr2));
+	l_usr2.sa_handler = usr2_handler;
+	l_usr2.sa_flags = SA_RESTART;
+	sigemptyset(&l_usr2.sa_mask);
+	sigaction(SIGUSR2, &l_usr2, nullptr);
 	std::shared_ptr<fortune_server> l_server = std::make_shared<fortune_server>();
+	// if we were started by an upgrade, take over the old server's clients
+	l_server->finish_upgrade();
 	
+	// signal handlers only post a request, the main loop below acts on it
 	auto ctrlc = [&]() {
 		ctx.log_p(ss::log::NOTICE, "Ctrl-C Pressed, exiting gracefully...");
-		l_server->shutdown();
-		exit(EXIT_SUCCESS);
+		l_server->post_down_request();
 	};
 	
 	auto hup = [&]() {
-		ctx.log_p(ss::log::NOTICE, "Caught SIGHUP, reloading config and restarting server...");
-		l_server->shutdown();
-		l_server.reset();
-		l_icr.restart();
-		l_icr.read_file("fortune.ini", false);
-		l_icr.read_arguments(argc, argv);
-		l_server = std::make_shared<fortune_server>();
+		ctx.log_p(ss::log::NOTICE, "Caught SIGHUP, reloading config...");
+		l_server->post_hup_request();
 	};
 	
 	l_fs.install_sigint_handler(ctrlc);
 	l_fs.install_sighup_handler(hup);
+	g_server = l_server.get();
+	if (g_usr2_pending)
+		l_server->post_upgrade_request(); // came in while we were starting up
 	
 	while (1) {
-		std::this_thread::sleep_for(std::chrono::microseconds(50));
+		// sleeps until somebody asks for a DOWN, a HUP or an upgrade
+		l_server->wait_for_request();
 		if (l_server->request_down()) {
+			g_server = nullptr;
 			l_server->shutdown();
 			return 0;
 		}
 		if (l_server->request_hup()) {
-			hup();
+			// re-read the ini and apply it in place, listeners and clients stay as they are
+			auto l_start = std::chrono::steady_clock::now();
+			l_icr.restart();
+			l_icr.read_file("fortune.ini", false);
+			l_icr.read_arguments(argc, argv);
+			l_server->reload();
+			ctx.log(std::format("reloaded in {:.3f} ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - l_start).count()));
+		}
+		if (l_server->request_upgrade()) {
+			// a fresh copy of us takes over, if it doesn't come up we carry on as we are
+			ctx.log_p(ss::log::NOTICE, "upgrade requested, starting our successor...");
+			if (l_server->upgrade(argv)) {
+				l_server->drain_clients();
+				g_server = nullptr;
+				l_server->shutdown();
+				return 0;
+			}
 		}
 	}
 	
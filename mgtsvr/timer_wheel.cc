@@ -0,0 +1,122 @@
+#include "timer_wheel.h"
+
+namespace ss {
+namespace net {
+
+timer_wheel::timer_wheel(std::uint32_t a_tick_ms)
+: m_tick_ms(a_tick_ms)
+, m_size(0)
+{
+	m_current = now();
+	m_level0_map.fill(0);
+	m_level_size.fill(0);
+}
+
+timer_wheel::~timer_wheel()
+{
+
+}
+
+std::uint64_t timer_wheel::now_ms() const
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::uint64_t timer_wheel::now() const
+{
+	return now_ms() / m_tick_ms;
+}
+
+void timer_wheel::insert(int a_fd, std::uint32_t a_serial, std::uint64_t a_tick)
+{
+	// the entry keeps the tick it was asked for, it's only placed no earlier than the present
+	entry l_entry = { a_fd, a_serial, a_tick };
+	if (a_tick < m_current)
+		a_tick = m_current;
+	std::uint64_t l_delta = a_tick - m_current;
+	++m_size;
+	if (l_delta < LEVEL0_SLOTS) {
+		std::size_t l_slot = a_tick & (LEVEL0_SLOTS - 1);
+		m_level0[l_slot].push_back(l_entry);
+		m_level0_map[l_slot / 64] |= std::uint64_t(1) << (l_slot % 64);
+		return;
+	}
+	// find the level whose span covers the delay, anything further out parks in the top level
+	// and is simply cascaded around again until it comes into range
+	unsigned int l_level = 1;
+	while ((l_level < LEVELS - 1) && (l_delta >= (std::uint64_t(1) << shift(l_level + 1))))
+		++l_level;
+	std::size_t l_slot = (a_tick >> shift(l_level)) & (LEVEL_SLOTS - 1);
+	if (l_delta >= (std::uint64_t(1) << shift(LEVELS)))
+		l_slot = ((m_current >> shift(l_level)) - 1) & (LEVEL_SLOTS - 1);
+	m_levels[l_level - 1][l_slot].push_back(l_entry);
+	++m_level_size[l_level - 1];
+}
+
+void timer_wheel::cascade(unsigned int a_level)
+{
+	std::size_t l_slot = (m_current >> shift(a_level)) & (LEVEL_SLOTS - 1);
+	std::vector<entry> l_entries;
+	l_entries.swap(m_levels[a_level - 1][l_slot]);
+	m_level_size[a_level - 1] -= l_entries.size();
+	m_size -= l_entries.size();
+	for (auto& l_entry : l_entries)
+		insert(l_entry.m_fd, l_entry.m_serial, l_entry.m_tick);
+}
+
+void timer_wheel::advance(std::vector<entry>& a_expired)
+{
+	std::uint64_t l_now = now();
+	while (m_current <= l_now) {
+		if (m_size == 0) {
+			// nothing to run, just catch up
+			m_current = l_now + 1;
+			break;
+		}
+		// at each boundary pull the next slot of the level above down, highest first
+		for (unsigned int l_level = LEVELS - 1; l_level >= 1; --l_level) {
+			if ((m_current & ((std::uint64_t(1) << shift(l_level)) - 1)) == 0)
+				cascade(l_level);
+		}
+		std::size_t l_slot = m_current & (LEVEL0_SLOTS - 1);
+		if (!m_level0[l_slot].empty()) {
+			m_size -= m_level0[l_slot].size();
+			a_expired.insert(a_expired.end(), m_level0[l_slot].begin(), m_level0[l_slot].end());
+			m_level0[l_slot].clear();
+			m_level0_map[l_slot / 64] &= ~(std::uint64_t(1) << (l_slot % 64));
+		}
+		++m_current;
+	}
+}
+
+int timer_wheel::timeout_ms() const
+{
+	if (m_size == 0)
+		return -1;
+	// nearest occupied first level slot, or the next cascade if the higher levels hold anything
+	std::uint64_t l_next = m_current + LEVEL0_SLOTS;
+	for (std::size_t i = 0; i < LEVEL0_SLOTS; ++i) {
+		std::size_t l_slot = (m_current + i) & (LEVEL0_SLOTS - 1);
+		std::uint64_t l_word = m_level0_map[l_slot / 64] >> (l_slot % 64);
+		if (l_word != 0) {
+			l_next = m_current + i + std::countr_zero(l_word);
+			break;
+		}
+		// nothing in the rest of this bitmap word
+		i += 63 - (l_slot % 64);
+	}
+	bool l_upper = false;
+	for (auto l_size : m_level_size)
+		l_upper = l_upper || (l_size > 0);
+	if (l_upper) {
+		std::uint64_t l_cascade = (m_current + LEVEL0_SLOTS - 1) & ~std::uint64_t(LEVEL0_SLOTS - 1);
+		if (l_cascade < l_next)
+			l_next = l_cascade;
+	}
+	std::uint64_t l_at = l_next * m_tick_ms;
+	std::uint64_t l_now = now_ms();
+	return (l_at > l_now) ? int(l_at - l_now) : 0;
+}
+
+} // namespace net
+} // namespace ss
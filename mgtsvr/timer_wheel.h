@@ -0,0 +1,62 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+#include <bit>
+
+namespace ss {
+namespace net {
+
+// hierarchical timer wheel keyed on (fd, serial). Time moves in ticks of a_tick_ms; the first
+// level has a slot per tick for the next 256 ticks, each further level a slot per 64 slots of
+// the one below, cascading down as time reaches them. Insertion and expiry are O(1) per timer.
+// Nothing is ever removed: owners keep their real deadline elsewhere and ignore stale expiries.
+
+class timer_wheel {
+public:
+	struct entry {
+		int m_fd;
+		std::uint32_t m_serial;
+		std::uint64_t m_tick;
+	};
+
+	timer_wheel(std::uint32_t a_tick_ms);
+	virtual ~timer_wheel();
+
+	std::uint64_t now() const; // the current tick by the clock
+	std::uint32_t tick_ms() const { return m_tick_ms; }
+	std::size_t size() const { return m_size; }
+
+	void insert(int a_fd, std::uint32_t a_serial, std::uint64_t a_tick); // ticks in the past fire on the next advance()
+	// run the wheel up to now(), appending every timer that came due to a_expired
+	void advance(std::vector<entry>& a_expired);
+	// milliseconds until advance() has something to do, -1 if the wheel is empty
+	int timeout_ms() const;
+
+protected:
+	const static unsigned int LEVEL0_BITS = 8;
+	const static unsigned int LEVEL_BITS = 6;
+	const static unsigned int LEVELS = 4;
+	const static std::size_t LEVEL0_SLOTS = 1 << LEVEL0_BITS;
+	const static std::size_t LEVEL_SLOTS = 1 << LEVEL_BITS;
+
+	virtual std::uint64_t now_ms() const; // the clock, a test can substitute its own
+	void cascade(unsigned int a_level);
+	unsigned int shift(unsigned int a_level) const { return (a_level == 0) ? 0 : LEVEL0_BITS + (a_level - 1) * LEVEL_BITS; }
+
+	std::uint32_t m_tick_ms;
+	std::uint64_t m_current; // next tick to be processed
+	std::size_t m_size;
+	std::array<std::vector<entry>, LEVEL0_SLOTS> m_level0;
+	std::array<std::uint64_t, LEVEL0_SLOTS / 64> m_level0_map; // occupied first level slots
+	std::array<std::array<std::vector<entry>, LEVEL_SLOTS>, LEVELS - 1> m_levels;
+	std::array<std::size_t, LEVELS - 1> m_level_size;
+};
+
+} // namespace net
+} // namespace ss
+
+#endif // TIMER_WHEEL_H
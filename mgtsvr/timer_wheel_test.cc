@@ -0,0 +1,245 @@
+#include <iostream>
+#include <string>
+#include <format>
+#include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+
+#include "timer_wheel.h"
+
+// drives timer_wheel with a clock of its own through the level boundaries and far past the
+// span of the top level, checking that every timer comes out of advance() exactly once and
+// on time, that timeout_ms() never sleeps past a due timer, and that an owner keeping its
+// deadline and serial the way server_base does sees cancels and re-arms honoured.
+
+namespace {
+
+const std::uint32_t TICK_MS = 10;
+
+void fail(const std::string& a_msg)
+{
+	std::cerr << a_msg << std::endl;
+	exit(EXIT_FAILURE);
+}
+
+class fake_wheel : public ss::net::timer_wheel {
+public:
+	fake_wheel(std::uint64_t a_tick)
+	: timer_wheel(TICK_MS)
+	, m_clock_ms(a_tick * TICK_MS)
+	{
+		// the base constructor read the real clock
+		m_current = now();
+	}
+	std::uint64_t m_clock_ms;
+
+protected:
+	std::uint64_t now_ms() const override { return m_clock_ms; }
+};
+
+// what a client_rec keeps: the serial of the connection on the fd and the deadline it's after
+struct owner {
+	std::uint32_t m_serial = 1;
+	std::uint64_t m_timer_at = 0;
+};
+
+class checker {
+public:
+	checker(std::uint64_t a_tick)
+	: m_wheel(a_tick)
+	, m_last(a_tick - 1)
+	{
+
+	}
+
+	std::uint64_t now() const { return m_wheel.now(); }
+	std::size_t pending() const { return m_pending.size(); }
+
+	// arm or re-arm a_fd for a_tick, superseding whatever it was after before
+	void arm(int a_fd, std::uint64_t a_tick)
+	{
+		owner& l_owner = m_owners[a_fd];
+		key l_key = { a_fd, l_owner.m_serial, a_tick };
+		while (m_pending.contains(l_key))
+			++std::get<2>(l_key);
+		if (l_owner.m_timer_at != 0)
+			++m_superseded;
+		l_owner.m_timer_at = std::get<2>(l_key);
+		// a deadline already gone by fires on the next advance
+		std::uint64_t l_due = std::max(l_owner.m_timer_at, m_last + 1);
+		m_pending[l_key] = l_due;
+		m_due.insert(l_due);
+		m_wheel.insert(a_fd, l_owner.m_serial, l_owner.m_timer_at);
+		++m_armed;
+	}
+
+	void cancel(int a_fd)
+	{
+		owner& l_owner = m_owners[a_fd];
+		if (l_owner.m_timer_at != 0)
+			++m_cancelled;
+		l_owner.m_timer_at = 0;
+	}
+
+	// the fd closes and is reused by a new connection
+	void reuse(int a_fd)
+	{
+		cancel(a_fd);
+		++m_owners[a_fd].m_serial;
+	}
+
+	void step(std::uint64_t a_ticks)
+	{
+		m_wheel.m_clock_ms += a_ticks * TICK_MS;
+		std::uint64_t l_now = m_wheel.now();
+		m_expired.clear();
+		m_wheel.advance(m_expired);
+		for (auto& l_entry : m_expired) {
+			key l_key = { l_entry.m_fd, l_entry.m_serial, l_entry.m_tick };
+			auto l_it = m_pending.find(l_key);
+			if (l_it == m_pending.end())
+				fail(std::format("fd {} serial {} tick {} fired twice or was never armed", l_entry.m_fd, l_entry.m_serial, l_entry.m_tick));
+			if ((l_it->second <= m_last) || (l_it->second > l_now))
+				fail(std::format("fd {} tick {} due at {} fired in the advance from {} to {}", l_entry.m_fd, l_entry.m_tick, l_it->second, m_last + 1, l_now));
+			m_due.erase(m_due.find(l_it->second));
+			m_pending.erase(l_it);
+			// the owner's side, as in server_base::expire_client()
+			owner& l_owner = m_owners[l_entry.m_fd];
+			if ((l_owner.m_serial != l_entry.m_serial) || (l_owner.m_timer_at != l_entry.m_tick)) {
+				++m_stale;
+				continue;
+			}
+			l_owner.m_timer_at = 0;
+			++m_fired;
+		}
+		m_last = l_now;
+		if (m_wheel.size() != m_pending.size())
+			fail(std::format("wheel holds {} timers, {} are pending", m_wheel.size(), m_pending.size()));
+		int l_timeout = m_wheel.timeout_ms();
+		if (m_pending.empty()) {
+			if (l_timeout != -1)
+				fail(std::format("empty wheel wants to wake in {} ms", l_timeout));
+			return;
+		}
+		std::uint64_t l_next_ms = *m_due.begin() * TICK_MS - m_wheel.m_clock_ms;
+		if ((l_timeout < 0) || (static_cast<std::uint64_t>(l_timeout) > l_next_ms))
+			fail(std::format("at tick {} timeout_ms() is {} but a timer is due in {} ms", l_now, l_timeout, l_next_ms));
+	}
+
+	// every deadline an owner still holds has to have fired
+	void finish(const std::string& a_name)
+	{
+		while (!m_pending.empty())
+			step(std::min<std::uint64_t>(*m_due.begin() - m_last, 1000));
+		for (auto& [l_fd, l_owner] : m_owners) {
+			if (l_owner.m_timer_at != 0)
+				fail(std::format("{}: fd {} never fired for tick {}", a_name, l_fd, l_owner.m_timer_at));
+		}
+		if (m_fired + m_superseded + m_cancelled != m_armed)
+			fail(std::format("{}: {} armed but {} fired, {} superseded, {} cancelled", a_name, m_armed, m_fired, m_superseded, m_cancelled));
+		std::cout << std::format("{}: {} armed, {} fired on time, {} superseded, {} cancelled, {} stale entries ignored, ended at tick {}",
+			a_name, m_armed, m_fired, m_superseded, m_cancelled, m_stale, m_last) << std::endl;
+	}
+
+protected:
+	using key = std::tuple<int, std::uint32_t, std::uint64_t>;
+
+	fake_wheel m_wheel;
+	std::uint64_t m_last; // the tick the last advance() ran up to
+	std::map<int, owner> m_owners;
+	std::map<key, std::uint64_t> m_pending; // entries on the wheel and the tick each is due
+	std::multiset<std::uint64_t> m_due;
+	std::vector<ss::net::timer_wheel::entry> m_expired;
+	std::uint64_t m_armed = 0;
+	std::uint64_t m_fired = 0;
+	std::uint64_t m_superseded = 0;
+	std::uint64_t m_cancelled = 0;
+	std::uint64_t m_stale = 0;
+};
+
+// one tick at a time across the first and second level boundaries
+void test_boundaries()
+{
+	const std::uint64_t l_level1 = 256;
+	const std::uint64_t l_level2 = 64 * 256;
+	const std::uint64_t l_level3 = 64 * 64 * 256;
+	checker l_check(1);
+	std::vector<std::uint64_t> l_ticks = { 1, 2, 254, 255, 256, 257, 511, 512, 513,
+		l_level2 - 1, l_level2, l_level2 + 1, l_level2 + 255, l_level2 + 256, 2 * l_level2, 3 * l_level2 + 7,
+		l_level3 - 1, l_level3, l_level3 + 1 };
+	int l_fd = 0;
+	for (auto l_tick : l_ticks)
+		l_check.arm(l_fd++, l_tick);
+	// and some armed while time is already running, so their spans straddle a boundary
+	// from somewhere other than the start of one
+	std::map<std::uint64_t, std::vector<std::uint64_t>> l_later = {
+		{ 200, { 100, 56, 57, 312 } },
+		{ l_level1 + 3, { l_level1, l_level2 } },
+		{ l_level2 - 10, { 9, 10, 11, l_level2 } },
+		{ l_level2 + 100, { l_level3 - l_level2 - 100 } },
+	};
+	while (l_check.now() <= l_level3 + 2) {
+		l_check.step(1);
+		auto l_it = l_later.find(l_check.now());
+		if (l_it != l_later.end()) {
+			for (auto l_delay : l_it->second)
+				l_check.arm(l_fd++, l_check.now() + l_delay);
+		}
+	}
+	if (l_check.pending() != 0)
+		fail("boundaries: timers left on the wheel");
+	l_check.finish("boundaries");
+}
+
+// random deadlines out past the span of the whole wheel, random clock jumps, and owners
+// cancelling, re-arming and reusing their fds all the while
+void test_random()
+{
+	const int l_fds = 2000;
+	const std::uint64_t l_end = std::uint64_t(1) << 27;
+	std::mt19937_64 l_rng(42);
+	std::uniform_real_distribution<double> l_exp(0.0, 27.0);
+	std::uniform_int_distribution<int> l_pick(0, l_fds - 1);
+	std::uniform_int_distribution<int> l_action(0, 99);
+	// start somewhere unaligned, the real clock never starts at zero
+	checker l_check(123456789);
+	auto l_delay = [&]() { return static_cast<std::uint64_t>(std::exp2(l_exp(l_rng))) - 1; };
+	for (int i = 0; i < l_fds; ++i)
+		l_check.arm(i, l_check.now() + l_delay());
+	std::uint64_t l_start = l_check.now();
+	while (l_check.now() - l_start < l_end) {
+		for (int i = 0; i < 4; ++i) {
+			int l_fd = l_pick(l_rng);
+			int l_what = l_action(l_rng);
+			if (l_what < 40) {
+				l_check.arm(l_fd, l_check.now() + l_delay());
+			} else if (l_what < 55) {
+				l_check.cancel(l_fd);
+			} else if (l_what < 70) {
+				l_check.reuse(l_fd);
+				l_check.arm(l_fd, l_check.now() + l_delay());
+			} else if (l_what < 75) {
+				// a deadline that has already gone by
+				l_check.arm(l_fd, l_check.now() - std::min<std::uint64_t>(l_delay(), 1000));
+			}
+		}
+		int l_what = l_action(l_rng);
+		l_check.step((l_what < 50) ? 1 : (l_what < 90) ? l_what : l_what * 997);
+	}
+	l_check.finish("random");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	test_boundaries();
+	test_random();
+	std::cout << "timer_wheel_test: all passed" << std::endl;
+	return 0;
+}
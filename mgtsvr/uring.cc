@@ -0,0 +1,280 @@
+#include "uring.h"
+
+namespace ss {
+namespace net {
+
+uring::uring(unsigned int a_entries)
+: m_fd(-1)
+, m_sq_ring(MAP_FAILED)
+, m_sq_ring_size(0)
+, m_sqes((struct io_uring_sqe *)MAP_FAILED)
+, m_sqes_size(0)
+, m_sqe_head(0)
+, m_sqe_tail(0)
+, m_cq_ring(MAP_FAILED)
+, m_cq_ring_size(0)
+{
+	memset(&m_params, 0, sizeof(m_params));
+	m_fd = syscall(__NR_io_uring_setup, a_entries, &m_params);
+	if (m_fd < 0)
+		throw std::runtime_error(std::string("uring: io_uring_setup failed: ") + strerror(errno));
+
+	// map the rings, which share a single mapping on any kernel recent enough to matter
+	m_sq_ring_size = m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned int);
+	m_cq_ring_size = m_params.cq_off.cqes + m_params.cq_entries * sizeof(struct io_uring_cqe);
+	bool l_single = (m_params.features & IORING_FEAT_SINGLE_MMAP);
+	if (l_single) {
+		m_sq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+		m_cq_ring_size = m_sq_ring_size;
+	}
+	m_sq_ring = mmap(0, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	if (m_sq_ring == MAP_FAILED) {
+		close(m_fd);
+		throw std::runtime_error(std::string("uring: unable to map submission ring: ") + strerror(errno));
+	}
+	if (l_single) {
+		m_cq_ring = m_sq_ring;
+	} else {
+		m_cq_ring = mmap(0, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+		if (m_cq_ring == MAP_FAILED) {
+			munmap(m_sq_ring, m_sq_ring_size);
+			close(m_fd);
+			throw std::runtime_error(std::string("uring: unable to map completion ring: ") + strerror(errno));
+		}
+	}
+	m_sqes_size = m_params.sq_entries * sizeof(struct io_uring_sqe);
+	m_sqes = (struct io_uring_sqe *)mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+	if (m_sqes == MAP_FAILED) {
+		if (!l_single)
+			munmap(m_cq_ring, m_cq_ring_size);
+		munmap(m_sq_ring, m_sq_ring_size);
+		close(m_fd);
+		throw std::runtime_error(std::string("uring: unable to map submission entries: ") + strerror(errno));
+	}
+
+	std::uint8_t *l_sq = (std::uint8_t *)m_sq_ring;
+	m_sq_head = (unsigned int *)(l_sq + m_params.sq_off.head);
+	m_sq_tail = (unsigned int *)(l_sq + m_params.sq_off.tail);
+	m_sq_mask = *(unsigned int *)(l_sq + m_params.sq_off.ring_mask);
+	m_sq_entries = *(unsigned int *)(l_sq + m_params.sq_off.ring_entries);
+	m_sq_array = (unsigned int *)(l_sq + m_params.sq_off.array);
+	std::uint8_t *l_cq = (std::uint8_t *)m_cq_ring;
+	m_cq_head = (unsigned int *)(l_cq + m_params.cq_off.head);
+	m_cq_tail = (unsigned int *)(l_cq + m_params.cq_off.tail);
+	m_cq_mask = *(unsigned int *)(l_cq + m_params.cq_off.ring_mask);
+	m_cqes = (struct io_uring_cqe *)(l_cq + m_params.cq_off.cqes);
+}
+
+uring::~uring()
+{
+	munmap(m_sqes, m_sqes_size);
+	if (m_cq_ring != m_sq_ring)
+		munmap(m_cq_ring, m_cq_ring_size);
+	munmap(m_sq_ring, m_sq_ring_size);
+	close(m_fd);
+}
+
+bool uring::probe(std::string& a_reason)
+{
+	try {
+		uring l_ring(8);
+		int l_pair[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, l_pair) == -1) {
+			a_reason = std::string("socketpair failed: ") + strerror(errno);
+			return false;
+		}
+		// one byte then EOF: a working multishot receive reports the byte with more to come,
+		// then the EOF, which ends it
+		std::uint8_t l_buf[2][64]; // the EOF takes a buffer as well
+		l_ring.prep_provide_buffers(l_buf, sizeof(l_buf[0]), 2, 1, 0, 1);
+		l_ring.prep_recv_multishot(l_pair[0], 1, 2);
+		if (write(l_pair[1], "x", 1) != 1)
+			a_reason = std::string("write failed: ") + strerror(errno);
+		close(l_pair[1]);
+		bool l_more = false;
+		bool l_done = !a_reason.empty();
+		while (!l_done) {
+			int l_ret = l_ring.submit_and_wait(1, PROBE_TIMEOUT_MS);
+			struct io_uring_cqe *l_cqes[8];
+			unsigned int n = (l_ret < 0) ? 0 : l_ring.peek_cqes(l_cqes, 8);
+			if (n == 0) {
+				a_reason = (l_ret < 0) ? std::string("io_uring_enter failed: ") + strerror(-l_ret) : "no completion for the receive";
+				break;
+			}
+			for (unsigned int i = 0; i < n; ++i) {
+				int l_res = l_cqes[i]->res;
+				if (l_res < 0) {
+					a_reason = std::string((l_cqes[i]->user_data == 1) ? "providing buffers" : "multishot receive") + " failed: " + strerror(-l_res);
+					l_done = true;
+				} else if (l_cqes[i]->user_data == 2) {
+					if (l_res > 0)
+						l_more = (l_cqes[i]->flags & IORING_CQE_F_MORE);
+					if (!(l_cqes[i]->flags & IORING_CQE_F_MORE))
+						l_done = true;
+				}
+			}
+			l_ring.cq_advance(n);
+		}
+		close(l_pair[0]);
+		if (a_reason.empty() && !l_more)
+			a_reason = "receive wasn't multishot";
+	} catch (std::exception& e) {
+		a_reason = e.what();
+	}
+	return a_reason.empty();
+}
+
+int uring::enter(unsigned int a_to_submit, unsigned int a_min_complete, unsigned int a_flags, void *a_arg, std::size_t a_argsz)
+{
+	int l_ret = syscall(__NR_io_uring_enter, m_fd, a_to_submit, a_min_complete, a_flags, a_arg, a_argsz);
+	return (l_ret < 0) ? -errno : l_ret;
+}
+
+unsigned int uring::flush_sq()
+{
+	// publish the entries handed out since the last flush
+	unsigned int l_tail = *m_sq_tail;
+	while (m_sqe_head != m_sqe_tail) {
+		m_sq_array[l_tail & m_sq_mask] = m_sqe_head & m_sq_mask;
+		++l_tail;
+		++m_sqe_head;
+	}
+	std::atomic_ref<unsigned int>(*m_sq_tail).store(l_tail, std::memory_order_release);
+	return l_tail - std::atomic_ref<unsigned int>(*m_sq_head).load(std::memory_order_acquire);
+}
+
+struct io_uring_sqe *uring::get_sqe()
+{
+	unsigned int l_head = std::atomic_ref<unsigned int>(*m_sq_head).load(std::memory_order_acquire);
+	if (m_sqe_tail - l_head >= m_sq_entries) {
+		submit();
+		l_head = std::atomic_ref<unsigned int>(*m_sq_head).load(std::memory_order_acquire);
+		if (m_sqe_tail - l_head >= m_sq_entries)
+			return nullptr;
+	}
+	struct io_uring_sqe *l_sqe = &m_sqes[m_sqe_tail & m_sq_mask];
+	++m_sqe_tail;
+	memset(l_sqe, 0, sizeof(*l_sqe));
+	return l_sqe;
+}
+
+int uring::submit()
+{
+	unsigned int l_pending = flush_sq();
+	if (l_pending == 0)
+		return 0;
+	return enter(l_pending, 0, 0, nullptr, 0);
+}
+
+int uring::submit_and_wait(unsigned int a_wait_nr, int a_timeout_ms)
+{
+	unsigned int l_pending = flush_sq();
+	int l_ret;
+	if (a_timeout_ms < 0) {
+		l_ret = enter(l_pending, a_wait_nr, IORING_ENTER_GETEVENTS, nullptr, 0);
+	} else {
+		struct __kernel_timespec l_ts;
+		l_ts.tv_sec = a_timeout_ms / 1000;
+		l_ts.tv_nsec = (a_timeout_ms % 1000) * 1000000;
+		struct io_uring_getevents_arg l_arg;
+		memset(&l_arg, 0, sizeof(l_arg));
+		l_arg.ts = (std::uint64_t)&l_ts;
+		l_ret = enter(l_pending, a_wait_nr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &l_arg, sizeof(l_arg));
+	}
+	// timeouts and signals just mean there's nothing to reap yet
+	if ((l_ret == -ETIME) || (l_ret == -EINTR))
+		return 0;
+	return l_ret;
+}
+
+unsigned int uring::peek_cqes(struct io_uring_cqe **a_cqes, unsigned int a_max)
+{
+	unsigned int l_head = *m_cq_head;
+	unsigned int l_tail = std::atomic_ref<unsigned int>(*m_cq_tail).load(std::memory_order_acquire);
+	unsigned int l_count = std::min(l_tail - l_head, a_max);
+	for (unsigned int i = 0; i < l_count; ++i)
+		a_cqes[i] = &m_cqes[(l_head + i) & m_cq_mask];
+	return l_count;
+}
+
+void uring::cq_advance(unsigned int a_count)
+{
+	std::atomic_ref<unsigned int>(*m_cq_head).store(*m_cq_head + a_count, std::memory_order_release);
+}
+
+struct io_uring_sqe *uring::prep(std::uint8_t a_opcode, int a_fd, std::uint64_t a_user_data)
+{
+	struct io_uring_sqe *l_sqe = get_sqe();
+	if (l_sqe == nullptr)
+		return nullptr;
+	l_sqe->opcode = a_opcode;
+	l_sqe->fd = a_fd;
+	l_sqe->user_data = a_user_data;
+	return l_sqe;
+}
+
+bool uring::prep_accept_multishot(int a_fd, int a_flags, std::uint64_t a_user_data)
+{
+	struct io_uring_sqe *l_sqe = prep(IORING_OP_ACCEPT, a_fd, a_user_data);
+	if (l_sqe == nullptr)
+		return false;
+	l_sqe->accept_flags = a_flags;
+	l_sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+	return true;
+}
+
+bool uring::prep_recv_multishot(int a_fd, std::uint16_t a_buffer_group, std::uint64_t a_user_data)
+{
+	struct io_uring_sqe *l_sqe = prep(IORING_OP_RECV, a_fd, a_user_data);
+	if (l_sqe == nullptr)
+		return false;
+	l_sqe->flags |= IOSQE_BUFFER_SELECT;
+	l_sqe->buf_group = a_buffer_group;
+	l_sqe->ioprio |= IORING_RECV_MULTISHOT;
+	return true;
+}
+
+bool uring::prep_provide_buffers(void *a_addr, unsigned int a_len, unsigned int a_count, std::uint16_t a_buffer_group, std::uint16_t a_first_id, std::uint64_t a_user_data)
+{
+	struct io_uring_sqe *l_sqe = prep(IORING_OP_PROVIDE_BUFFERS, a_count, a_user_data);
+	if (l_sqe == nullptr)
+		return false;
+	l_sqe->addr = (std::uint64_t)a_addr;
+	l_sqe->len = a_len;
+	l_sqe->off = a_first_id;
+	l_sqe->buf_group = a_buffer_group;
+	return true;
+}
+
+bool uring::prep_sendmsg(int a_fd, const struct msghdr *a_msg, unsigned int a_flags, std::uint64_t a_user_data)
+{
+	struct io_uring_sqe *l_sqe = prep(IORING_OP_SENDMSG, a_fd, a_user_data);
+	if (l_sqe == nullptr)
+		return false;
+	l_sqe->addr = (std::uint64_t)a_msg;
+	l_sqe->len = 1;
+	l_sqe->msg_flags = a_flags;
+	return true;
+}
+
+bool uring::prep_read(int a_fd, void *a_buffer, unsigned int a_len, std::uint64_t a_user_data)
+{
+	struct io_uring_sqe *l_sqe = prep(IORING_OP_READ, a_fd, a_user_data);
+	if (l_sqe == nullptr)
+		return false;
+	l_sqe->addr = (std::uint64_t)a_buffer;
+	l_sqe->len = a_len;
+	return true;
+}
+
+bool uring::prep_cancel(std::uint64_t a_target, std::uint64_t a_user_data)
+{
+	struct io_uring_sqe *l_sqe = prep(IORING_OP_ASYNC_CANCEL, -1, a_user_data);
+	if (l_sqe == nullptr)
+		return false;
+	l_sqe->addr = a_target;
+	return true;
+}
+
+} // namespace net
+} // namespace ss
@@ -0,0 +1,85 @@
+#ifndef URING_H
+#define URING_H
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <atomic>
+#include <algorithm>
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+namespace ss {
+namespace net {
+
+// minimal io_uring wrapper talking to the kernel directly (no liburing), covering what the
+// server_base io_uring backend needs: multishot accept, multishot receive into provided
+// buffers, sendmsg, reads, and cancellation. Not thread safe - one ring per reactor thread.
+
+class uring {
+public:
+	uring(unsigned int a_entries);
+	~uring();
+
+	// can this kernel run what we use? Multishot receives into provided buffers (which came a
+	// release after multishot accepts) are tried out on a throwaway ring, older kernels have the
+	// opcodes but reject the multishot flag. If not, a_reason says what went wrong.
+	static bool probe(std::string& a_reason);
+	const static int PROBE_TIMEOUT_MS = 1000;
+
+	// next free submission entry, flushing the queue to the kernel first if it is full.
+	// returns nullptr only if the kernel would not take any entries.
+	struct io_uring_sqe *get_sqe();
+	int submit();
+	int submit_and_wait(unsigned int a_wait_nr, int a_timeout_ms); // a_timeout_ms < 0 waits forever
+
+	// completions are consumed in batches: peek, process, then advance past them
+	unsigned int peek_cqes(struct io_uring_cqe **a_cqes, unsigned int a_max);
+	void cq_advance(unsigned int a_count);
+
+	// request preparation, all return false if no submission entry was available
+	bool prep_accept_multishot(int a_fd, int a_flags, std::uint64_t a_user_data);
+	bool prep_recv_multishot(int a_fd, std::uint16_t a_buffer_group, std::uint64_t a_user_data);
+	bool prep_provide_buffers(void *a_addr, unsigned int a_len, unsigned int a_count, std::uint16_t a_buffer_group, std::uint16_t a_first_id, std::uint64_t a_user_data);
+	bool prep_sendmsg(int a_fd, const struct msghdr *a_msg, unsigned int a_flags, std::uint64_t a_user_data);
+	bool prep_read(int a_fd, void *a_buffer, unsigned int a_len, std::uint64_t a_user_data);
+	bool prep_cancel(std::uint64_t a_target, std::uint64_t a_user_data);
+
+protected:
+	int enter(unsigned int a_to_submit, unsigned int a_min_complete, unsigned int a_flags, void *a_arg, std::size_t a_argsz);
+	unsigned int flush_sq();
+	struct io_uring_sqe *prep(std::uint8_t a_opcode, int a_fd, std::uint64_t a_user_data);
+
+	int m_fd;
+	struct io_uring_params m_params;
+	// submission queue
+	void *m_sq_ring;
+	std::size_t m_sq_ring_size;
+	unsigned int *m_sq_head;
+	unsigned int *m_sq_tail;
+	unsigned int m_sq_mask;
+	unsigned int m_sq_entries;
+	unsigned int *m_sq_array;
+	struct io_uring_sqe *m_sqes;
+	std::size_t m_sqes_size;
+	unsigned int m_sqe_head; // entries handed out by get_sqe() but not yet published to the kernel
+	unsigned int m_sqe_tail;
+	// completion queue
+	void *m_cq_ring;
+	std::size_t m_cq_ring_size;
+	unsigned int *m_cq_head;
+	unsigned int *m_cq_tail;
+	unsigned int m_cq_mask;
+	struct io_uring_cqe *m_cqes;
+};
+
+} // namespace net
+} // namespace ss
+
+#endif // URING_H
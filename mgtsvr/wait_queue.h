@@ -0,0 +1,265 @@
+#ifndef WAIT_QUEUE_H
+#define WAIT_QUEUE_H
+
+#include <vector>
+#include <memory>
+#include <optional>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace ss {
+namespace net {
+
+// bounded lock-free work queue for many producers and many consumers (Vyukov's array queue:
+// each cell carries a sequence number saying whose turn it is, so a push or pop is one CAS on
+// the tail or head plus a store to the cell). Consumers that find it empty park on an atomic
+// wait, so they sleep in the kernel rather than poll, and producers only touch the wait word
+// when somebody is parked. A push only has to wait if the queue is full, which callers avoid
+// by sizing it for the most items they can have in it at once.
+
+template <typename T>
+class wait_queue {
+public:
+	wait_queue(std::size_t a_capacity); // rounded up to a power of two
+	~wait_queue();
+
+	void add_work_item(T a_item);
+	void add_work_items(std::vector<T>& a_items); // moves the items out, one wake up pass for the lot
+	// blocks until an item is available, returns nullopt once the queue has been shut down
+	std::optional<T> wait_for_item();
+	// same, but takes up to a_max items at a time, appended to a_items. Returns how many, 0 once shut down.
+	std::size_t wait_for_items(std::vector<T>& a_items, std::size_t a_max);
+	void shut_down(); // wakes every waiter, items still queued are dropped
+	bool is_shut_down() const { return m_shut_down.load(std::memory_order_acquire); }
+	std::size_t size() const; // for statistics, a snapshot
+	std::size_t capacity() const { return m_mask + 1; }
+
+	// statistics: items taken and the time they spent queued in total, and how often a consumer
+	// found nothing to do and went to sleep
+	std::uint64_t pops() const { return m_pops.load(std::memory_order_relaxed); }
+	std::uint64_t wait_ns() const { return m_wait_ns.load(std::memory_order_relaxed); }
+	std::uint64_t parks() const { return m_parks.load(std::memory_order_relaxed); }
+
+protected:
+	struct cell {
+		std::atomic<std::size_t> m_seq;
+		T m_item;
+		std::uint64_t m_pushed_ns;
+	};
+
+	bool try_push(T& a_item, std::uint64_t a_now);
+	bool try_pop(T& a_item);
+	void push(T& a_item, std::uint64_t a_now);
+	void wake(std::size_t a_count);
+	bool park(); // false once shut down
+	static std::uint64_t now_ns();
+
+	std::unique_ptr<cell[]> m_cells;
+	std::size_t m_mask;
+	alignas(64) std::atomic<std::size_t> m_tail; // next position to push to
+	alignas(64) std::atomic<std::size_t> m_head; // next position to pop from
+	alignas(64) std::atomic<std::uint32_t> m_signal; // the wait word, bumped to wake parked consumers
+	std::atomic<std::uint32_t> m_sleepers;
+	std::atomic<bool> m_shut_down;
+	alignas(64) std::atomic<std::uint64_t> m_pops;
+	std::atomic<std::uint64_t> m_wait_ns;
+	std::atomic<std::uint64_t> m_parks;
+};
+
+template <typename T>
+wait_queue<T>::wait_queue(std::size_t a_capacity)
+: m_tail(0)
+, m_head(0)
+, m_signal(0)
+, m_sleepers(0)
+, m_shut_down(false)
+, m_pops(0)
+, m_wait_ns(0)
+, m_parks(0)
+{
+	std::size_t l_capacity = 2;
+	while (l_capacity < a_capacity)
+		l_capacity <<= 1;
+	m_mask = l_capacity - 1;
+	m_cells.reset(new cell[l_capacity]);
+	for (std::size_t i = 0; i < l_capacity; ++i)
+		m_cells[i].m_seq.store(i, std::memory_order_relaxed);
+}
+
+template <typename T>
+wait_queue<T>::~wait_queue()
+{ }
+
+template <typename T>
+std::uint64_t wait_queue<T>::now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename T>
+bool wait_queue<T>::try_push(T& a_item, std::uint64_t a_now)
+{
+	std::size_t l_pos = m_tail.load(std::memory_order_relaxed);
+	while (1) {
+		cell& l_cell = m_cells[l_pos & m_mask];
+		std::size_t l_seq = l_cell.m_seq.load(std::memory_order_acquire);
+		std::intptr_t l_diff = std::intptr_t(l_seq) - std::intptr_t(l_pos);
+		if (l_diff == 0) {
+			// the cell is free for this lap, claim it
+			if (m_tail.compare_exchange_weak(l_pos, l_pos + 1, std::memory_order_relaxed)) {
+				l_cell.m_item = std::move(a_item);
+				l_cell.m_pushed_ns = a_now;
+				l_cell.m_seq.store(l_pos + 1, std::memory_order_release);
+				return true;
+			}
+		} else if (l_diff < 0) {
+			return false; // full: the cell still holds an item from the previous lap
+		} else {
+			l_pos = m_tail.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+template <typename T>
+bool wait_queue<T>::try_pop(T& a_item)
+{
+	std::size_t l_pos = m_head.load(std::memory_order_relaxed);
+	while (1) {
+		cell& l_cell = m_cells[l_pos & m_mask];
+		std::size_t l_seq = l_cell.m_seq.load(std::memory_order_acquire);
+		std::intptr_t l_diff = std::intptr_t(l_seq) - std::intptr_t(l_pos + 1);
+		if (l_diff == 0) {
+			if (m_head.compare_exchange_weak(l_pos, l_pos + 1, std::memory_order_relaxed)) {
+				a_item = std::move(l_cell.m_item);
+				std::uint64_t l_pushed = l_cell.m_pushed_ns;
+				l_cell.m_seq.store(l_pos + m_mask + 1, std::memory_order_release);
+				m_pops.fetch_add(1, std::memory_order_relaxed);
+				m_wait_ns.fetch_add(now_ns() - l_pushed, std::memory_order_relaxed);
+				return true;
+			}
+		} else if (l_diff < 0) {
+			return false; // empty
+		} else {
+			l_pos = m_head.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+template <typename T>
+void wait_queue<T>::push(T& a_item, std::uint64_t a_now)
+{
+	// only waits when full, until a consumer makes room
+	while (!try_push(a_item, a_now)) {
+		if (is_shut_down())
+			return;
+		wake(1);
+		std::this_thread::yield();
+	}
+}
+
+template <typename T>
+void wait_queue<T>::wake(std::size_t a_count)
+{
+	// pairs with the fence in park(): either the sleeper sees our item, or we see the sleeper
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	std::uint32_t l_sleepers = m_sleepers.load(std::memory_order_relaxed);
+	if (l_sleepers == 0)
+		return;
+	m_signal.fetch_add(1, std::memory_order_release);
+	if (a_count >= l_sleepers)
+		m_signal.notify_all();
+	else
+		while (a_count-- > 0)
+			m_signal.notify_one();
+}
+
+template <typename T>
+bool wait_queue<T>::park()
+{
+	std::uint32_t l_signal = m_signal.load(std::memory_order_acquire);
+	m_sleepers.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	// look again now we're counted, anything pushed from here on bumps the signal
+	if ((m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_relaxed)) && !is_shut_down()) {
+		m_parks.fetch_add(1, std::memory_order_relaxed);
+		m_signal.wait(l_signal, std::memory_order_acquire);
+	}
+	m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+	return !is_shut_down();
+}
+
+template <typename T>
+void wait_queue<T>::add_work_item(T a_item)
+{
+	if (is_shut_down())
+		return;
+	push(a_item, now_ns());
+	wake(1);
+}
+
+template <typename T>
+void wait_queue<T>::add_work_items(std::vector<T>& a_items)
+{
+	if (is_shut_down())
+		a_items.clear();
+	if (a_items.empty())
+		return;
+	std::uint64_t l_now = now_ns();
+	for (auto& l_item : a_items)
+		push(l_item, l_now);
+	wake(a_items.size());
+	a_items.clear();
+}
+
+template <typename T>
+std::optional<T> wait_queue<T>::wait_for_item()
+{
+	T l_item;
+	while (!is_shut_down()) {
+		if (try_pop(l_item))
+			return l_item;
+		if (!park())
+			break;
+	}
+	return std::nullopt;
+}
+
+template <typename T>
+std::size_t wait_queue<T>::wait_for_items(std::vector<T>& a_items, std::size_t a_max)
+{
+	std::size_t l_count = 0;
+	T l_item;
+	while ((l_count == 0) && !is_shut_down()) {
+		while ((l_count < a_max) && try_pop(l_item)) {
+			a_items.push_back(std::move(l_item));
+			++l_count;
+		}
+		if ((l_count == 0) && !park())
+			break;
+	}
+	return l_count;
+}
+
+template <typename T>
+void wait_queue<T>::shut_down()
+{
+	m_shut_down.store(true, std::memory_order_release);
+	m_signal.fetch_add(1, std::memory_order_release);
+	m_signal.notify_all();
+}
+
+template <typename T>
+std::size_t wait_queue<T>::size() const
+{
+	std::size_t l_tail = m_tail.load(std::memory_order_relaxed);
+	std::size_t l_head = m_head.load(std::memory_order_relaxed);
+	return (l_tail > l_head) ? l_tail - l_head : 0;
+}
+
+} // namespace net
+} // namespace ss
+
+#endif // WAIT_QUEUE_H
@@ -0,0 +1,209 @@
+#include <iostream>
+#include <string>
+#include <format>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+#include "wait_queue.h"
+
+// exercises wait_queue the way command_server uses it: several producers against several
+// consumers through a queue small enough to fill, and consumers parked on an empty queue
+// being let go by shut_down(). A lost wake up shows as a hang, so a watchdog bounds the run.
+
+namespace {
+
+const int PRODUCERS = 4;
+const int CONSUMERS = 4;
+const int ITEMS_PER_PRODUCER = 100000;
+const std::size_t CAPACITY = 64;
+const std::size_t BATCH = 16;
+const int WATCHDOG_SECS = 60;
+
+void fail(const std::string& a_msg)
+{
+	std::cerr << a_msg << std::endl;
+	exit(EXIT_FAILURE);
+}
+
+// wait until a_pred holds or a_secs have gone by
+template <typename PRED>
+bool wait_until(PRED a_pred, int a_secs)
+{
+	auto l_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(a_secs);
+	while (!a_pred()) {
+		if (std::chrono::steady_clock::now() > l_deadline)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+void test_exactly_once()
+{
+	ss::net::wait_queue<int> l_queue(CAPACITY);
+	const int l_total = PRODUCERS * ITEMS_PER_PRODUCER;
+	std::vector<std::atomic<int>> l_seen(l_total);
+	std::atomic<int> l_taken = 0;
+
+	// half the consumers take one item at a time, the other half take batches
+	std::vector<std::thread> l_consumers;
+	for (int i = 0; i < CONSUMERS; ++i) {
+		l_consumers.emplace_back([&, i]() {
+			std::vector<int> l_items;
+			for (;;) {
+				l_items.clear();
+				if (i % 2 == 0) {
+					auto l_item = l_queue.wait_for_item();
+					if (!l_item.has_value())
+						return;
+					l_items.push_back(l_item.value());
+				} else if (l_queue.wait_for_items(l_items, BATCH) == 0) {
+					return;
+				}
+				for (int l_item : l_items)
+					l_seen[l_item].fetch_add(1, std::memory_order_relaxed);
+				l_taken.fetch_add(l_items.size(), std::memory_order_release);
+			}
+		});
+	}
+	// likewise the producers, one at a time or in batches
+	std::vector<std::thread> l_producers;
+	for (int i = 0; i < PRODUCERS; ++i) {
+		l_producers.emplace_back([&, i]() {
+			std::vector<int> l_items;
+			for (int j = 0; j < ITEMS_PER_PRODUCER; ++j) {
+				int l_item = i * ITEMS_PER_PRODUCER + j;
+				if (i % 2 == 0) {
+					l_queue.add_work_item(l_item);
+					continue;
+				}
+				l_items.push_back(l_item);
+				if (l_items.size() == BATCH)
+					l_queue.add_work_items(l_items);
+			}
+			l_queue.add_work_items(l_items);
+		});
+	}
+	for (auto& l_thread : l_producers)
+		l_thread.join();
+	if (!wait_until([&]() { return l_taken.load(std::memory_order_acquire) >= l_total; }, WATCHDOG_SECS))
+		fail(std::format("exactly once: only {} of {} items came out", l_taken.load(), l_total));
+	l_queue.shut_down();
+	for (auto& l_thread : l_consumers)
+		l_thread.join();
+
+	int l_missing = 0;
+	int l_repeated = 0;
+	for (auto& l_count : l_seen) {
+		int l_times = l_count.load();
+		if (l_times == 0)
+			++l_missing;
+		else if (l_times > 1)
+			++l_repeated;
+	}
+	std::cout << std::format("exactly once: {} producers, {} consumers, {} items, {} missing, {} repeated, {} parks",
+		PRODUCERS, CONSUMERS, l_total, l_missing, l_repeated, l_queue.parks()) << std::endl;
+	if ((l_missing != 0) || (l_repeated != 0) || (l_taken.load() != l_total) || (l_queue.pops() != static_cast<std::uint64_t>(l_total)))
+		fail("exactly once: FAILED");
+}
+
+void test_full()
+{
+	ss::net::wait_queue<int> l_queue(CAPACITY);
+	for (std::size_t i = 0; i < l_queue.capacity(); ++i)
+		l_queue.add_work_item(static_cast<int>(i));
+	if (l_queue.size() != l_queue.capacity())
+		fail(std::format("full: size {} after filling a queue of {}", l_queue.size(), l_queue.capacity()));
+
+	// one more push has to wait for room
+	std::atomic<bool> l_pushed = false;
+	std::thread l_producer([&]() {
+		l_queue.add_work_item(-1);
+		l_pushed = true;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	if (l_pushed)
+		fail("full: push into a full queue did not wait");
+	auto l_first = l_queue.wait_for_item();
+	if (!l_first.has_value() || (l_first.value() != 0))
+		fail("full: first item out is not the first one in");
+	if (!wait_until([&]() { return l_pushed.load(); }, WATCHDOG_SECS))
+		fail("full: push did not go through once there was room");
+	l_producer.join();
+
+	// everything else comes out in order, the late one last
+	for (std::size_t i = 1; i < l_queue.capacity(); ++i) {
+		auto l_item = l_queue.wait_for_item();
+		if (!l_item.has_value() || (l_item.value() != static_cast<int>(i)))
+			fail(std::format("full: expected item {}", i));
+	}
+	auto l_last = l_queue.wait_for_item();
+	if (!l_last.has_value() || (l_last.value() != -1))
+		fail("full: the item pushed while full got lost");
+	if (l_queue.size() != 0)
+		fail("full: queue not empty after draining");
+	std::cout << std::format("full: capacity {}, push waited for room and nothing was lost", l_queue.capacity()) << std::endl;
+}
+
+void test_shut_down()
+{
+	ss::net::wait_queue<int> l_queue(CAPACITY);
+	std::atomic<int> l_returned = 0;
+	std::atomic<int> l_got_item = 0;
+	std::vector<std::thread> l_consumers;
+	for (int i = 0; i < CONSUMERS; ++i) {
+		l_consumers.emplace_back([&, i]() {
+			std::vector<int> l_items;
+			if (i % 2 == 0) {
+				if (l_queue.wait_for_item().has_value())
+					++l_got_item;
+			} else if (l_queue.wait_for_items(l_items, BATCH) != 0) {
+				++l_got_item;
+			}
+			++l_returned;
+		});
+	}
+	// make sure they are all asleep in the kernel before pulling the plug
+	if (!wait_until([&]() { return l_queue.parks() >= static_cast<std::uint64_t>(CONSUMERS); }, WATCHDOG_SECS))
+		fail(std::format("shut down: only {} of {} consumers parked", l_queue.parks(), CONSUMERS));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	if (l_returned != 0)
+		fail("shut down: a consumer returned from an empty queue");
+	l_queue.shut_down();
+	if (!wait_until([&]() { return l_returned.load() == CONSUMERS; }, WATCHDOG_SECS))
+		fail(std::format("shut down: only {} of {} parked consumers woke up", l_returned.load(), CONSUMERS));
+	for (auto& l_thread : l_consumers)
+		l_thread.join();
+	if (l_got_item != 0)
+		fail("shut down: a consumer got an item from an empty queue");
+
+	// and once shut down nothing goes in and nobody blocks
+	l_queue.add_work_item(1);
+	std::vector<int> l_items = { 2, 3 };
+	l_queue.add_work_items(l_items);
+	if (l_queue.wait_for_item().has_value() || (l_queue.wait_for_items(l_items, BATCH) != 0))
+		fail("shut down: items came out of a queue that was shut down");
+	std::cout << std::format("shut down: {} parked consumers woke up empty handed", CONSUMERS) << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	// a lost wake up would hang rather than fail, so give up loudly instead
+	std::thread l_watchdog([]() {
+		std::this_thread::sleep_for(std::chrono::seconds(WATCHDOG_SECS * 2));
+		std::cerr << "wait_queue_test: timed out" << std::endl;
+		_Exit(EXIT_FAILURE);
+	});
+	l_watchdog.detach();
+
+	test_exactly_once();
+	test_full();
+	test_shut_down();
+	std::cout << "wait_queue_test: all passed" << std::endl;
+	return 0;
+}